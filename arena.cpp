@@ -0,0 +1,116 @@
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#include "arena.hpp"
+
+// Room for the slab header, keeping what follows it maximally aligned.
+static constexpr size_t header_size =
+    (sizeof(void *) * 2 + alignof(std::max_align_t) - 1) &
+    ~(alignof(std::max_align_t) - 1);
+
+Arena::Arena(Arena &&other) noexcept
+    : cursor(std::exchange(other.cursor, nullptr)),
+      limit(std::exchange(other.limit, nullptr)),
+      head(std::exchange(other.head, nullptr)),
+      used(std::exchange(other.used, 0)),
+      reserved(std::exchange(other.reserved, 0)),
+      nodes(std::exchange(other.nodes, 0)),
+      slabs(std::exchange(other.slabs, 0)) {}
+
+Arena &Arena::operator=(Arena &&other) noexcept {
+  if (this != &other) {
+    release();
+    cursor = std::exchange(other.cursor, nullptr);
+    limit = std::exchange(other.limit, nullptr);
+    head = std::exchange(other.head, nullptr);
+    used = std::exchange(other.used, 0);
+    reserved = std::exchange(other.reserved, 0);
+    nodes = std::exchange(other.nodes, 0);
+    slabs = std::exchange(other.slabs, 0);
+  }
+  return *this;
+}
+
+void *Arena::allocate_slow(size_t size, size_t align) {
+  static_assert(sizeof(Slab) <= header_size);
+
+  if (size > slab_size / 4) {
+    // A slab of its own, linked in behind the current one so that what is
+    // left of that is still used for small allocations.
+    size_t const bytes = header_size + size;
+    Slab *const slab = static_cast<Slab *>(::operator new(bytes));
+    slab->size = bytes;
+    if (head == nullptr) {
+      slab->next = nullptr;
+      head = slab;
+    } else {
+      slab->next = head->next;
+      head->next = slab;
+    }
+    reserved += bytes;
+    ++slabs;
+    used += size;
+    return reinterpret_cast<char *>(slab) + header_size;
+  }
+
+  Slab *const slab = static_cast<Slab *>(::operator new(slab_size));
+  slab->size = slab_size;
+  slab->next = head;
+  head = slab;
+  reserved += slab_size;
+  ++slabs;
+  cursor = reinterpret_cast<char *>(slab) + header_size;
+  limit = reinterpret_cast<char *>(slab) + slab_size;
+  return allocate(size, align);
+}
+
+void Arena::adopt(Arena &&other) {
+  if (this == &other || other.head == nullptr) {
+    return;
+  }
+
+  // other's current slab goes in behind ours, so the partly used slab that
+  // stays current is this arena's
+  Slab *tail = other.head;
+  while (tail->next != nullptr) {
+    tail = tail->next;
+  }
+  if (head == nullptr) {
+    head = other.head;
+    cursor = other.cursor;
+    limit = other.limit;
+  } else {
+    tail->next = head->next;
+    head->next = other.head;
+  }
+
+  used += other.used;
+  reserved += other.reserved;
+  nodes += other.nodes;
+  slabs += other.slabs;
+
+  other.cursor = nullptr;
+  other.limit = nullptr;
+  other.head = nullptr;
+  other.used = 0;
+  other.reserved = 0;
+  other.nodes = 0;
+  other.slabs = 0;
+}
+
+void Arena::release() {
+  while (head != nullptr) {
+    Slab *const next = head->next;
+    ::operator delete(head);
+    head = next;
+  }
+
+  cursor = nullptr;
+  limit = nullptr;
+  used = 0;
+  reserved = 0;
+  nodes = 0;
+  slabs = 0;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// count Ts in an arena. Plain data, so that whatever holds one stays
+// trivially copyable and destructible.
+template <typename T> struct ArenaSpan {
+  T *data;
+  uint32_t count;
+
+  T *begin() const { return data; }
+  T *end() const { return data + count; }
+  uint32_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  T &operator[](uint32_t i) const { return data[i]; }
+};
+
+// Bump-pointer allocator for things that all die together, like the nodes
+// of one AST. Memory comes from slabs of slab_size bytes (or one slab of its
+// own for anything bigger than a quarter of that) and is only given back, all
+// at once, when the arena is destroyed or released. No destructors are run:
+// only trivially destructible objects go in an arena.
+class Arena {
+public:
+  static constexpr size_t slab_size = size_t{64} << 10;
+
+  Arena() = default;
+  ~Arena() { release(); }
+
+  Arena(Arena const &) = delete;
+  Arena &operator=(Arena const &) = delete;
+  Arena(Arena &&other) noexcept;
+  Arena &operator=(Arena &&other) noexcept;
+
+  // size bytes aligned to align, a power of two no bigger than
+  // alignof(std::max_align_t)
+  void *allocate(size_t size, size_t align) {
+    uintptr_t const p =
+        (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(align - 1);
+    if (cursor == nullptr || p + size > reinterpret_cast<uintptr_t>(limit)) {
+      return allocate_slow(size, align);
+    }
+    cursor = reinterpret_cast<char *>(p + size);
+    used += size;
+    return reinterpret_cast<void *>(p);
+  }
+
+  // A new T, counted as one node.
+  template <typename T, typename... Args> T *make(Args &&...args) {
+    static_assert(std::is_trivially_destructible_v<T>);
+    ++nodes;
+    return new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+  }
+
+  // Uninitialised room for one T, counted as one node, for the plain structs
+  // that are filled in field by field (as malloc'ed ones would be).
+  template <typename T> T *alloc() {
+    static_assert(std::is_trivially_destructible_v<T>);
+    ++nodes;
+    return static_cast<T *>(allocate(sizeof(T), alignof(T)));
+  }
+
+  // A copy of src[0, count) in one allocation.
+  template <typename T> ArenaSpan<T> make_span(T const *src, uint32_t count) {
+    static_assert(std::is_trivially_copyable_v<T> &&
+                  std::is_trivially_destructible_v<T>);
+    if (count == 0) {
+      return ArenaSpan<T>{nullptr, 0};
+    }
+    T *const data = static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+    std::memcpy(static_cast<void *>(data), src, sizeof(T) * count);
+    return ArenaSpan<T>{data, count};
+  }
+
+  // Take over everything other owns; other is left empty. Whatever was
+  // allocated from either arena stays where it is.
+  void adopt(Arena &&other);
+
+  // Free every slab.
+  void release();
+
+  // bytes handed out, padding for alignment not included
+  size_t bytes_used() const { return used; }
+  // bytes held in slabs
+  size_t bytes_reserved() const { return reserved; }
+  uint32_t node_count() const { return nodes; }
+  uint32_t slab_count() const { return slabs; }
+
+private:
+  // Slabs are chained through a header at their start.
+  struct Slab {
+    Slab *next;
+    size_t size;
+  };
+
+  void *allocate_slow(size_t size, size_t align);
+
+  char *cursor = nullptr;
+  char *limit = nullptr;
+  Slab *head = nullptr;
+  size_t used = 0;
+  size_t reserved = 0;
+  uint32_t nodes = 0;
+  uint32_t slabs = 0;
+};
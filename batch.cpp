@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "batch.hpp"
+#include "line_index.hpp"
+#include "parser.hpp"
+#include "scanner.hpp"
+#include "source_buffer.hpp"
+#include "symbol_interner.hpp"
+#include "token.hpp"
+#include "token_writer.hpp"
+#include "work_pool.hpp"
+
+void write_dump_start(CompileOptions const &options, TokenWriter *out) {
+  if (options.binary_dump) {
+    out->write_binary_header();
+  } else {
+    out->write_raw("======= The VC compiler =======\n");
+  }
+}
+
+// The tokens dump_tokens() writes out, positions and all.
+static std::vector<Token> scan_for_dump(char const *src, uint32_t length,
+                                        CompileOptions const &options) {
+  if (options.lazy_positions) {
+    // scan offsets only, then work the positions out in one pass: one
+    // cursor for all the tokens, not a walk from the start of the line for
+    // each of them, which is quadratic on long lines
+    std::vector<uint32_t> escaped_crs;
+    std::vector<Token> tokens = do_scan_offsets(src, length, &escaped_crs);
+    resolve_positions(&tokens, LineIndex(src, length, escaped_crs));
+    return tokens;
+  }
+
+  return options.scan_threads == 1
+             ? do_scan(src, length, options.engine)
+             : do_scan_parallel(src, length, options.scan_threads);
+}
+
+static void write_tokens(std::vector<Token> const &tokens, char const *src,
+                         CompileOptions const &options, TokenWriter *out) {
+  for (auto const &t : tokens) {
+    if (options.binary_dump) {
+      out->write_binary(t);
+    } else {
+      out->write_text(t, src);
+    }
+  }
+}
+
+uint32_t dump_tokens(char const *src, uint32_t length,
+                     CompileOptions const &options, TokenWriter *out) {
+  std::vector<Token> const tokens = scan_for_dump(src, length, options);
+  write_tokens(tokens, src, options, out);
+  return static_cast<uint32_t>(tokens.size());
+}
+
+CompileResult compile_source(char const *src, uint32_t length,
+                             CompileOptions const &options, TokenWriter *out,
+                             SymbolInterner *symbols) {
+  std::vector<Token> tokens = scan_for_dump(src, length, options);
+  write_tokens(tokens, src, options, out);
+
+  CompileResult result;
+  result.tokens = static_cast<uint32_t>(tokens.size());
+  if (!options.parse) {
+    return result;
+  }
+
+  if (symbols != nullptr) {
+    for (auto &t : tokens) {
+      if (t.kind == TokenKind::ID) {
+        t.payload = symbols->intern(std::string_view(
+            src + t.start_offset, t.end_offset - t.start_offset));
+      }
+    }
+  }
+  AST const ast = do_parse(tokens.data(), result.tokens);
+  if (ast.error_token != AST::no_error) {
+    result.ok = false;
+    result.error = tokens[ast.error_token];
+  }
+  return result;
+}
+
+std::string describe_error(std::string_view path, Token const &tk,
+                           std::string_view what) {
+  std::string ret(path);
+  ret += ":" + std::to_string(tk.start_pos.line_num) + ":" +
+         std::to_string(tk.start_pos.col_pos) + ": ";
+  ret += what;
+  return ret;
+}
+
+std::string describe_syntax_error(std::string_view path,
+                                  CompileResult const &result) {
+  return describe_error(path, result.error,
+                        "syntax error at " +
+                            std::string(spelling_of(result.error.kind)));
+}
+
+bool read_manifest(char const *path, std::vector<std::string> *inputs) {
+  std::ifstream manifest(path);
+  if (!manifest) {
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(manifest, line)) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    inputs->push_back(line);
+  }
+  return !manifest.bad();
+}
+
+std::vector<std::string> batch_output_paths(
+    std::vector<std::string> const &inputs, std::string const &out_dir,
+    bool binary_dump) {
+  // names handed out so far, and for each file name the suffix to try next
+  std::set<std::string> taken;
+  std::map<std::string, uint32_t> next_suffix;
+  std::vector<std::string> ret;
+  ret.reserve(inputs.size());
+
+  for (auto const &input : inputs) {
+    size_t const slash = input.find_last_of('/');
+    std::string const base =
+        slash == std::string::npos ? input : input.substr(slash + 1);
+    // a suffixed name may be another input's own file name, as with "a.vc"
+    // twice and then "a.vc.2"
+    std::string name = base;
+    uint32_t &n = next_suffix.try_emplace(base, 2).first->second;
+    while (!taken.insert(name).second) {
+      name = base + "." + std::to_string(n++);
+    }
+    ret.push_back(out_dir + "/" + name + (binary_dump ? ".bin" : ".tokens"));
+  }
+  return ret;
+}
+
+static void compile_file(std::string const &input,
+                         CompileOptions const &options,
+                         BatchFileResult *result) {
+  SourceBuffer src;
+  if (!src.open(input.c_str())) {
+    result->error = "cannot read " + input;
+    return;
+  }
+
+  int const fd = ::open(result->output_path.c_str(),
+                        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    result->error = "cannot write " + result->output_path + ": " +
+                    std::strerror(errno);
+    return;
+  }
+
+  bool written;
+  CompileResult compiled;
+  {
+    TokenWriter out(fd);
+    write_dump_start(options, &out);
+    compiled = compile_source(src.data(), src.size(), options, &out);
+    written = out.flush();
+  }
+  if (::close(fd) != 0 || !written) {
+    result->error = "cannot write " + result->output_path;
+    return;
+  }
+
+  result->tokens = compiled.tokens;
+  result->bytes = src.size();
+  if (!compiled.ok) {
+    result->error = describe_syntax_error(input, compiled);
+    return;
+  }
+  result->ok = true;
+}
+
+BatchReport run_batch(std::vector<std::string> const &inputs,
+                      std::string const &out_dir,
+                      CompileOptions const &options, uint32_t threads,
+                      std::vector<BatchFileResult> *results) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  std::vector<std::string> const outputs =
+      batch_output_paths(inputs, out_dir, options.binary_dump);
+  results->assign(inputs.size(), BatchFileResult{});
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    (*results)[i].output_path = outputs[i];
+  }
+
+  // the files are the unit of parallelism, each one is scanned on one thread
+  CompileOptions file_options = options;
+  file_options.scan_threads = 1;
+
+  auto const start = std::chrono::steady_clock::now();
+  run_work_stealing(static_cast<uint32_t>(inputs.size()), threads,
+                    [&](uint32_t i) {
+                      compile_file(inputs[i], file_options, &(*results)[i]);
+                    });
+  auto const stop = std::chrono::steady_clock::now();
+
+  BatchReport report;
+  report.seconds = std::chrono::duration<double>(stop - start).count();
+  for (auto const &result : *results) {
+    ++report.files;
+    report.failed += !result.ok;
+    report.bytes += result.bytes;
+    report.tokens += result.tokens;
+  }
+  return report;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "scanner.hpp"
+#include "token.hpp"
+#include "token_writer.hpp"
+
+class SymbolInterner;
+
+// What the driver does to one source file, in batch mode or not.
+struct CompileOptions {
+  ScanEngine engine = default_scan_engine;
+  bool lazy_positions = false;
+  bool binary_dump = false;
+  // 1: scan on the calling thread, 0: as many threads as the machine has
+  uint32_t scan_threads = 1;
+  // parse the tokens after dumping them, and fail on a syntax error
+  bool parse = false;
+};
+
+// The banner, or the binary header, that starts every dump.
+void write_dump_start(CompileOptions const &options, TokenWriter *out);
+
+// Scan src[0, length) and dump every token to *out. Returns the number of
+// tokens.
+uint32_t dump_tokens(char const *src, uint32_t length,
+                     CompileOptions const &options, TokenWriter *out);
+
+struct CompileResult {
+  uint32_t tokens = 0;
+  bool ok = true;
+  // if not ok, the token the parser gave up at
+  Token error = {};
+};
+
+// What the driver does to one source file: dump_tokens(), then with
+// options.parse, parse the tokens. With `symbols`, identifiers are interned
+// into it before parsing, so that their tokens in the AST carry symbol IDs.
+// There is no stage after the parser yet, so the AST itself is dropped.
+CompileResult compile_source(char const *src, uint32_t length,
+                             CompileOptions const &options, TokenWriter *out,
+                             SymbolInterner *symbols = nullptr);
+
+// The line the driver prints for an error at `tk` in the file at `path`:
+// "PATH:LINE:COL: WHAT".
+std::string describe_error(std::string_view path, Token const &tk,
+                           std::string_view what);
+
+// describe_error() for the syntax error compile_source() found.
+std::string describe_syntax_error(std::string_view path,
+                                  CompileResult const &result);
+
+// Paths listed in a manifest, one per line. Blank lines and lines starting
+// with '#' are skipped. Returns false if the manifest can't be read.
+bool read_manifest(char const *path, std::vector<std::string> *inputs);
+
+// Where the dump of each input goes: out_dir/<file name>.tokens (or .bin),
+// with the first of ".2", ".3", ... that gives a name not yet handed out
+// added for later inputs whose name is taken, so every input gets a file of
+// its own and the names only depend on the order of the inputs.
+std::vector<std::string> batch_output_paths(
+    std::vector<std::string> const &inputs, std::string const &out_dir,
+    bool binary_dump);
+
+struct BatchFileResult {
+  bool ok = false;
+  uint32_t bytes = 0;
+  uint32_t tokens = 0;
+  std::string output_path;
+  // why the file failed, empty if it did not. A file that does not parse
+  // still has its dump written.
+  std::string error;
+};
+
+struct BatchReport {
+  uint32_t files = 0;
+  uint32_t failed = 0;
+  uint64_t bytes = 0;
+  uint64_t tokens = 0;
+  double seconds = 0;
+};
+
+// Compile every input to its own output file under out_dir, on `threads`
+// worker threads (0: one per hardware thread) that steal files from each
+// other. Each output is exactly what the driver prints for that file on its
+// own. results[i] is filled in for inputs[i].
+BatchReport run_batch(std::vector<std::string> const &inputs,
+                      std::string const &out_dir,
+                      CompileOptions const &options, uint32_t threads,
+                      std::vector<BatchFileResult> *results);
@@ -0,0 +1,265 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define EVC_HAVE_TSC 1
+#else
+#define EVC_HAVE_TSC 0
+#endif
+
+#include "corpus.hpp"
+#include "literal_table.hpp"
+#include "scanner.hpp"
+#include "scanner_simd.hpp"
+#include "symbol_interner.hpp"
+#include "token.hpp"
+#include "token_sink.hpp"
+#include "token_stream.hpp"
+
+// Scanner throughput over synthetic corpora.
+//
+//   bench_scanner [--size=MB] [--mix=NAME|all] [--min-time=SECONDS]
+//                 [--seeds=DIR]
+//
+// For every corpus mix and scanner entry point it prints MB/s, tokens/s,
+// cycles/byte and the heap allocations one scan makes. Cycles are time stamp
+// counter ticks, i.e. at the nominal clock rate rather than the one the core
+// actually ran at. Configure with -DCMAKE_BUILD_TYPE=Release for numbers
+// worth comparing.
+
+static std::atomic<uint64_t> allocation_count{0};
+static std::atomic<uint64_t> allocation_bytes{0};
+
+void *operator new(size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+  if (void *p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+static uint64_t read_cycles() {
+#if EVC_HAVE_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+struct Engine {
+  char const *name;
+  // returns the number of tokens
+  size_t (*scan)(std::string const &src);
+};
+
+static size_t scan_switch(std::string const &src) {
+  return do_scan(src.data(), static_cast<uint32_t>(src.size())).size();
+}
+
+static size_t scan_table(std::string const &src) {
+  return do_scan_table(src.data(), static_cast<uint32_t>(src.size())).size();
+}
+
+static size_t scan_offsets(std::string const &src) {
+  std::vector<uint32_t> escaped_crs;
+  return do_scan_offsets(src.data(), static_cast<uint32_t>(src.size()),
+                         &escaped_crs)
+      .size();
+}
+
+// The corpus being measured with every error token blanked out, so that
+// check_scan has to go all the way through. main() makes it for each mix.
+static std::string corpus_without_errors;
+
+static std::string remove_errors(std::string src) {
+  // blanking an unterminated comment or string can open up new errors
+  for (uint32_t round = 0; round < 8; ++round) {
+    bool found = false;
+    for (auto const &t :
+         do_scan(src.data(), static_cast<uint32_t>(src.size()))) {
+      if (is_error(t.kind)) {
+        // strings start past their quote
+        uint32_t const from = t.start_offset > 0 ? t.start_offset - 1 : 0;
+        src.replace(from, t.end_offset - from, t.end_offset - from, ' ');
+        found = true;
+      }
+    }
+    if (!found) {
+      break;
+    }
+  }
+  return src;
+}
+
+static size_t scan_check(std::string const &) {
+  std::string const &src = corpus_without_errors;
+  return check_scan(src.data(), static_cast<uint32_t>(src.size())) ? 0 : 1;
+}
+
+static size_t scan_stream(std::string const &src) {
+  TokenStream stream;
+  do_scan(src.data(), static_cast<uint32_t>(src.size()), &stream);
+  return stream.size();
+}
+
+static size_t scan_counting(std::string const &src) {
+  size_t count = 0;
+  do_scan(src.data(), static_cast<uint32_t>(src.size()),
+          [&count](Token const &) { ++count; });
+  return count;
+}
+
+static size_t scan_literals(std::string const &src) {
+  LiteralTable table;
+  return do_scan_literals(src.data(), static_cast<uint32_t>(src.size()),
+                          &table)
+      .size();
+}
+
+static size_t scan_interned(std::string const &src) {
+  LiteralTable table;
+  SymbolInterner symbols;
+  return do_scan_literals(src.data(), static_cast<uint32_t>(src.size()),
+                          &table, &symbols)
+      .size();
+}
+
+static size_t scan_parallel(std::string const &src) {
+  return do_scan_parallel(src.data(), static_cast<uint32_t>(src.size()))
+      .size();
+}
+
+static constexpr Engine engines[] = {
+    {"do_scan", scan_switch},
+    {"do_scan_table", scan_table},
+    {"do_scan_offsets", scan_offsets},
+    {"check_scan(no errors)", scan_check},
+    {"do_scan(TokenStream)", scan_stream},
+    {"do_scan(counting sink)", scan_counting},
+    {"do_scan_parallel", scan_parallel},
+    {"do_scan_literals", scan_literals},
+    {"do_scan_literals(symbols)", scan_interned},
+};
+
+struct Result {
+  double seconds_per_scan;
+  double cycles_per_scan;
+  size_t tokens;
+  uint64_t allocations;
+  uint64_t allocated_bytes;
+};
+
+static Result measure(Engine const &engine, std::string const &src,
+                      double min_time) {
+  Result ret = {};
+
+  // one untimed scan to warm up and to count allocations
+  uint64_t const count_before = allocation_count.load();
+  uint64_t const bytes_before = allocation_bytes.load();
+  ret.tokens = engine.scan(src);
+  ret.allocations = allocation_count.load() - count_before;
+  ret.allocated_bytes = allocation_bytes.load() - bytes_before;
+
+  using clock = std::chrono::steady_clock;
+  uint32_t iterations = 0;
+  auto const start = clock::now();
+  uint64_t const start_cycles = read_cycles();
+  double elapsed = 0;
+  do {
+    engine.scan(src);
+    ++iterations;
+    elapsed = std::chrono::duration<double>(clock::now() - start).count();
+  } while (elapsed < min_time);
+  uint64_t const cycles = read_cycles() - start_cycles;
+
+  ret.seconds_per_scan = elapsed / iterations;
+  ret.cycles_per_scan = static_cast<double>(cycles) / iterations;
+  return ret;
+}
+
+int main(int argc, char **argv) {
+  double size_mb = 8;
+  double min_time = 1;
+  std::string_view mix_name = "all";
+  char const *seeds_dir = EVC_SCANNER_TESTS_DIR "/test";
+
+  for (int i = 1; i < argc; ++i) {
+    std::string_view const arg = argv[i];
+    if (arg.starts_with("--size=")) {
+      size_mb = std::atof(argv[i] + sizeof("--size=") - 1);
+    } else if (arg.starts_with("--mix=")) {
+      mix_name = arg.substr(sizeof("--mix=") - 1);
+    } else if (arg.starts_with("--min-time=")) {
+      min_time = std::atof(argv[i] + sizeof("--min-time=") - 1);
+    } else if (arg.starts_with("--seeds=")) {
+      seeds_dir = argv[i] + sizeof("--seeds=") - 1;
+    } else {
+      std::fprintf(stderr,
+                   "usage: %s [--size=MB] [--mix=NAME|all] "
+                   "[--min-time=SECONDS] [--seeds=DIR]\n",
+                   argv[0]);
+      return 1;
+    }
+  }
+
+  std::vector<CorpusMix> mixes;
+  if (mix_name == "all") {
+    mixes.assign(std::begin(all_corpus_mixes), std::end(all_corpus_mixes));
+  } else {
+    CorpusMix mix;
+    if (!parse_corpus_mix(mix_name, &mix)) {
+      std::fprintf(stderr, "unknown corpus mix %.*s\n",
+                   static_cast<int>(mix_name.size()), mix_name.data());
+      return 1;
+    }
+    mixes.push_back(mix);
+  }
+
+#ifndef NDEBUG
+  std::fprintf(stderr, "warning: assertions are on, this is not a release "
+                       "build\n");
+#endif
+
+  std::vector<std::string> const seeds = load_seed_sources(seeds_dir);
+  if (seeds.empty()) {
+    std::fprintf(stderr, "warning: no seed files in %s\n", seeds_dir);
+  }
+
+  static constexpr char const *level_names[] = {"scalar", "sse2", "avx2"};
+  std::printf("simd level %s, %zu seed files\n",
+              level_names[static_cast<int>(active_simd_level())],
+              seeds.size());
+  std::printf("%-12s %-26s %9s %10s %12s %8s %8s %12s\n", "mix", "engine",
+              "bytes", "MB/s", "tokens/s", "cyc/B", "allocs", "alloc bytes");
+
+  for (CorpusMix const mix : mixes) {
+    std::string const src = generate_corpus(
+        mix, static_cast<uint32_t>(size_mb * 1024 * 1024), seeds);
+    corpus_without_errors = remove_errors(src);
+
+    for (Engine const &engine : engines) {
+      Result const r = measure(engine, src, min_time);
+      std::printf("%-12.*s %-26s %9zu %10.1f %12.0f %8.2f %8llu %12llu\n",
+                  static_cast<int>(corpus_mix_name(mix).size()),
+                  corpus_mix_name(mix).data(), engine.name, src.size(),
+                  src.size() / r.seconds_per_scan / (1024 * 1024),
+                  r.tokens / r.seconds_per_scan,
+                  r.cycles_per_scan / src.size(),
+                  static_cast<unsigned long long>(r.allocations),
+                  static_cast<unsigned long long>(r.allocated_bytes));
+    }
+  }
+}
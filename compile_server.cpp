@@ -0,0 +1,356 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+#include "batch.hpp"
+#include "compile_server.hpp"
+#include "scanner.hpp"
+#include "token_writer.hpp"
+
+static bool read_exact(int fd, void *dst, size_t size) {
+  char *p = static_cast<char *>(dst);
+  while (size > 0) {
+    ssize_t const got = ::read(fd, p, size);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      return false;
+    }
+    p += got;
+    size -= static_cast<size_t>(got);
+  }
+  return true;
+}
+
+// MSG_NOSIGNAL: a client going away must not kill the server with SIGPIPE
+static bool write_exact(int fd, void const *src, size_t size) {
+  char const *p = static_cast<char const *>(src);
+  while (size > 0) {
+    ssize_t const sent = ::send(fd, p, size, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    p += sent;
+    size -= static_cast<size_t>(sent);
+  }
+  return true;
+}
+
+static bool make_address(char const *path, sockaddr_un *addr) {
+  if (std::strlen(path) >= sizeof(addr->sun_path)) {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+  std::memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  std::strcpy(addr->sun_path, path);
+  return true;
+}
+
+static CompileOptions options_from_flags(uint32_t flags) {
+  CompileOptions options;
+  options.binary_dump = (flags & request_binary_dump) != 0;
+  options.lazy_positions = (flags & request_lazy_positions) != 0;
+  options.engine = (flags & request_table_engine) != 0 ? ScanEngine::Table
+                                                       : ScanEngine::Switch;
+  options.parse = (flags & request_parse) != 0;
+  return options;
+}
+
+static uint32_t flags_from_options(CompileOptions const &options) {
+  return (options.binary_dump ? static_cast<uint32_t>(request_binary_dump)
+                              : 0u) |
+         (options.lazy_positions
+              ? static_cast<uint32_t>(request_lazy_positions)
+              : 0u) |
+         (options.engine == ScanEngine::Table
+              ? static_cast<uint32_t>(request_table_engine)
+              : 0u) |
+         (options.parse ? static_cast<uint32_t>(request_parse) : 0u);
+}
+
+CompileServer::CompileServer(uint32_t threads) : threads(threads) {
+  if (this->threads == 0) {
+    this->threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+}
+
+CompileServer::~CompileServer() {
+  stop();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  if (listen_fd >= 0) {
+    ::close(listen_fd);
+  }
+}
+
+bool CompileServer::listen(char const *path) {
+  sockaddr_un addr;
+  if (!make_address(path, &addr)) {
+    return false;
+  }
+
+  listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0) {
+    return false;
+  }
+  // a socket file nobody answers on is what a crashed server leaves behind
+  ::unlink(path);
+  if (::bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) !=
+          0 ||
+      ::listen(listen_fd, SOMAXCONN) != 0) {
+    int const saved = errno;
+    ::close(listen_fd);
+    listen_fd = -1;
+    errno = saved;
+    return false;
+  }
+
+  socket_path = path;
+  return true;
+}
+
+void CompileServer::serve() {
+  for (uint32_t i = 0; i < threads; ++i) {
+    workers.emplace_back([this] { work(); });
+  }
+
+  for (;;) {
+    int const fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      // stop() shut the listening socket down, or it failed for good
+      break;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopping) {
+      ::close(fd);
+      break;
+    }
+    pending.push_back(fd);
+    ready.notify_one();
+  }
+
+  stop();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  workers.clear();
+  ::unlink(socket_path.c_str());
+}
+
+void CompileServer::stop() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (stopping) {
+    return;
+  }
+  stopping = true;
+  if (listen_fd >= 0) {
+    ::shutdown(listen_fd, SHUT_RDWR);
+  }
+  // clients sitting on idle connections would otherwise keep workers waiting
+  for (int const fd : active) {
+    ::shutdown(fd, SHUT_RD);
+  }
+  for (int const fd : pending) {
+    ::close(fd);
+  }
+  pending.clear();
+  ready.notify_all();
+}
+
+void CompileServer::work() {
+  Scratch scratch;
+  for (;;) {
+    int fd;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      ready.wait(lock, [this] { return stopping || !pending.empty(); });
+      if (pending.empty()) {
+        return;
+      }
+      fd = pending.front();
+      pending.pop_front();
+      active.insert(fd);
+    }
+
+    handle_connection(fd, &scratch);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    active.erase(fd);
+    ::close(fd);
+  }
+}
+
+// Answer a request the server will not compile. The connection is closed
+// after this, as whatever the client sent after the header can't be trusted.
+static void refuse(int fd, std::string const &diagnostics) {
+  ServerResponseHeader const response = {
+      .magic = {'E', 'V', 'C', 'R'},
+      .status = 1,
+      .output_length = 0,
+      .diagnostics_length = static_cast<uint32_t>(diagnostics.size()),
+  };
+  if (write_exact(fd, &response, sizeof(response))) {
+    write_exact(fd, diagnostics.data(), diagnostics.size());
+  }
+}
+
+void CompileServer::handle_connection(int fd, Scratch *scratch) {
+  ServerRequestHeader request;
+  while (read_exact(fd, &request, sizeof(request))) {
+    ServerResponseHeader response = {.magic = {'E', 'V', 'C', 'R'},
+                                     .status = 0,
+                                     .output_length = 0,
+                                     .diagnostics_length = 0};
+
+    if (std::memcmp(request.magic, "EVCQ", 4) != 0 ||
+        request.version != server_protocol_version) {
+      refuse(fd, "unsupported compile request\n");
+      return;
+    }
+
+    if (request.flags & request_stop_server) {
+      write_exact(fd, &response, sizeof(response));
+      stop();
+      return;
+    }
+
+    // the lengths come from the client: don't let them size the buffers
+    if (request.source_length > server_max_source_length ||
+        request.path_length > server_max_path_length) {
+      refuse(fd, "source too large for the compile server\n");
+      return;
+    }
+
+    scratch->path.resize(request.path_length);
+    scratch->source.resize(request.source_length);
+    if (!read_exact(fd, scratch->path.data(), request.path_length) ||
+        !read_exact(fd, scratch->source.data(), request.source_length)) {
+      return;
+    }
+
+    scratch->output.clear();
+    std::string diagnostics;
+    if (request.flags & request_check_only) {
+      Token error;
+      if (!check_scan(scratch->source.data(), request.source_length,
+                      &error)) {
+        diagnostics =
+            describe_error(scratch->path, error, spelling_of(error.kind)) +
+            "\n";
+        response.status = 1;
+      }
+    } else {
+      CompileOptions const options = options_from_flags(request.flags);
+      TokenWriter out(&scratch->output);
+      write_dump_start(options, &out);
+      // emptied, but its storage is kept for the next request
+      scratch->symbols.clear();
+      CompileResult const result =
+          compile_source(scratch->source.data(), request.source_length,
+                         options, &out, &scratch->symbols);
+      if (!result.ok) {
+        diagnostics = describe_syntax_error(scratch->path, result) + "\n";
+        response.status = 1;
+      }
+    }
+
+    response.output_length = static_cast<uint32_t>(scratch->output.size());
+    response.diagnostics_length = static_cast<uint32_t>(diagnostics.size());
+    if (!write_exact(fd, &response, sizeof(response)) ||
+        !write_exact(fd, scratch->output.data(), scratch->output.size()) ||
+        !write_exact(fd, diagnostics.data(), diagnostics.size())) {
+      return;
+    }
+  }
+}
+
+int connect_compile_server(char const *socket_path) {
+  sockaddr_un addr;
+  if (!make_address(socket_path, &addr)) {
+    return -1;
+  }
+
+  int const fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    int const saved = errno;
+    ::close(fd);
+    errno = saved;
+    return -1;
+  }
+  return fd;
+}
+
+static bool read_response(int fd, ServerResponse *response) {
+  ServerResponseHeader header;
+  if (!read_exact(fd, &header, sizeof(header)) ||
+      std::memcmp(header.magic, "EVCR", 4) != 0) {
+    return false;
+  }
+
+  response->status = header.status;
+  response->output.resize(header.output_length);
+  response->diagnostics.resize(header.diagnostics_length);
+  return read_exact(fd, response->output.data(), header.output_length) &&
+         read_exact(fd, response->diagnostics.data(),
+                    header.diagnostics_length);
+}
+
+static bool send_request(int fd, uint32_t flags, std::string const &path,
+                         char const *src, uint32_t length,
+                         ServerResponse *response) {
+  ServerRequestHeader const header = {
+      .magic = {'E', 'V', 'C', 'Q'},
+      .version = server_protocol_version,
+      .flags = flags,
+      .path_length = static_cast<uint32_t>(path.size()),
+      .source_length = length,
+  };
+  return write_exact(fd, &header, sizeof(header)) &&
+         write_exact(fd, path.data(), path.size()) &&
+         write_exact(fd, src, length) && read_response(fd, response);
+}
+
+bool request_compile(int fd, CompileOptions const &options,
+                     std::string const &path, char const *src,
+                     uint32_t length, ServerResponse *response) {
+  return send_request(fd, flags_from_options(options), path, src, length,
+                      response);
+}
+
+bool request_check(int fd, std::string const &path, char const *src,
+                   uint32_t length, ServerResponse *response) {
+  return send_request(fd, request_check_only, path, src, length, response);
+}
+
+bool request_shutdown(int fd) {
+  ServerRequestHeader const header = {
+      .magic = {'E', 'V', 'C', 'Q'},
+      .version = server_protocol_version,
+      .flags = request_stop_server,
+      .path_length = 0,
+      .source_length = 0,
+  };
+  ServerResponse response;
+  return write_exact(fd, &header, sizeof(header)) &&
+         read_response(fd, &response);
+}
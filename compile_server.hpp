@@ -0,0 +1,131 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "batch.hpp"
+#include "symbol_interner.hpp"
+
+// A resident compiler on a Unix domain socket, so that compiling a file
+// costs a round trip instead of starting a process.
+//
+// A connection carries any number of requests, one after the other. Each
+// request is a ServerRequestHeader followed by the path the source was read
+// from (only used in diagnostics) and the source; the reply is a
+// ServerResponseHeader followed by the output and then the diagnostics,
+// which are exactly what main_runner would print on stdout and stderr for
+// that file, and the status it would exit with. All fields are in host byte
+// order, the socket never leaving the machine.
+//
+// Each worker keeps its buffers and a SymbolInterner from one request to
+// the next, so that once warm, a parse interns identifiers without going
+// back to the allocator.
+
+struct ServerRequestHeader {
+  char magic[4]; // "EVCQ"
+  uint32_t version;
+  uint32_t flags; // ServerRequestFlags
+  uint32_t path_length;
+  uint32_t source_length;
+};
+
+enum ServerRequestFlags : uint32_t {
+  request_binary_dump = 1u << 0,
+  request_lazy_positions = 1u << 1,
+  request_table_engine = 1u << 2,
+  // stop the server once this connection has been answered; no source
+  request_stop_server = 1u << 3,
+  request_parse = 1u << 4,
+  // what `main_runner --check` does instead: no output, the first lexical
+  // error if any as the diagnostics; the other flags are ignored
+  request_check_only = 1u << 5,
+};
+
+struct ServerResponseHeader {
+  char magic[4]; // "EVCR"
+  uint32_t status;
+  uint32_t output_length;
+  uint32_t diagnostics_length;
+};
+
+static constexpr uint32_t server_protocol_version = 2;
+
+// Larger requests are refused with a non-zero status, before the server
+// allocates anything for them.
+static constexpr uint32_t server_max_source_length = 256u << 20;
+static constexpr uint32_t server_max_path_length = 4096;
+
+class CompileServer {
+public:
+  // `threads` connections are served at once, 0 meaning one per hardware
+  // thread.
+  explicit CompileServer(uint32_t threads = 0);
+  ~CompileServer();
+
+  CompileServer(CompileServer const &) = delete;
+  CompileServer &operator=(CompileServer const &) = delete;
+
+  // Bind to socket_path, replacing a stale socket left there. Returns false
+  // with errno set on failure.
+  bool listen(char const *socket_path);
+
+  // Accept and answer connections until a client asks for a shutdown. The
+  // socket file is removed on the way out.
+  void serve();
+
+private:
+  // What a worker keeps between requests so that, once warm, answering one
+  // does not go back to the allocator.
+  struct Scratch {
+    std::string path;
+    std::string source;
+    std::string output;
+    SymbolInterner symbols;
+  };
+
+  void work();
+  void handle_connection(int fd, Scratch *scratch);
+  void stop();
+
+  uint32_t threads;
+  int listen_fd = -1;
+  std::string socket_path;
+
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::deque<int> pending;
+  // connections being answered, shut down to unblock their workers on stop
+  std::set<int> active;
+  bool stopping = false;
+  std::vector<std::thread> workers;
+};
+
+struct ServerResponse {
+  uint32_t status = 0;
+  std::string output;
+  std::string diagnostics;
+};
+
+// Client side. Returns the connected socket, or -1 with errno set.
+int connect_compile_server(char const *socket_path);
+
+// Compile src[0, length), read from `path`, on the server at the other end
+// of `fd`. Returns false if the connection failed.
+bool request_compile(int fd, CompileOptions const &options,
+                     std::string const &path, char const *src,
+                     uint32_t length, ServerResponse *response);
+
+// Lex src[0, length), read from `path`, on the server only as far as its
+// first error, like `main_runner --check`. Returns false if the connection
+// failed.
+bool request_check(int fd, std::string const &path, char const *src,
+                   uint32_t length, ServerResponse *response);
+
+// Ask the server to stop, waiting for it to acknowledge.
+bool request_shutdown(int fd);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Synthetic VC sources for benchmarking the scanner. A corpus is the seed
+// files (normally ScannerTests/test/*.vc) over and over, with generated lines
+// of one flavour mixed in between them to lean on a particular part of the
+// scanner.
+
+enum class CorpusMix {
+  // the seed files and nothing else
+  Seeds,
+  // declarations and expressions with long, keyword-like identifiers
+  Identifiers,
+  // line comments and multi-line block comments
+  Comments,
+  // string literals full of escapes
+  Strings,
+  // float literals with fractions and signed exponents
+  Floats,
+  // the seed files with every line ending turned into "\r\n"
+  Crlf,
+};
+
+static constexpr CorpusMix all_corpus_mixes[] = {
+    CorpusMix::Seeds,   CorpusMix::Identifiers, CorpusMix::Comments,
+    CorpusMix::Strings, CorpusMix::Floats,      CorpusMix::Crlf,
+};
+
+std::string_view corpus_mix_name(CorpusMix mix);
+
+// Returns false if `name` is not one of the corpus_mix_name()s.
+bool parse_corpus_mix(std::string_view name, CorpusMix *mix);
+
+// Contents of every regular file in `dir`, sorted by file name so the
+// corpus doesn't depend on directory order.
+std::vector<std::string> load_seed_sources(char const *dir);
+
+// At least `size` bytes of `mix`, the same for the same seed value.
+std::string generate_corpus(CorpusMix mix, uint32_t size,
+                            std::vector<std::string> const &seeds,
+                            uint32_t seed = 1);
@@ -1,33 +1,168 @@
 #include <cassert>
 #include <cstdio>
-#include <fstream>
-#include <iostream>
-#include <sstream>
+#include <cstdlib>
 #include <stdio.h>
+#include <string>
+#include <string_view>
+#include <unistd.h>
 #include <vector>
 
+#include "batch.hpp"
+#include "compile_server.hpp"
 #include "scanner.hpp"
+#include "source_buffer.hpp"
 #include "token.hpp"
+#include "token_writer.hpp"
+
+// evc [options] FILE
+// evc [options] --batch [--out-dir=DIR] [--manifest=LIST] FILE...
+// evc [--threads=N] --serve=SOCKET
+// evc --check FILE
+//
+// Batch mode compiles every file given, and every file listed in the
+// manifest, each to its own output file under DIR (default "."), and prints
+// the aggregate throughput.
+//
+// Serving listens on a Unix domain socket for evc_client (or anything else
+// speaking compile_server.hpp's protocol) until a client asks it to stop.
+//
+// Checking only lexes up to the first error, if any, which it prints as
+// FILE:LINE:COL: KIND and exits with 1.
+//
+// With --parse the tokens are parsed once they have been dumped, and a
+// syntax error is printed as FILE:LINE:COL: syntax error at KIND, with exit
+// status 1. In batch mode that makes the file count as failed.
+static int run_batch_mode(std::vector<std::string> const &inputs,
+                          std::string const &out_dir,
+                          CompileOptions const &options, uint32_t threads) {
+  std::vector<BatchFileResult> results;
+  BatchReport const report =
+      run_batch(inputs, out_dir, options, threads, &results);
+
+  for (auto const &result : results) {
+    if (!result.ok) {
+      std::fprintf(stderr, "%s\n", result.error.c_str());
+    }
+  }
+
+  double const seconds = report.seconds > 0 ? report.seconds : 1e-9;
+  std::printf("%u files (%u failed), %llu bytes, %llu tokens in %.3f s: "
+              "%.1f files/s, %.1f MB/s, %.0f tokens/s\n",
+              report.files, report.failed,
+              static_cast<unsigned long long>(report.bytes),
+              static_cast<unsigned long long>(report.tokens), report.seconds,
+              report.files / seconds, report.bytes / seconds / (1024 * 1024),
+              report.tokens / seconds);
+  return report.failed == 0 ? 0 : 1;
+}
 
 int main(int argc, char **argv) {
 
-  assert(argc == 2 && "Please give us two args");
+  CompileOptions options;
+  // 1: scan on this thread, 0: as many threads as the machine has. In batch
+  // and server mode, the number of files compiled at once.
+  uint32_t threads = 1;
+  bool threads_given = false;
+  bool batch = false;
+  bool check = false;
+  std::string out_dir = ".";
+  char const *serve_path = nullptr;
+  std::vector<std::string> inputs;
 
-  std::printf("======= The VC compiler =======\n");
+  for (int i = 1; i < argc; ++i) {
+    std::string_view const arg = argv[i];
+    if (arg == "--engine=switch") {
+      options.engine = ScanEngine::Switch;
+    } else if (arg == "--engine=table") {
+      options.engine = ScanEngine::Table;
+    } else if (arg == "--lazy-positions") {
+      options.lazy_positions = true;
+    } else if (arg == "--dump=text") {
+      options.binary_dump = false;
+    } else if (arg == "--dump=binary") {
+      options.binary_dump = true;
+    } else if (arg.starts_with("--threads=")) {
+      threads = static_cast<uint32_t>(
+          std::strtoul(argv[i] + sizeof("--threads=") - 1, nullptr, 10));
+      threads_given = true;
+    } else if (arg.starts_with("--serve=")) {
+      serve_path = argv[i] + sizeof("--serve=") - 1;
+    } else if (arg == "--check") {
+      check = true;
+    } else if (arg == "--parse") {
+      options.parse = true;
+    } else if (arg == "--batch") {
+      batch = true;
+    } else if (arg.starts_with("--out-dir=")) {
+      out_dir = arg.substr(sizeof("--out-dir=") - 1);
+    } else if (arg.starts_with("--manifest=")) {
+      batch = true;
+      char const *const manifest = argv[i] + sizeof("--manifest=") - 1;
+      if (!read_manifest(manifest, &inputs)) {
+        std::fprintf(stderr, "cannot read manifest %s\n", manifest);
+        return 1;
+      }
+    } else {
+      inputs.push_back(argv[i]);
+    }
+  }
 
-  std::ifstream src_file(argv[1]);
-  assert(src_file.is_open());
+  if (serve_path != nullptr) {
+    CompileServer server(threads_given ? threads : 0);
+    if (!server.listen(serve_path)) {
+      std::perror(serve_path);
+      return 1;
+    }
+    server.serve();
+    return 0;
+  }
 
-  std::stringstream filebuf;
-  filebuf << src_file.rdbuf();
+  if (batch) {
+    // one file per core unless told otherwise
+    return run_batch_mode(inputs, out_dir, options,
+                          threads_given ? threads : 0);
+  }
+
+  assert(inputs.size() == 1 && "Please give us one source file");
+  char const *const src_path = inputs[0].c_str();
+  options.scan_threads = threads;
 
-  auto f = filebuf.str();
+  if (check) {
+    SourceBuffer src;
+    if (!src.open(src_path)) {
+      std::fprintf(stderr, "cannot read %s\n", src_path);
+      return 1;
+    }
+    Token error;
+    if (check_scan(src.data(), src.size(), &error)) {
+      return 0;
+    }
+    std::fprintf(
+        stderr, "%s\n",
+        describe_error(src_path, error, spelling_of(error.kind)).c_str());
+    return 1;
+  }
 
-  std::vector<Token> tokens = do_scan(f.data(), f.size());
+  TokenWriter out(STDOUT_FILENO);
+  write_dump_start(options, &out);
 
-  for (auto const t : tokens) {
-    std::printf("%s\n", to_string(t, f.data(), f.size()).c_str());
+  // mapped for the whole compile: token offsets index straight into it
+  SourceBuffer src;
+  if (!src.open(src_path)) {
+    out.flush();
+    std::fprintf(stderr, "cannot read %s\n", src_path);
+    return 1;
   }
 
-  tokens.data();
-}
\ No newline at end of file
+  CompileResult const result =
+      compile_source(src.data(), src.size(), options, &out);
+  if (!out.flush()) {
+    return 1;
+  }
+  if (!result.ok) {
+    std::fprintf(stderr, "%s\n",
+                 describe_syntax_error(src_path, result).c_str());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,114 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string_view>
+#include <unistd.h>
+
+#include "batch.hpp"
+#include "compile_server.hpp"
+#include "source_buffer.hpp"
+#include "token_writer.hpp"
+
+// Thin client for `main_runner --serve=SOCKET`, standing in for main_runner
+// itself: same options, same output, same exit status.
+//
+//   evc_client [--socket=PATH] [options] FILE
+//   evc_client [--socket=PATH] --check FILE
+//   evc_client [--socket=PATH] --shutdown
+//
+// main_runner's batch and serving options have no meaning here and are
+// refused, like any other option the server doesn't know.
+//
+// The socket defaults to $EVC_SERVER_SOCKET.
+
+int main(int argc, char **argv) {
+  CompileOptions options;
+  char const *socket_path = std::getenv("EVC_SERVER_SOCKET");
+  char const *src_path = nullptr;
+  bool shutdown = false;
+  bool check = false;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string_view const arg = argv[i];
+    if (arg == "--engine=switch") {
+      options.engine = ScanEngine::Switch;
+    } else if (arg == "--engine=table") {
+      options.engine = ScanEngine::Table;
+    } else if (arg == "--lazy-positions") {
+      options.lazy_positions = true;
+    } else if (arg == "--dump=text") {
+      options.binary_dump = false;
+    } else if (arg == "--dump=binary") {
+      options.binary_dump = true;
+    } else if (arg == "--parse") {
+      options.parse = true;
+    } else if (arg.starts_with("--threads=")) {
+      // the server decides how files are scanned
+    } else if (arg.starts_with("--socket=")) {
+      socket_path = argv[i] + sizeof("--socket=") - 1;
+    } else if (arg == "--shutdown") {
+      shutdown = true;
+    } else if (arg == "--check") {
+      check = true;
+    } else if (arg.starts_with("--")) {
+      std::fprintf(stderr, "evc_client: unsupported option %s\n", argv[i]);
+      return 1;
+    } else if (src_path == nullptr) {
+      src_path = argv[i];
+    } else {
+      std::fprintf(stderr, "Please give us one source file\n");
+      return 1;
+    }
+  }
+
+  if (socket_path == nullptr) {
+    std::fprintf(stderr, "no server socket: use --socket=PATH or set "
+                         "EVC_SERVER_SOCKET\n");
+    return 1;
+  }
+  int const fd = connect_compile_server(socket_path);
+  if (fd < 0) {
+    std::perror(socket_path);
+    return 1;
+  }
+
+  if (shutdown) {
+    bool const ok = request_shutdown(fd);
+    ::close(fd);
+    return ok ? 0 : 1;
+  }
+
+  if (src_path == nullptr) {
+    std::fprintf(stderr, "Please give us a source file\n");
+    return 1;
+  }
+
+  SourceBuffer src;
+  if (!src.open(src_path)) {
+    // what main_runner does when it can't read the file
+    if (!check) {
+      TokenWriter out(STDOUT_FILENO);
+      write_dump_start(options, &out);
+      out.flush();
+    }
+    std::fprintf(stderr, "cannot read %s\n", src_path);
+    return 1;
+  }
+
+  ServerResponse response;
+  bool const answered =
+      check ? request_check(fd, src_path, src.data(), src.size(), &response)
+            : request_compile(fd, options, src_path, src.data(), src.size(),
+                              &response);
+  if (!answered) {
+    std::fprintf(stderr, "lost the connection to %s\n", socket_path);
+    return 1;
+  }
+  ::close(fd);
+
+  TokenWriter out(STDOUT_FILENO);
+  out.write_raw(response.output);
+  bool const written = out.flush();
+  std::fwrite(response.diagnostics.data(), 1, response.diagnostics.size(),
+              stderr);
+  return written ? static_cast<int>(response.status) : 1;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "parser.hpp"
+#include "token_stream.hpp"
+
+// Index of a node in one of FlatAST's arrays, or of a token in the
+// TokenStream the AST was parsed from.
+using NodeIndex = uint32_t;
+static constexpr NodeIndex no_node = UINT32_MAX;
+
+// Elements [first, first + count) of one of FlatAST's arrays.
+struct FlatRange {
+  uint32_t first;
+  uint32_t count;
+};
+
+struct FlatExpr {
+  Expr::ExprKind tag;
+  // token of the operator, of a PlainExpr's operand, or of a call's '('
+  NodeIndex token;
+  // UnaryExpr: the operand. BinaryExpr: the left operand. CallExpr: the
+  // callee.
+  NodeIndex lhs;
+  // BinaryExpr: the right operand. CallExpr: the argument list, in
+  // FlatAST::expr_lists.
+  NodeIndex rhs;
+};
+
+// A statement is followed by the statements inside it, so the first child
+// (a loop's body, an if's then-branch, a block's first statement) is always
+// at index + 1 and the next sibling at `end`.
+struct FlatStmt {
+  enum class Kind : uint8_t {
+    CmpdStmt,
+    IfStmt,
+    ForStmt,
+    WhileStmt,
+    BreakStmt,
+    ContStmt,
+    RetStmt,
+    ExprStmt,
+    // the declarations of one `int a, b = 1;` in a block
+    DeclStmt,
+  };
+  Kind tag;
+  // one past the last statement inside this one
+  NodeIndex end;
+  // IfStmt: the condition in a, the else-branch (or no_node) in b.
+  // WhileStmt: the condition. ForStmt: the three header expressions, any
+  // of which can be no_node. RetStmt, ExprStmt: the expression, if any.
+  // DeclStmt: a is the first declaration and b is one past the last one
+  // (nested ones included).
+  NodeIndex a;
+  NodeIndex b;
+  NodeIndex c;
+};
+
+struct FlatPara {
+  uint8_t indirection_counter;
+  NodeIndex type;
+  NodeIndex id;
+};
+
+struct FlatModifier {
+  TypeModifier::TypeModKind tag;
+  // ArrayOf: the size expression
+  NodeIndex array_expr;
+  // FunctionReturning: the parameters, in FlatAST::paras
+  FlatRange paras;
+};
+
+// Declarations are followed by the ones declared in their body, so the top
+// level ones are at 0, decls[0].end, decls[decls[0].end].end, ...
+struct FlatDecl {
+  NodeIndex type;
+  NodeIndex ident;
+  // in FlatAST::modifiers
+  FlatRange modifiers;
+  InitValue::DeclKind init_tag;
+  // Expr: in exprs. ExprList: in expr_lists. Body: the CmpdStmt in stmts.
+  NodeIndex init;
+  // one past the last declaration inside this one
+  NodeIndex end;
+};
+
+// The AST as arrays of plain nodes, one per kind of node, linked by 32 bit
+// indices instead of pointers. Declarations and statements are laid out in
+// preorder. Expressions are laid out in postorder, operands before the
+// operator that uses them, which is the order a stack machine evaluates
+// them in: a checker or an emitter goes through each array front to back.
+struct FlatAST {
+  std::vector<FlatDecl> decls;
+  std::vector<FlatStmt> stmts;
+  std::vector<FlatExpr> exprs;
+  std::vector<FlatModifier> modifiers;
+  std::vector<FlatPara> paras;
+  // argument lists and initializer lists, each a range of list_items
+  std::vector<FlatRange> expr_lists;
+  std::vector<NodeIndex> list_items;
+  // index of the token the parser gave up at, or AST::no_error
+  uint32_t error_token = AST::no_error;
+
+  void clear() {
+    decls.clear();
+    stmts.clear();
+    exprs.clear();
+    modifiers.clear();
+    paras.clear();
+    expr_lists.clear();
+    list_items.clear();
+    error_token = AST::no_error;
+  }
+};
+
+// Parse straight into *ast, which is cleared first. Tokens are referred to
+// by their index in tks.
+void do_parse_flat(TokenStream const &tks, FlatAST *ast);
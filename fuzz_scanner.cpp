@@ -0,0 +1,437 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "corpus.hpp"
+#include "incremental_scanner.hpp"
+#include "line_index.hpp"
+#include "literal_table.hpp"
+#include "reference_scanner.hpp"
+#include "scanner.hpp"
+#include "scanner_simd.hpp"
+#include "stream_scanner.hpp"
+#include "token.hpp"
+#include "token_pipe.hpp"
+#include "token_sink.hpp"
+#include "token_stream.hpp"
+
+// Differential fuzzing of the scanner engines against reference_scan().
+//
+//   fuzz_scanner [--runs=N] [--seed=N] [--max-size=BYTES] [--seeds=DIR]
+//                [--failure=FILE]
+//
+// Every run makes an input, either random pieces leaning on the scanner's
+// corner cases or a seed file (normally ScannerTests/test/*.vc) put through
+// a few random edits, and scans it with every engine. All of them have to
+// give exactly the tokens reference_scan() gives, and check_scan has to stop
+// at the first error among them. The first input
+// where that fails is printed and written to the failure file, and the exit
+// status is 1. Otherwise it ends with each engine's throughput over all the
+// inputs; they are small, so that includes per-call overhead a long file
+// would not see.
+
+// Pieces of random inputs: line endings, tabs, comments and strings that
+// are never closed, numbers that are almost floats, and UTF-8 good and bad.
+static constexpr std::string_view fragments[] = {
+    // blanks and line endings
+    " ", "  ", "\t", "\n", "\r\n", "\r", "\r\r\n\n",
+    // identifiers and keywords
+    "x", "e", "E", "_a1", "int", "float", "true", "while", "returnx",
+    // numbers, most of them not quite floats
+    "0", "42", "1.2e+ 2", "1e5", "1.e-3x", ".5e", "3.e+", "1e+", "1.5E-7",
+    "..1.", ".",
+    // operators and separators
+    "+", "-", "*", "/", "!", "!=", "=", "==", "<", "<=", ">=", "&", "&&",
+    "|", "||", "(", ")", "{", "}", "[", "]", ";", ",",
+    // comments and strings, opened and not always closed
+    "//", "/*", "*/", "/**\r\n**/", "a/b//c\r\nd", "\"", "\\", "\"s\"",
+    "\"ab\\", "\"\\q\\n\"", "\"\\\r\n",
+    // UTF-8, then bytes that are not
+    "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80", "\xe2\x82", "\xff", "\x80",
+    "\xed\xa0\x80",
+};
+
+static std::string_view pick_fragment(std::mt19937 *rng) {
+  return fragments[(*rng)() % std::size(fragments)];
+}
+
+struct FuzzInput {
+  std::string src;
+
+  // The input before its last edit, and that edit, for relex(). Random
+  // inputs count as inserted whole into an empty buffer.
+  std::string parent;
+  std::vector<Token> parent_tokens;
+  uint32_t edit_offset = 0;
+  uint32_t edit_removed = 0;
+  std::string edit_inserted;
+};
+
+static std::string random_source(uint32_t max_size, std::mt19937 *rng) {
+  uint32_t const target = (*rng)() % (max_size + 1);
+  std::string ret;
+  while (ret.size() < target) {
+    ret += pick_fragment(rng);
+  }
+  return ret;
+}
+
+// One random edit of *src, recorded in *in as the last one.
+static void mutate(std::string *src, std::vector<std::string> const &seeds,
+                   std::mt19937 *rng, FuzzInput *in) {
+  uint32_t const size = static_cast<uint32_t>(src->size());
+  uint32_t const offset = (*rng)() % (size + 1);
+  uint32_t const room = size - offset;
+  uint32_t removed = 0;
+  std::string inserted;
+
+  switch ((*rng)() % 6) {
+  case 0:
+    // a few pieces in
+    for (uint32_t n = 1 + (*rng)() % 3; n > 0; --n) {
+      inserted += pick_fragment(rng);
+    }
+    break;
+  case 1:
+    // some bytes out
+    removed = (*rng)() % (std::min(room, 16u) + 1);
+    break;
+  case 2:
+    // some bytes replaced with a piece
+    removed = (*rng)() % (std::min(room, 8u) + 1);
+    inserted = pick_fragment(rng);
+    break;
+  case 3: {
+    // a piece of the input, or of another seed, copied in
+    std::string const &from = seeds.empty() || (*rng)() % 2 == 0
+                                  ? *src
+                                  : seeds[(*rng)() % seeds.size()];
+    if (!from.empty()) {
+      uint32_t const at = (*rng)() % from.size();
+      inserted = from.substr(at, 1 + (*rng)() % 64);
+    }
+  } break;
+  case 4:
+    // line endings turned into "\r\n"
+    removed = std::min(room, 1 + static_cast<uint32_t>((*rng)() % 256));
+    for (char const c : src->substr(offset, removed)) {
+      if (c == '\n') {
+        inserted += '\r';
+      }
+      inserted += c;
+    }
+    break;
+  default:
+    // cut off, leaving whatever was open unterminated
+    removed = room;
+    break;
+  }
+
+  in->parent = *src;
+  in->edit_offset = offset;
+  in->edit_removed = removed;
+  in->edit_inserted = inserted;
+  src->replace(offset, removed, inserted);
+}
+
+static void make_input(uint32_t run, uint32_t max_size,
+                       std::vector<std::string> const &seeds,
+                       std::mt19937 *rng, FuzzInput *in) {
+  if (seeds.empty() || run % 2 == 0) {
+    in->src = random_source(max_size, rng);
+    in->parent.clear();
+    in->edit_offset = 0;
+    in->edit_removed = 0;
+    in->edit_inserted = in->src;
+    return;
+  }
+
+  std::string src = seeds[(*rng)() % seeds.size()];
+  for (uint32_t n = 1 + (*rng)() % 4; n > 0; --n) {
+    mutate(&src, seeds, rng, in);
+  }
+  in->src = std::move(src);
+}
+
+struct Engine {
+  char const *name;
+  void (*scan)(FuzzInput const &in, std::vector<Token> *out);
+  // the SIMD level to pin the scan to, skipped on a CPU without it; if
+  // none, whatever detect_simd_level() finds
+  std::optional<SimdLevel> level;
+};
+
+static uint32_t size_of(FuzzInput const &in) {
+  return static_cast<uint32_t>(in.src.size());
+}
+
+static void scan_switch(FuzzInput const &in, std::vector<Token> *out) {
+  *out = do_scan(in.src.data(), size_of(in));
+}
+
+static void scan_table(FuzzInput const &in, std::vector<Token> *out) {
+  *out = do_scan_table(in.src.data(), size_of(in));
+}
+
+static void scan_offsets(FuzzInput const &in, std::vector<Token> *out) {
+  std::vector<uint32_t> escaped_crs;
+  *out = do_scan_offsets(in.src.data(), size_of(in), &escaped_crs);
+  resolve_positions(out, LineIndex(in.src.data(), size_of(in), escaped_crs));
+}
+
+static void scan_token_stream(FuzzInput const &in, std::vector<Token> *out) {
+  TokenStream stream;
+  do_scan(in.src.data(), size_of(in), &stream);
+  out->clear();
+  for (uint32_t i = 0; i < stream.size(); ++i) {
+    out->push_back(stream[i]);
+  }
+}
+
+static void scan_sink(FuzzInput const &in, std::vector<Token> *out) {
+  out->clear();
+  do_scan(in.src.data(), size_of(in),
+          [out](Token const &tk) { out->push_back(tk); });
+}
+
+static void scan_parallel(FuzzInput const &in, std::vector<Token> *out) {
+  // pieces small enough that even short inputs are cut a few times
+  *out = do_scan_parallel(in.src.data(), size_of(in), 4, 16);
+}
+
+static void scan_streaming(FuzzInput const &in, std::vector<Token> *out) {
+  // chunks of 1 to 7 bytes, cutting through everything sooner or later
+  out->clear();
+  StreamScanner scanner;
+  uint32_t const size = size_of(in);
+  for (uint32_t offset = 0, i = 0; offset < size; ++i) {
+    uint32_t const chunk = std::min(size - offset, 1 + (offset + i) % 7);
+    scanner.feed(in.src.data() + offset, chunk, out);
+    offset += chunk;
+  }
+  scanner.finish(out);
+}
+
+template <PipeMode Mode>
+static void scan_pipe(FuzzInput const &in, std::vector<Token> *out) {
+  out->clear();
+  TokenPipe pipe(in.src.data(), size_of(in), Mode);
+  for (uint32_t i = 0;; ++i) {
+    Token const tk = pipe[i];
+    out->push_back(tk);
+    if (tk.kind == TokenKind::EVC_EOF) {
+      break;
+    }
+  }
+}
+
+static void scan_literals(FuzzInput const &in, std::vector<Token> *out) {
+  LiteralTable table;
+  *out = do_scan_literals(in.src.data(), size_of(in), &table);
+  // the payloads are the only difference
+  for (auto &tk : *out) {
+    tk.payload = no_payload;
+  }
+}
+
+static void scan_relex(FuzzInput const &in, std::vector<Token> *out) {
+  *out = in.parent_tokens;
+  relex(out, in.src.data(), size_of(in),
+        TextEdit{in.edit_offset, in.edit_removed, in.edit_inserted});
+}
+
+static constexpr Engine engines[] = {
+    {"do_scan(scalar)", scan_switch, SimdLevel::Scalar},
+    {"do_scan(sse2)", scan_switch, SimdLevel::SSE2},
+    {"do_scan(avx2)", scan_switch, SimdLevel::AVX2},
+    {"do_scan_table", scan_table, std::nullopt},
+    {"do_scan_offsets", scan_offsets, std::nullopt},
+    {"do_scan(TokenStream)", scan_token_stream, std::nullopt},
+    {"do_scan(sink)", scan_sink, std::nullopt},
+    {"do_scan_parallel", scan_parallel, std::nullopt},
+    {"StreamScanner", scan_streaming, std::nullopt},
+    {"TokenPipe(same thread)", scan_pipe<PipeMode::SameThread>, std::nullopt},
+    {"TokenPipe(producer)", scan_pipe<PipeMode::ProducerThread>,
+     std::nullopt},
+    {"do_scan_literals", scan_literals, std::nullopt},
+    {"relex", scan_relex, std::nullopt},
+};
+
+struct Throughput {
+  double seconds = 0;
+  uint64_t bytes = 0;
+  uint64_t tokens = 0;
+  uint32_t inputs = 0;
+};
+
+static void print_escaped(std::string_view s) {
+  for (char const c : s) {
+    unsigned char const b = static_cast<unsigned char>(c);
+    if (c == '\\' || c == '"') {
+      std::printf("\\%c", c);
+    } else if (b >= 0x20 && b < 0x7F) {
+      std::putchar(c);
+    } else {
+      std::printf("\\x%02x", b);
+    }
+  }
+}
+
+static void report_mismatch(Engine const &engine, uint32_t run,
+                            FuzzInput const &in,
+                            std::vector<Token> const &expected,
+                            std::vector<Token> const &got,
+                            char const *failure_path) {
+  size_t i = 0;
+  while (i < expected.size() && i < got.size() && expected[i] == got[i]) {
+    ++i;
+  }
+
+  std::printf("run %u: %s differs from reference_scan at token %zu of %zu\n",
+              run, engine.name, i, expected.size());
+  std::printf("  input (%zu bytes): \"", in.src.size());
+  print_escaped(in.src.size() <= 512 ? std::string_view(in.src)
+                                     : std::string_view(in.src).substr(0, 512));
+  std::printf("\"%s\n", in.src.size() <= 512 ? "" : "...");
+  uint32_t const size = size_of(in);
+  if (i < expected.size()) {
+    std::printf("  expected %s\n",
+                to_string(expected[i], in.src.data(), size).c_str());
+  }
+  if (i < got.size()) {
+    std::printf("  got      %s\n",
+                to_string(got[i], in.src.data(), size).c_str());
+  }
+  if (engine.scan == scan_relex) {
+    std::printf("  after replacing %u bytes at %u with \"", in.edit_removed,
+                in.edit_offset);
+    print_escaped(in.edit_inserted);
+    std::printf("\"\n");
+  }
+
+  std::ofstream(failure_path, std::ios::binary) << in.src;
+  std::printf("  written to %s\n", failure_path);
+}
+
+int main(int argc, char **argv) {
+  uint32_t runs = 20000;
+  uint32_t seed = 1;
+  uint32_t max_size = 2048;
+  char const *seeds_dir = EVC_SCANNER_TESTS_DIR "/test";
+  char const *failure_path = "fuzz_failure.vc";
+
+  for (int i = 1; i < argc; ++i) {
+    std::string_view const arg = argv[i];
+    if (arg.starts_with("--runs=")) {
+      runs = static_cast<uint32_t>(std::atol(argv[i] + sizeof("--runs=") - 1));
+    } else if (arg.starts_with("--seed=")) {
+      seed = static_cast<uint32_t>(std::atol(argv[i] + sizeof("--seed=") - 1));
+    } else if (arg.starts_with("--max-size=")) {
+      max_size = static_cast<uint32_t>(
+          std::atol(argv[i] + sizeof("--max-size=") - 1));
+    } else if (arg.starts_with("--seeds=")) {
+      seeds_dir = argv[i] + sizeof("--seeds=") - 1;
+    } else if (arg.starts_with("--failure=")) {
+      failure_path = argv[i] + sizeof("--failure=") - 1;
+    } else {
+      std::fprintf(stderr,
+                   "usage: %s [--runs=N] [--seed=N] [--max-size=BYTES] "
+                   "[--seeds=DIR] [--failure=FILE]\n",
+                   argv[0]);
+      return 1;
+    }
+  }
+
+  std::vector<std::string> const seeds = load_seed_sources(seeds_dir);
+  if (seeds.empty()) {
+    std::fprintf(stderr, "warning: no seed files in %s\n", seeds_dir);
+  }
+
+  SimdLevel const best = detect_simd_level();
+  std::mt19937 rng(seed);
+  FuzzInput in;
+  std::vector<Token> expected;
+  std::vector<Token> got;
+  Throughput reference;
+  Throughput measured[std::size(engines)];
+
+  using clock = std::chrono::steady_clock;
+  for (uint32_t run = 0; run < runs; ++run) {
+    make_input(run, max_size, seeds, &rng, &in);
+
+    in.parent_tokens = reference_scan(
+        in.parent.data(), static_cast<uint32_t>(in.parent.size()));
+    auto const start = clock::now();
+    expected = reference_scan(in.src.data(), size_of(in));
+    reference.seconds +=
+        std::chrono::duration<double>(clock::now() - start).count();
+    reference.bytes += in.src.size();
+    reference.tokens += expected.size();
+    ++reference.inputs;
+
+    for (size_t e = 0; e < std::size(engines); ++e) {
+      Engine const &engine = engines[e];
+      SimdLevel const level = engine.level.value_or(best);
+      if (static_cast<int>(level) > static_cast<int>(best)) {
+        continue;
+      }
+      set_simd_level(level);
+
+      auto const engine_start = clock::now();
+      engine.scan(in, &got);
+      measured[e].seconds +=
+          std::chrono::duration<double>(clock::now() - engine_start).count();
+      measured[e].bytes += in.src.size();
+      measured[e].tokens += got.size();
+      ++measured[e].inputs;
+
+      if (got != expected) {
+        report_mismatch(engine, run, in, expected, got, failure_path);
+        return 1;
+      }
+    }
+
+    // check_scan has to stop at the first error there is
+    auto const first = std::find_if(
+        expected.begin(), expected.end(),
+        [](Token const &tk) { return is_error(tk.kind); });
+    Token error;
+    bool const ok = check_scan(in.src.data(), size_of(in), &error);
+    if (ok != (first == expected.end()) || (!ok && error != *first)) {
+      std::printf("run %u: check_scan does not stop at the first "
+                  "error\n  input: \"",
+                  run);
+      print_escaped(in.src);
+      std::printf("\"\n");
+      std::ofstream(failure_path, std::ios::binary) << in.src;
+      return 1;
+    }
+  }
+  set_simd_level(best);
+
+  std::printf("%u inputs, seed %u, every engine matched reference_scan\n",
+              runs, seed);
+  std::printf("%-24s %8s %12s %10s %12s\n", "engine", "inputs", "bytes",
+              "MB/s", "tokens/s");
+  auto const print_row = [](char const *name, Throughput const &t) {
+    double const seconds = t.seconds > 0 ? t.seconds : 1e-9;
+    std::printf("%-24s %8u %12llu %10.1f %12.0f\n", name, t.inputs,
+                static_cast<unsigned long long>(t.bytes),
+                t.bytes / seconds / (1024 * 1024), t.tokens / seconds);
+  };
+  print_row("reference_scan", reference);
+  for (size_t e = 0; e < std::size(engines); ++e) {
+    if (measured[e].inputs > 0) {
+      print_row(engines[e].name, measured[e]);
+    }
+  }
+  return 0;
+}
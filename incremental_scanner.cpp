@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "incremental_scanner.hpp"
+#include "scanner_core.hpp"
+#include "scanner_internal.hpp"
+#include "token.hpp"
+
+// Source bytes scanned before looking for a match again; doubled every time.
+static constexpr uint32_t first_slice = 256;
+
+// Whether the scanner, started cold (freshStart, no fragment) at tk's first
+// byte with tk's start position, lexes tk and everything after it the same.
+// `prev` is the token before tk, if any.
+static bool is_restart_point(Token const *prev, Token const &tk) {
+  switch (tk.kind) {
+  // strings start past their quote, and their start_pos is the quote's
+  case TokenKind::STRINGLITERAL:
+  case TokenKind::ERROR_UNTERMINATED_STRING:
+  case TokenKind::ERROR_STRINGLIT_WITH_ILLEGAL_ESCAPE_CHAR:
+  case TokenKind::ERROR_STRINGLIT_WITH_INVALID_UTF8:
+  // may be inside a comment
+  case TokenKind::ERROR_INVALID_UTF8:
+  // only made at the end of the input
+  case TokenKind::ERROR_UNTERMINATED_COMMENT:
+  case TokenKind::PLACEHOLDER:
+  case TokenKind::EVC_EOF:
+    return false;
+  default:
+    break;
+  }
+  if (prev == nullptr) {
+    return true;
+  }
+
+  // a fragment re-emitted at the end of the input
+  if (prev->end_offset > tk.start_offset) {
+    return false;
+  }
+  if (prev->end_offset == tk.start_offset) {
+    // the 'e' and the sign of what could have been an exponent are lexed
+    // in modes of their own
+    bool const after_number = prev->kind == TokenKind::INTLITERAL ||
+                              prev->kind == TokenKind::FLOATLITERAL;
+    if ((tk.kind == TokenKind::ID && after_number) ||
+        (tk.kind == TokenKind::PLUS && prev->kind == TokenKind::ID)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+RelexResult relex(std::vector<Token> *tokens, char const *src, uint32_t length,
+                  TextEdit const &edit) {
+  std::vector<Token> &old = *tokens;
+  int64_t const delta = static_cast<int64_t>(edit.inserted.size()) -
+                        static_cast<int64_t>(edit.removed);
+  uint32_t const old_edit_end = edit.offset + edit.removed;
+  uint32_t const new_edit_end =
+      edit.offset + static_cast<uint32_t>(edit.inserted.size());
+
+  // Restart strictly before the edit, so the byte the token before the
+  // restart was ended by is unchanged. Starts never decrease along the
+  // tokens, re-emitted fragments included.
+  uint32_t first = static_cast<uint32_t>(
+      std::partition_point(old.begin(), old.end(),
+                           [&](Token const &t) {
+                             return t.start_offset < edit.offset;
+                           }) -
+      old.begin());
+  while (first > 0 &&
+         !is_restart_point(first > 1 ? &old[first - 2] : nullptr,
+                           old[first - 1])) {
+    --first;
+  }
+  first = first > 0 ? first - 1 : 0;
+  bool const cold_start = first == 0;
+
+  ScanState state = {};
+  if (!cold_start) {
+    state.offset = old[first].start_offset;
+    state.curr_pos = old[first].start_pos;
+  }
+  uint32_t const scan_from = state.offset;
+
+  // Old token matching fresh[i], if the scan can stop there, else UINT32_MAX.
+  std::vector<Token> fresh;
+  auto const match = [&](uint32_t i) -> uint32_t {
+    Token const &tk = fresh[i];
+    if (tk.start_offset < new_edit_end) {
+      return UINT32_MAX;
+    }
+    Token const *const prev =
+        i > 0 ? &fresh[i - 1] : (first > 0 ? &old[first - 1] : nullptr);
+    if (!is_restart_point(prev, tk)) {
+      return UINT32_MAX;
+    }
+
+    uint32_t const old_start = static_cast<uint32_t>(tk.start_offset - delta);
+    uint32_t const j = static_cast<uint32_t>(
+        std::partition_point(old.begin() + first, old.end(),
+                             [&](Token const &t) {
+                               return t.start_offset < old_start;
+                             }) -
+        old.begin());
+    if (j == old.size() || old_start < old_edit_end) {
+      return UINT32_MAX;
+    }
+    Token const &o = old[j];
+    if (o.start_offset != old_start || o.kind != tk.kind ||
+        o.end_offset - o.start_offset != tk.end_offset - tk.start_offset ||
+        o.start_pos.col_pos != tk.start_pos.col_pos ||
+        !is_restart_point(j > 0 ? &old[j - 1] : nullptr, o)) {
+      return UINT32_MAX;
+    }
+    return j;
+  };
+
+  // Scan a slice at a time; a token is only final once two more follow it,
+  // as the scanner may still take it back for an exponent.
+  uint32_t checked = 0;
+  uint32_t resync = UINT32_MAX;
+  uint32_t resync_at = 0;
+  for (uint32_t slice = first_slice; resync == UINT32_MAX; slice *= 2) {
+    uint32_t const limit =
+        length - state.offset > slice ? state.offset + slice : length;
+    scan_chunk<FullScan>(&state, src, 0, limit, &fresh);
+
+    bool const done = limit == length;
+    if (done) {
+      finish_scan(&state, &fresh);
+    }
+    uint32_t const final_count =
+        done ? static_cast<uint32_t>(fresh.size())
+             : static_cast<uint32_t>(std::max<size_t>(fresh.size(), 2) - 2);
+    for (; checked < final_count && resync == UINT32_MAX; ++checked) {
+      resync = match(checked);
+      resync_at = checked;
+    }
+    if (done) {
+      break;
+    }
+  }
+
+  RelexResult ret = {.first = first,
+                     .removed = 0,
+                     .inserted = 0,
+                     .scanned_bytes = state.offset - scan_from};
+  if (resync == UINT32_MAX) {
+    // ran to the end without finding a match: everything from `first` on is
+    // new
+    ret.removed = static_cast<uint32_t>(old.size()) - first;
+    ret.inserted = static_cast<uint32_t>(fresh.size());
+    old.resize(first);
+    old.insert(old.end(), fresh.begin(), fresh.end());
+    return ret;
+  }
+
+  int const line_delta =
+      fresh[resync_at].start_pos.line_num - old[resync].start_pos.line_num;
+  for (auto it = old.begin() + resync; it != old.end(); ++it) {
+    it->start_offset = static_cast<uint32_t>(it->start_offset + delta);
+    it->end_offset = static_cast<uint32_t>(it->end_offset + delta);
+    it->start_pos.line_num += line_delta;
+    it->end_pos.line_num += line_delta;
+  }
+
+  ret.removed = resync - first;
+  ret.inserted = resync_at;
+  old.erase(old.begin() + first, old.begin() + resync);
+  old.insert(old.begin() + first, fresh.begin(), fresh.begin() + resync_at);
+  return ret;
+}
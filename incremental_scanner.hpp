@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "token.hpp"
+
+// One change to a source buffer: `removed` bytes at `offset` were replaced
+// by `inserted`. Offsets are into the buffer before the edit.
+struct TextEdit {
+  uint32_t offset;
+  uint32_t removed;
+  std::string_view inserted;
+};
+
+struct RelexResult {
+  // tokens[first, first + inserted) are new; they replaced `removed` tokens
+  uint32_t first;
+  uint32_t removed;
+  uint32_t inserted;
+  // source bytes the scanner went over
+  uint32_t scanned_bytes;
+};
+
+// Bring *tokens, do_scan's tokens for the buffer before `edit`, up to date
+// with src[0, length), the buffer after it, as if by do_scan(src, length).
+//
+// The scanner restarts at the last token before the edit that it can start
+// cold on, and stops as soon as it produces a token that matches one from
+// before the edit in a state where everything after is bound to match too:
+// same kind and extent, started between tokens, at the same column. Tokens
+// before the restart are kept as they are and the ones after the match get
+// their offsets and lines shifted. Lexing only covers the edit, the tokens
+// around it and, typically, the rest of the edited line; shifting the tail
+// is a single pass over the tokens.
+RelexResult relex(std::vector<Token> *tokens, char const *src, uint32_t length,
+                  TextEdit const &edit);
@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "line_index.hpp"
+#include "scanner_simd.hpp"
+#include "token.hpp"
+#include "utf8.hpp"
+
+LineIndex::LineIndex(char const *start, uint32_t length,
+                     std::vector<uint32_t> const &escaped_crs)
+    : start(start), length(length) {
+  line_starts.push_back(0);
+
+  // escaped_crs comes out of the scanner in order
+  auto next_escaped = escaped_crs.begin();
+
+  uint32_t offset = skip_to_line_break(start, 0, length);
+  while (offset < length) {
+    if (start[offset] == '\r') {
+      line_starts.push_back(offset + 1);
+    } else if (offset == 0 || start[offset - 1] != '\r') {
+      line_starts.push_back(offset + 1);
+    } else {
+      // "\r\n": the '\n' is skipped, unless the '\r' was a string escape
+      while (next_escaped != escaped_crs.end() && *next_escaped < offset - 1) {
+        ++next_escaped;
+      }
+      if (next_escaped != escaped_crs.end() && *next_escaped == offset - 1) {
+        line_starts.push_back(offset + 1);
+      }
+    }
+    offset = skip_to_line_break(start, offset + 1, length);
+  }
+}
+
+SourcePosition LineIndex::position_at(uint32_t offset) const {
+  Cursor cursor = {};
+  return position_at(offset, &cursor);
+}
+
+SourcePosition LineIndex::position_at(uint32_t offset, Cursor *cursor) const {
+  assert(offset <= length);
+
+  uint32_t const next_line = cursor->line + 1;
+  if (offset < cursor->offset ||
+      (next_line < line_starts.size() && line_starts[next_line] <= offset)) {
+    auto const after =
+        std::upper_bound(line_starts.begin(), line_starts.end(), offset);
+    cursor->line = static_cast<uint32_t>(after - line_starts.begin()) - 1;
+    cursor->offset = *(after - 1);
+    cursor->col = 1;
+  }
+
+  int col = cursor->col;
+  uint32_t o = cursor->offset;
+  while (o < offset) {
+    switch (start[o]) {
+    case '\t':
+      col = ((col - 1) / 8 + 1) * 8 + 1;
+      break;
+    case '\n':
+      // only ever the second half of a "\r\n", which takes up no column
+      break;
+    default:
+      if (is_non_ascii(start[o])) {
+        // one column for the whole character, which is where every byte of
+        // it is
+        Utf8Decoder d;
+        Utf8Char what;
+        uint32_t const n = utf8_char(start + o, length - o, &d, &what);
+        if (o + n > offset) {
+          cursor->offset = o;
+          cursor->col = col;
+          return SourcePosition{col, static_cast<int>(cursor->line + 1)};
+        }
+        o += n;
+        ++col;
+        continue;
+      }
+      ++col;
+      break;
+    }
+    ++o;
+  }
+  cursor->offset = offset;
+  cursor->col = col;
+
+  return SourcePosition{col, static_cast<int>(cursor->line + 1)};
+}
+
+// Offsets whose positions do_scan records as a token's start_pos and
+// end_pos. Usually the first and last character, but string literals start
+// at their opening quote and end on the character that ends them, and some
+// tokens end just past their last character.
+struct PositionOffsets {
+  uint32_t start;
+  uint32_t end;
+};
+
+static PositionOffsets position_offsets(Token const &tk, char const *start,
+                                        uint32_t length) {
+  switch (tk.kind) {
+  case TokenKind::STRINGLITERAL:
+  case TokenKind::ERROR_UNTERMINATED_STRING:
+  case TokenKind::ERROR_STRINGLIT_WITH_ILLEGAL_ESCAPE_CHAR:
+  case TokenKind::ERROR_STRINGLIT_WITH_INVALID_UTF8:
+    // closed by a quote or line break, unless the input ran out first
+    return PositionOffsets{tk.start_offset - 1, tk.end_offset < length
+                                                    ? tk.end_offset
+                                                    : tk.end_offset - 1};
+  case TokenKind::ERROR_UNTERMINATED_COMMENT:
+    return PositionOffsets{tk.start_offset, tk.end_offset};
+  case TokenKind::ERROR_INVALID_UTF8:
+    return PositionOffsets{tk.start_offset, tk.start_offset};
+  case TokenKind::EVC_EOF:
+  case TokenKind::PLACEHOLDER:
+    // PLACEHOLDER only escapes when the input is a lone '\r'
+    return PositionOffsets{tk.start_offset, tk.end_offset};
+  case TokenKind::ERROR:
+    // a lone '.' is ended by the character after it, if there is one
+    if (start[tk.start_offset] == '.' && tk.end_offset < length) {
+      return PositionOffsets{tk.start_offset, tk.end_offset};
+    }
+    return PositionOffsets{tk.start_offset, tk.end_offset - 1};
+  default:
+    return PositionOffsets{tk.start_offset, tk.end_offset - 1};
+  }
+}
+
+void resolve_positions(Token *tk, LineIndex const &index) {
+  resolve_positions(tk, 1, index);
+}
+
+void resolve_positions(std::vector<Token> *tks, LineIndex const &index) {
+  resolve_positions(tks->data(), static_cast<uint32_t>(tks->size()), index);
+}
+
+void resolve_positions(Token *tks, uint32_t count, LineIndex const &index) {
+  LineIndex::Cursor cursor = {};
+  for (uint32_t i = 0; i < count; ++i) {
+    PositionOffsets const po =
+        position_offsets(tks[i], index.data(), index.size());
+    tks[i].start_pos = index.position_at(po.start, &cursor);
+    tks[i].end_pos = index.position_at(po.end, &cursor);
+  }
+}
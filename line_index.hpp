@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "token.hpp"
+
+// Line start table for a source buffer, for turning byte offsets into the
+// SourcePosition do_scan would have computed while scanning. Lines break at
+// every '\r' and at every '\n' that does not complete a "\r\n" pair; the one
+// exception is a '\n' after a '\r' the scanner read as a string escape,
+// which breaks a line of its own. Those '\r's are what do_scan_offsets()
+// collects.
+//
+// Columns are worked out on demand by walking from the start of the line,
+// with tabs moving to the next multiple of 8 plus one.
+class LineIndex {
+public:
+  LineIndex(char const *start, uint32_t length,
+            std::vector<uint32_t> const &escaped_crs = {});
+
+  // Where a walk through the buffer has got to, so that a run of offsets in
+  // increasing order costs one pass over the bytes rather than a search and
+  // a walk from the start of the line for each of them.
+  struct Cursor {
+    uint32_t offset = 0;
+    uint32_t line = 0;
+    int col = 1;
+  };
+
+  // Position the scanner has when it reaches `offset`, 0 <= offset <= length.
+  SourcePosition position_at(uint32_t offset) const;
+
+  // Same, moving *cursor to `offset`. Going backwards is allowed but restarts
+  // the walk from the start of the line.
+  SourcePosition position_at(uint32_t offset, Cursor *cursor) const;
+
+  uint32_t line_count() const {
+    return static_cast<uint32_t>(line_starts.size());
+  }
+
+  char const *data() const { return start; }
+  uint32_t size() const { return length; }
+
+private:
+  char const *start;
+  uint32_t length;
+  std::vector<uint32_t> line_starts;
+};
+
+// Fill in tk->start_pos and tk->end_pos as do_scan would have, for a token
+// from do_scan_offsets() over the same buffer the index was built on.
+void resolve_positions(Token *tk, LineIndex const &index);
+
+void resolve_positions(std::vector<Token> *tks, LineIndex const &index);
+
+// Same for tks[0, count), sharing one cursor between the tokens.
+void resolve_positions(Token *tks, uint32_t count, LineIndex const &index);
@@ -0,0 +1,153 @@
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "literal_table.hpp"
+#include "scanner_core.hpp"
+#include "scanner_internal.hpp"
+#include "symbol_interner.hpp"
+#include "token.hpp"
+
+// Value of the 8 decimal digits at p, most significant first. Each step
+// merges neighbouring groups of digits: pairs, then quads, then the eight.
+static uint32_t parse_eight_digits(char const *p) {
+  uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+  v -= 0x3030303030303030;
+  v = (v * 10 + (v >> 8)) & 0x00FF00FF00FF00FF;
+  v = (v * 100 + (v >> 16)) & 0x0000FFFF0000FFFF;
+  v = (v * 10000 + (v >> 32)) & 0x00000000FFFFFFFF;
+  return static_cast<uint32_t>(v);
+}
+
+static void decode_int(char const *p, uint32_t length, Literal *lit) {
+  uint64_t value = 0;
+  uint32_t i = 0;
+  // once past UINT32_MAX the value can only grow, so stop accumulating
+  for (; i + 8 <= length && value <= UINT32_MAX; i += 8) {
+    value = value * 100000000 + parse_eight_digits(p + i);
+  }
+  for (; i < length && value <= UINT32_MAX; ++i) {
+    value = value * 10 + static_cast<uint32_t>(p[i] - '0');
+  }
+
+  uint64_t const max = std::numeric_limits<int32_t>::max();
+  lit->out_of_range = value > max;
+  lit->int_value = static_cast<uint32_t>(value > max ? max : value);
+}
+
+static void decode_float(char const *p, uint32_t length, Literal *lit) {
+  // from_chars is correctly rounded and, in libstdc++, takes the Eisel-Lemire
+  // fast path whenever it can
+  float value = 0;
+  auto const [end, ec] = std::from_chars(p, p + length, value);
+  if (ec == std::errc::result_out_of_range) {
+    // from_chars leaves the value alone then; strtof saturates
+    std::string const copy(p, length);
+    value = std::strtof(copy.c_str(), nullptr);
+    lit->out_of_range = true;
+  }
+  lit->float_value = value;
+}
+
+static char unescape(char c) {
+  switch (c) {
+  case 'n':
+    return '\n';
+  case 'b':
+    return '\b';
+  case 'f':
+    return '\f';
+  case 'r':
+    return '\r';
+  case 't':
+    return '\t';
+  case '\'':
+  case '"':
+  case '\\':
+    return c;
+  default:
+    return 0;
+  }
+}
+
+static void decode_string(char const *p, uint32_t length, Literal *lit,
+                          std::string *pool) {
+  lit->string.offset = static_cast<uint32_t>(pool->size());
+
+  uint32_t i = 0;
+  while (i < length) {
+    void const *const slash = std::memchr(p + i, '\\', length - i);
+    uint32_t const run =
+        slash == nullptr
+            ? length - i
+            : static_cast<uint32_t>(static_cast<char const *>(slash) - p) - i;
+    pool->append(p + i, run);
+    i += run;
+    if (i == length) {
+      break;
+    }
+
+    // p[i] is a backslash; one at the very end of an unterminated string
+    // stays as it is
+    char const decoded = i + 1 < length ? unescape(p[i + 1]) : 0;
+    if (decoded != 0) {
+      pool->push_back(decoded);
+    } else {
+      pool->append(p + i, i + 1 < length ? 2 : 1);
+    }
+    i += 2;
+  }
+
+  lit->string.length = static_cast<uint32_t>(pool->size()) - lit->string.offset;
+}
+
+uint32_t decode_literal(Token const &tk, char const *start,
+                        LiteralTable *table) {
+  char const *const p = start + tk.start_offset;
+  uint32_t const length = tk.end_offset - tk.start_offset;
+
+  Literal lit;
+  switch (tk.kind) {
+  case TokenKind::INTLITERAL:
+    lit.kind = LiteralKind::Int;
+    decode_int(p, length, &lit);
+    break;
+  case TokenKind::FLOATLITERAL:
+    lit.kind = LiteralKind::Float;
+    decode_float(p, length, &lit);
+    break;
+  case TokenKind::BOOLEANLITERAL:
+    lit.kind = LiteralKind::Bool;
+    lit.bool_value = p[0] == 't';
+    break;
+  case TokenKind::STRINGLITERAL:
+  case TokenKind::ERROR_UNTERMINATED_STRING:
+  case TokenKind::ERROR_STRINGLIT_WITH_ILLEGAL_ESCAPE_CHAR:
+  case TokenKind::ERROR_STRINGLIT_WITH_INVALID_UTF8:
+    lit.kind = LiteralKind::String;
+    decode_string(p, length, &lit, &table->pool);
+    break;
+  default:
+    return no_payload;
+  }
+
+  table->literals.push_back(lit);
+  return table->size() - 1;
+}
+
+std::vector<Token> do_scan_literals(char const *start, uint32_t length,
+                                    LiteralTable *table,
+                                    SymbolInterner *symbols) {
+  std::vector<Token> ret;
+  ret.reserve(estimated_token_count(length));
+  scan_source<LiteralScan>(
+      start, length, &ret,
+      ScanSideOutputs{.literals = table, .symbols = symbols});
+  return ret;
+}
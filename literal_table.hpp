@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "symbol_interner.hpp"
+#include "token.hpp"
+
+enum class LiteralKind : uint8_t {
+  Int,
+  Float,
+  Bool,
+  String,
+};
+
+// Where a decoded string's characters are in LiteralTable::pool.
+struct PooledString {
+  uint32_t offset;
+  uint32_t length;
+};
+
+// The value of one literal token, decoded once while scanning so that later
+// stages never have to go back to the source text for it.
+struct Literal {
+  LiteralKind kind;
+  // An int that does not fit in an int32_t, or a float that overflowed to
+  // infinity or underflowed to zero. The value is then saturated.
+  bool out_of_range = false;
+  union {
+    uint32_t int_value;
+    float float_value;
+    bool bool_value;
+    PooledString string;
+  };
+};
+
+// Decoded literals, indexed by Token::payload. Strings have their escapes
+// replaced and share one character pool; an illegal escape is kept as the
+// two characters it was written as.
+struct LiteralTable {
+  std::vector<Literal> literals;
+  std::string pool;
+
+  Literal const &operator[](uint32_t i) const { return literals[i]; }
+  uint32_t size() const { return static_cast<uint32_t>(literals.size()); }
+
+  std::string_view string_at(Literal const &lit) const {
+    return std::string_view(pool).substr(lit.string.offset, lit.string.length);
+  }
+
+  void clear() {
+    literals.clear();
+    pool.clear();
+  }
+};
+
+// Same tokens as do_scan(start, length), except that every INTLITERAL,
+// FLOATLITERAL, BOOLEANLITERAL, STRINGLITERAL and string error token has its
+// value appended to *table and the index stored in its payload. With
+// `symbols`, every ID token gets its symbol ID as payload too.
+std::vector<Token> do_scan_literals(char const *start, uint32_t length,
+                                    LiteralTable *table,
+                                    SymbolInterner *symbols = nullptr);
+
+// Decode a single literal token of the kinds above into *table, returning its
+// index, or no_payload for any other kind of token.
+uint32_t decode_literal(Token const &tk, char const *start,
+                        LiteralTable *table);
@@ -1,99 +1,105 @@
+#include "flat_ast.hpp"
 #include "parser.hpp"
 #include "token.hpp"
+#include "token_pipe.hpp"
+#include "work_pool.hpp"
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <utility>
+#include <vector>
+
+// What a token kind does in an expression. A binding power of 0 means the
+// kind is not that sort of operator.
+struct OperatorPowers {
+  uint8_t prefix;
+  uint8_t postfix;
+  uint8_t infix_left;
+  uint8_t infix_right;
+  // an identifier or a literal
+  bool operand;
+};
 
-#define CASE_POSTFIX TokenKind::LBRACKET : case TokenKind::LPAREN
-
-#define CASE_PREFIX                                                            \
-  TokenKind::MULT : case TokenKind::AMPERSAND : case TokenKind::NOT            \
-      : case TokenKind::PLUS : case TokenKind::MINUS
-
-#define CASE_INFIX                                                             \
-  TokenKind::PLUS : case TokenKind::MINUS : case TokenKind::DIV                \
-      : case TokenKind::MULT : case TokenKind::EQEQ : case TokenKind::ANDAND   \
-      : case TokenKind::OROR : case TokenKind::EQ : case TokenKind::LT         \
-      : case TokenKind::LTEQ : case TokenKind::GT : case TokenKind::GTEQ       \
-      : case TokenKind::NOTEQ
-
-inline uint8_t unary_prefix_binding_power(TokenKind tk) {
-  switch (tk) {
-  case TokenKind::PLUS:
-  case TokenKind::MINUS:
-  case TokenKind::NOT:
-  case TokenKind::MULT:
-  case TokenKind::AMPERSAND:
-    return 90;
-  default:
-    assert(!"Ruh roh not an accepted token");
-    return 0;
-  }
-}
+static constexpr size_t token_kind_count =
+    static_cast<size_t>(TokenKind::ERROR_STRINGLIT_WITH_INVALID_UTF8) + 1;
 
-inline uint8_t unary_postfix_binding_power(TokenKind tk) {
-  switch (tk) {
-  case TokenKind::LPAREN:
-  case TokenKind::LBRACKET:
-    return 100;
-  default:
-    assert(!"Ruh roh not an accepted token");
-    return 0;
-  }
-}
+static constexpr std::array<OperatorPowers, token_kind_count>
+make_operator_powers() {
+  std::array<OperatorPowers, token_kind_count> ops = {};
+  auto const at = [&ops](TokenKind tk) -> OperatorPowers & {
+    return ops[static_cast<size_t>(tk)];
+  };
 
-inline uint8_t infix_left_binding_power(TokenKind tk) {
-  switch (tk) {
-  case TokenKind::DIV:
-  case TokenKind::MULT:
-    return 79;
-  case TokenKind::PLUS:
-  case TokenKind::MINUS:
-    return 69;
-  case TokenKind::GT:
-  case TokenKind::LT:
-    return 59;
-  case TokenKind::EQEQ:
-  case TokenKind::NOTEQ:
-    return 49;
-  case TokenKind::ANDAND:
-    return 39;
-  case TokenKind::OROR:
-    return 29;
-  case TokenKind::EQ:
-    return 21;
-  default:
-    assert(!"Ruh roh not an accepted token");
-    return 0;
+  for (TokenKind tk : {TokenKind::ID, TokenKind::INTLITERAL,
+                       TokenKind::FLOATLITERAL, TokenKind::BOOLEANLITERAL,
+                       TokenKind::STRINGLITERAL}) {
+    at(tk).operand = true;
   }
-}
-
-inline uint8_t infix_right_binding_power(TokenKind tk) {
-  switch (tk) {
-  case TokenKind::DIV:
-  case TokenKind::MULT:
-    return 81;
-  case TokenKind::PLUS:
-  case TokenKind::MINUS:
-    return 71;
-  case TokenKind::GT:
-  case TokenKind::LT:
-    return 61;
-  case TokenKind::EQEQ:
-  case TokenKind::NOTEQ:
-    return 51;
-  case TokenKind::ANDAND:
-    return 41;
-  case TokenKind::OROR:
-    return 31;
-  case TokenKind::EQ:
-    return 19;
-  default:
-    assert(!"Ruh roh not an accepted token");
-    return 0;
+  for (TokenKind tk : {TokenKind::PLUS, TokenKind::MINUS, TokenKind::NOT,
+                       TokenKind::MULT, TokenKind::AMPERSAND}) {
+    at(tk).prefix = 90;
   }
+  at(TokenKind::LPAREN).postfix = 100;
+  at(TokenKind::LBRACKET).postfix = 100;
+
+  // a left power below the right one makes the operator left associative,
+  // one above it (as for '=') right associative
+  auto const infix = [&at](TokenKind tk, uint8_t left, uint8_t right) {
+    at(tk).infix_left = left;
+    at(tk).infix_right = right;
+  };
+  infix(TokenKind::DIV, 79, 81);
+  infix(TokenKind::MULT, 79, 81);
+  infix(TokenKind::PLUS, 69, 71);
+  infix(TokenKind::MINUS, 69, 71);
+  infix(TokenKind::GT, 59, 61);
+  infix(TokenKind::LT, 59, 61);
+  infix(TokenKind::GTEQ, 59, 61);
+  infix(TokenKind::LTEQ, 59, 61);
+  infix(TokenKind::EQEQ, 49, 51);
+  infix(TokenKind::NOTEQ, 49, 51);
+  infix(TokenKind::ANDAND, 39, 41);
+  infix(TokenKind::OROR, 29, 31);
+  infix(TokenKind::EQ, 21, 19);
+  return ops;
 }
 
+static constexpr std::array<OperatorPowers, token_kind_count> operator_powers =
+    make_operator_powers();
+
+static_assert(operator_powers[static_cast<size_t>(TokenKind::MULT)].prefix ==
+              90);
+static_assert(
+    operator_powers[static_cast<size_t>(TokenKind::EQ)].infix_right == 19);
+static_assert(!operator_powers[static_cast<size_t>(TokenKind::EVC_EOF)]
+                   .operand);
+
+// An operator the expression parser has read but not yet built a node for,
+// waiting on its right operand. Kept on an explicit stack rather than the
+// call stack, so that how deeply an expression nests costs heap, not stack.
+template <typename ExprRef, typename ListBuilder> struct PrattFrame {
+  enum class Kind : uint8_t {
+    Prefix,
+    Infix,
+    // '(' ... ')'
+    Group,
+    // lhs '[' ... ']'
+    Index,
+    // lhs '(' ... ',' ... ')'
+    Call,
+  };
+  Kind kind;
+  // operators binding less tightly than this end the right operand
+  uint8_t right_bp;
+  uint32_t op_at;
+  Token op;
+  ExprRef lhs;
+  // Call: the arguments so far
+  ListBuilder args;
+};
+
 #define CASE_TYPES                                                             \
   TokenKind::BOOLEAN : case TokenKind::INT : case TokenKind::FLOAT             \
       : case TokenKind::VOID
@@ -104,130 +110,733 @@ enum class Status {
   Success,
 };
 
-Status parse_decl(Token const *tks, uint32_t length, uint32_t *const offset,
-                  std::vector<Decl> *const ret);
+template <typename Tokens, typename Builder>
+Status parse_decl(Tokens &tks, uint32_t *const offset, Builder *b,
+                  typename Builder::DeclGroup *const ret);
 
 struct TokenResult {
   Token tk;
   Status err;
 };
 
-static Status munch_token(Token const *tks, uint32_t length,
-                          uint32_t *const offset, TokenKind expected,
-                          Token *slot) {
-  Token ret = tks[*offset];
-  if (ret.kind != expected) {
+template <typename Tokens>
+static Status munch_token(Tokens &tks, uint32_t *const offset,
+                          TokenKind expected, Token *slot) {
+  if (tks.kind(*offset) != expected) {
     return Status::TokenNotFound;
   }
+  *slot = tks[*offset];
   ++*offset;
-  *slot = ret;
   return Status::Success;
 }
 
-static Status accept_token(Token const *tks, uint32_t length,
-                           uint32_t *const offset, TokenKind expected) {
-  Token ret = tks[*offset];
-  if (ret.kind != expected) {
+template <typename Tokens>
+static Status accept_token(Tokens &tks, uint32_t *const offset,
+                           TokenKind expected) {
+  if (tks.kind(*offset) != expected) {
     return Status::TokenNotFound;
   }
   ++*offset;
   return Status::Success;
 }
 
-static Status munch_type(Token const *tks, uint32_t length,
-                         uint32_t *const offset, Token *slot) {
-  switch (tks[*offset].kind) {
+template <typename Tokens>
+static Status munch_type(Tokens &tks, uint32_t *const offset, Token *slot) {
+  switch (tks.kind(*offset)) {
   case CASE_TYPES:
-    return munch_token(tks, length, offset, tks[*offset].kind, slot);
+    return munch_token(tks, offset, tks.kind(*offset), slot);
   default:
     return Status::TokenNotFound;
   };
 }
 
-Status parse_paralist(Token const *tks, uint32_t length, uint32_t *const offset,
-                      std::vector<Para> *pl);
+// The parse functions hand every node they recognise to a Builder and get
+// back a handle (Builder::ExprRef, StmtRef, ...) to pass on to whatever node
+// it ends up inside. TreeBuilder links the nodes up by pointer in an arena,
+// FlatBuilder lays them out in the arrays of a FlatAST.
+struct TreeBuilder {
+  using ExprRef = Expr *;
+  using StmtRef = Stmt *;
+  using CmpdRef = CmpdStmt *;
+  using ListRef = ExprList *;
+  // Lists under construction are marks into the pending stacks below.
+  using ListBuilder = uint32_t;
+  using CmpdBuilder = uint32_t;
+  using ParaList = uint32_t;
+  using DeclGroup = uint32_t;
+  struct DeclRef {
+    Decl dcl;
+    uint32_t first_modifier;
+  };
+
+  static constexpr Expr *no_expr = nullptr;
+  static constexpr Stmt *no_stmt = nullptr;
+
+  Arena *arena;
+  // Children of the lists being parsed, innermost list last. Each list is
+  // copied into the arena in one go once it is done, which is where it
+  // would have been reallocated as it grew.
+  std::vector<Expr *> pending_exprs = {};
+  std::vector<CmpdNode> pending_nodes = {};
+  std::vector<Decl> pending_decls = {};
+  std::vector<TypeModifier> pending_modifiers = {};
+  std::vector<Para> pending_paras = {};
+  // the expression parser's operator stack
+  std::vector<PrattFrame<Expr *, uint32_t>> pratt_frames = {};
+
+  template <typename T>
+  ArenaSpan<T> take_span(std::vector<T> *pending, uint32_t mark) {
+    ArenaSpan<T> const span = arena->make_span(
+        pending->data() + mark, static_cast<uint32_t>(pending->size()) - mark);
+    pending->resize(mark);
+    return span;
+  }
+
+  Expr *plain(uint32_t, Token const &tk) {
+    Expr *const node = arena->alloc<Expr>();
+    node->tag = Expr::ExprKind::PlainExpr;
+    node->plain_node.the_tk = tk;
+    return node;
+  }
+
+  Expr *unary(uint32_t, Token const &op, Expr *operand) {
+    Expr *const node = arena->alloc<Expr>();
+    node->tag = Expr::ExprKind::UnaryExpr;
+    node->unary_node.op_tk = op;
+    node->unary_node.expr = operand;
+    return node;
+  }
+
+  Expr *binary(uint32_t, Token const &op, Expr *left, Expr *right) {
+    Expr *const node = arena->alloc<Expr>();
+    node->tag = Expr::ExprKind::BinaryExpr;
+    node->binary_node.op_tk = op;
+    node->binary_node.left_expr = left;
+    node->binary_node.right_expr = right;
+    return node;
+  }
+
+  Expr *call(uint32_t, Token const &, Expr *callee, ExprList *args) {
+    Expr *const node = arena->alloc<Expr>();
+    node->tag = Expr::ExprKind::CallExpr;
+    node->call_node.left_expr = callee;
+    node->call_node.exprlist = args;
+    return node;
+  }
+
+  uint32_t begin_list() {
+    return static_cast<uint32_t>(pending_exprs.size());
+  }
+  void list_add(uint32_t *, Expr *expr) { pending_exprs.push_back(expr); }
+  ExprList *end_list(uint32_t *mark) {
+    ExprList *const list = arena->alloc<ExprList>();
+    list->expr_list = take_span(&pending_exprs, *mark);
+    return list;
+  }
+
+  Stmt *begin_stmt() { return arena->alloc<Stmt>(); }
+
+  void if_stmt(Stmt *stmt, Expr *condition, Stmt *if_stmt, Stmt *else_stmt) {
+    IfStmt *const node = arena->alloc<IfStmt>();
+    node->condition = condition;
+    node->if_stmt = if_stmt;
+    node->else_stmt = else_stmt;
+    stmt->tag = Stmt::kind::IfStmt;
+    stmt->if_node = node;
+  }
+
+  void for_stmt(Stmt *stmt, Expr *e1, Expr *e2, Expr *e3, Stmt *body) {
+    ForStmt *const node = arena->alloc<ForStmt>();
+    node->e1 = e1;
+    node->e2 = e2;
+    node->e3 = e3;
+    node->for_stmt = body;
+    stmt->tag = Stmt::kind::ForStmt;
+    stmt->for_node = node;
+  }
+
+  void while_stmt(Stmt *stmt, Expr *condition, Stmt *body) {
+    WhileStmt *const node = arena->alloc<WhileStmt>();
+    node->condition = condition;
+    node->while_stmt = body;
+    stmt->tag = Stmt::kind::WhileStmt;
+    stmt->while_node = node;
+  }
+
+  void break_stmt(Stmt *stmt) {
+    stmt->tag = Stmt::kind::BreakStmt;
+    stmt->nothing = 0;
+  }
+
+  void cont_stmt(Stmt *stmt) {
+    stmt->tag = Stmt::kind::ContStmt;
+    stmt->nothing = 0;
+  }
 
-Status parseExpr(Token const *tks, uint32_t length, uint32_t *const offset,
-                 Expr **expr);
+  // a bare `return;` has no RetStmt
+  void ret_stmt(Stmt *stmt, Expr *ret_expr) {
+    RetStmt *node = nullptr;
+    if (ret_expr != nullptr) {
+      node = arena->alloc<RetStmt>();
+      node->ret_expr = ret_expr;
+    }
+    stmt->tag = Stmt::kind::RetStmt;
+    stmt->return_node = node;
+  }
 
-Status parseExprList(Token const *tks, uint32_t length, uint32_t *const offset,
-                     TokenKind end_token, ExprList **expr) {
+  void expr_stmt(Stmt *stmt, Expr *expr) {
+    stmt->tag = Stmt::kind::ExprStmt;
+    stmt->expr_node = expr;
+  }
 
-  ExprList *new_list = new ExprList;
+  uint32_t begin_compound() {
+    return static_cast<uint32_t>(pending_nodes.size());
+  }
+  void compound_add_stmt(uint32_t *, Stmt *stmt) {
+    CmpdNode cnode = {.tag = CmpdNode::kind::Stmt, .stmt = stmt};
+    pending_nodes.push_back(cnode);
+  }
+  uint32_t begin_decls() {
+    return static_cast<uint32_t>(pending_decls.size());
+  }
+  void compound_add_decls(uint32_t *, uint32_t *dcl) {
+    CmpdNode cnode = {.tag = CmpdNode::kind::Decl,
+                      .decl = take_span(&pending_decls, *dcl)};
+    pending_nodes.push_back(cnode);
+  }
+  CmpdStmt *end_compound(uint32_t *mark) {
+    CmpdStmt *const cmpst = arena->alloc<CmpdStmt>();
+    cmpst->nodes = take_span(&pending_nodes, *mark);
+    return cmpst;
+  }
+
+  Stmt *compound_stmt(CmpdStmt *cmpst) {
+    Stmt *const stmt = arena->alloc<Stmt>();
+    stmt->tag = Stmt::kind::CmpdStmt;
+    stmt->compound_node = cmpst;
+    return stmt;
+  }
+
+  DeclRef begin_decl(uint32_t, Token const &type_tk) {
+    DeclRef ref = {
+        .dcl = {},
+        .first_modifier = static_cast<uint32_t>(pending_modifiers.size())};
+    ref.dcl.ti.type = type_tk;
+    return ref;
+  }
+  void set_ident(DeclRef *ref, uint32_t, Token const &ident) {
+    ref->dcl.ti.ident = ident;
+  }
 
-  while (tks[*offset].kind != end_token) {
-    Expr *new_expr;
-    Status err = parseExpr(tks, length, offset, &new_expr);
+  uint32_t begin_paras() {
+    return static_cast<uint32_t>(pending_paras.size());
+  }
+  void para_add(uint32_t *, uint8_t indirection_counter, uint32_t,
+                Token const &type, uint32_t, Token const &id) {
+    pending_paras.push_back(Para{.indirection_counter = indirection_counter,
+                                 .type = type,
+                                 .id = id});
+  }
+  void function_returning(DeclRef *, uint32_t *paralist) {
+    pending_modifiers.push_back(
+        TypeModifier{.tag = TypeModifier::TypeModKind::FunctionReturning,
+                     .para_list = take_span(&pending_paras, *paralist)});
+  }
+  void array_of(DeclRef *, Expr *expr) {
+    pending_modifiers.push_back(TypeModifier{
+        .tag = TypeModifier::TypeModKind::ArrayOf, .array_expr = expr});
+  }
+  void pointer_to(DeclRef *) {
+    TypeModifier tm = {.tag = TypeModifier::TypeModKind::PointerTo,
+                       .array_expr = nullptr};
+    pending_modifiers.push_back(tm);
+  }
+
+  void init_nothing(DeclRef *ref) {
+    ref->dcl.init.tag = InitValue::DeclKind::Nothing;
+    ref->dcl.init.nothing = nullptr;
+  }
+  void init_expr(DeclRef *ref, Expr *expr) {
+    ref->dcl.init.tag = InitValue::DeclKind::Expr;
+    ref->dcl.init.expr = expr;
+  }
+  void init_list(DeclRef *ref, ExprList *exprlist) {
+    ref->dcl.init.tag = InitValue::DeclKind::ExprList;
+    ref->dcl.init.exprlist = exprlist;
+  }
+  void init_body(DeclRef *ref, CmpdStmt *body) {
+    ref->dcl.init.tag = InitValue::DeclKind::Body;
+    ref->dcl.init.body = body;
+  }
+  // The modifiers of the declarations in a body were taken off the stack
+  // as those were finished, so this one's are on top.
+  void end_decl(uint32_t *, DeclRef *ref) {
+    ref->dcl.ti.modifiers = take_span(&pending_modifiers, ref->first_modifier);
+    pending_decls.push_back(ref->dcl);
+  }
+};
+
+// Nodes go into the FlatAST's arrays as they are finished, which is
+// postorder. Statements and declarations have their slot taken when they
+// start instead, which makes their arrays preorder.
+struct FlatBuilder {
+  using ExprRef = NodeIndex;
+  using StmtRef = NodeIndex;
+  using CmpdRef = NodeIndex;
+  using ListRef = NodeIndex;
+  // where the list's items start in `pending`
+  using ListBuilder = uint32_t;
+  using CmpdBuilder = NodeIndex;
+  using ParaList = FlatRange;
+  using DeclRef = NodeIndex;
+  // the DeclStmt, or no_node at the top level
+  using DeclGroup = NodeIndex;
+
+  static constexpr NodeIndex no_expr = no_node;
+  static constexpr NodeIndex no_stmt = no_node;
+
+  FlatAST *ast;
+  // Items of the expression lists being parsed, innermost list last. They
+  // only go to ast->list_items once the list is done, so that each list's
+  // items are contiguous even when an item has a list of its own.
+  std::vector<NodeIndex> pending = {};
+  // the expression parser's operator stack
+  std::vector<PrattFrame<NodeIndex, uint32_t>> pratt_frames = {};
+
+  NodeIndex add_expr(FlatExpr const &expr) {
+    ast->exprs.push_back(expr);
+    return static_cast<NodeIndex>(ast->exprs.size() - 1);
+  }
+
+  NodeIndex plain(uint32_t tk, Token const &) {
+    return add_expr(FlatExpr{.tag = Expr::ExprKind::PlainExpr,
+                             .token = tk,
+                             .lhs = no_node,
+                             .rhs = no_node});
+  }
+
+  NodeIndex unary(uint32_t op, Token const &, NodeIndex operand) {
+    return add_expr(FlatExpr{.tag = Expr::ExprKind::UnaryExpr,
+                             .token = op,
+                             .lhs = operand,
+                             .rhs = no_node});
+  }
+
+  NodeIndex binary(uint32_t op, Token const &, NodeIndex left,
+                   NodeIndex right) {
+    return add_expr(FlatExpr{.tag = Expr::ExprKind::BinaryExpr,
+                             .token = op,
+                             .lhs = left,
+                             .rhs = right});
+  }
+
+  NodeIndex call(uint32_t lparen, Token const &, NodeIndex callee,
+                 NodeIndex args) {
+    return add_expr(FlatExpr{.tag = Expr::ExprKind::CallExpr,
+                             .token = lparen,
+                             .lhs = callee,
+                             .rhs = args});
+  }
+
+  uint32_t begin_list() { return static_cast<uint32_t>(pending.size()); }
+  void list_add(uint32_t *, NodeIndex expr) { pending.push_back(expr); }
+  NodeIndex end_list(uint32_t *mark) {
+    FlatRange const items = {
+        .first = static_cast<uint32_t>(ast->list_items.size()),
+        .count = static_cast<uint32_t>(pending.size()) - *mark};
+    ast->list_items.insert(ast->list_items.end(), pending.begin() + *mark,
+                           pending.end());
+    pending.resize(*mark);
+    ast->expr_lists.push_back(items);
+    return static_cast<NodeIndex>(ast->expr_lists.size() - 1);
+  }
+
+  NodeIndex begin_stmt() {
+    ast->stmts.push_back(FlatStmt{});
+    return static_cast<NodeIndex>(ast->stmts.size() - 1);
+  }
+
+  void finish_stmt(NodeIndex stmt, FlatStmt::Kind tag, NodeIndex a,
+                   NodeIndex b, NodeIndex c) {
+    ast->stmts[stmt] =
+        FlatStmt{.tag = tag,
+                 .end = static_cast<NodeIndex>(ast->stmts.size()),
+                 .a = a,
+                 .b = b,
+                 .c = c};
+  }
+
+  // the body follows the statement, there is nothing to link
+  void if_stmt(NodeIndex stmt, NodeIndex condition, NodeIndex,
+               NodeIndex else_stmt) {
+    finish_stmt(stmt, FlatStmt::Kind::IfStmt, condition, else_stmt, no_node);
+  }
+
+  void for_stmt(NodeIndex stmt, NodeIndex e1, NodeIndex e2, NodeIndex e3,
+                NodeIndex) {
+    finish_stmt(stmt, FlatStmt::Kind::ForStmt, e1, e2, e3);
+  }
+
+  void while_stmt(NodeIndex stmt, NodeIndex condition, NodeIndex) {
+    finish_stmt(stmt, FlatStmt::Kind::WhileStmt, condition, no_node,
+                no_node);
+  }
+
+  void break_stmt(NodeIndex stmt) {
+    finish_stmt(stmt, FlatStmt::Kind::BreakStmt, no_node, no_node, no_node);
+  }
+
+  void cont_stmt(NodeIndex stmt) {
+    finish_stmt(stmt, FlatStmt::Kind::ContStmt, no_node, no_node, no_node);
+  }
+
+  void ret_stmt(NodeIndex stmt, NodeIndex ret_expr) {
+    finish_stmt(stmt, FlatStmt::Kind::RetStmt, ret_expr, no_node, no_node);
+  }
+
+  void expr_stmt(NodeIndex stmt, NodeIndex expr) {
+    finish_stmt(stmt, FlatStmt::Kind::ExprStmt, expr, no_node, no_node);
+  }
+
+  // the block's statements follow it, there is nothing to link
+  NodeIndex begin_compound() { return begin_stmt(); }
+  void compound_add_stmt(NodeIndex *, NodeIndex) {}
+  NodeIndex begin_decls() {
+    NodeIndex const stmt = begin_stmt();
+    ast->stmts[stmt].a = static_cast<NodeIndex>(ast->decls.size());
+    return stmt;
+  }
+  void compound_add_decls(NodeIndex *, NodeIndex *dcl) {
+    finish_stmt(*dcl, FlatStmt::Kind::DeclStmt, ast->stmts[*dcl].a,
+                static_cast<NodeIndex>(ast->decls.size()), no_node);
+  }
+  NodeIndex end_compound(NodeIndex *cmpst) {
+    finish_stmt(*cmpst, FlatStmt::Kind::CmpdStmt, no_node, no_node, no_node);
+    return *cmpst;
+  }
+
+  NodeIndex compound_stmt(NodeIndex cmpst) { return cmpst; }
+
+  NodeIndex begin_decl(uint32_t type_tk, Token const &) {
+    ast->decls.push_back(FlatDecl{
+        .type = type_tk,
+        .ident = no_node,
+        .modifiers = {static_cast<uint32_t>(ast->modifiers.size()), 0},
+        .init_tag = InitValue::DeclKind::Nothing,
+        .init = no_node,
+        .end = no_node});
+    return static_cast<NodeIndex>(ast->decls.size() - 1);
+  }
+  void set_ident(NodeIndex *dcl, uint32_t ident, Token const &) {
+    ast->decls[*dcl].ident = ident;
+  }
+
+  // A declaration's modifiers are contiguous: nothing in between (array
+  // sizes, parameters) has modifiers of its own.
+  void add_modifier(NodeIndex dcl, FlatModifier const &tm) {
+    assert(ast->decls[dcl].modifiers.first +
+               ast->decls[dcl].modifiers.count ==
+           ast->modifiers.size());
+    ast->modifiers.push_back(tm);
+    ++ast->decls[dcl].modifiers.count;
+  }
+
+  FlatRange begin_paras() {
+    return FlatRange{static_cast<uint32_t>(ast->paras.size()), 0};
+  }
+  void para_add(FlatRange *paralist, uint8_t indirection_counter,
+                uint32_t type, Token const &, uint32_t id, Token const &) {
+    ast->paras.push_back(FlatPara{
+        .indirection_counter = indirection_counter, .type = type, .id = id});
+    ++paralist->count;
+  }
+  void function_returning(NodeIndex *dcl, FlatRange *paralist) {
+    add_modifier(
+        *dcl, FlatModifier{.tag = TypeModifier::TypeModKind::FunctionReturning,
+                           .array_expr = no_node,
+                           .paras = *paralist});
+  }
+  void array_of(NodeIndex *dcl, NodeIndex expr) {
+    add_modifier(*dcl, FlatModifier{.tag = TypeModifier::TypeModKind::ArrayOf,
+                                    .array_expr = expr,
+                                    .paras = {0, 0}});
+  }
+  void pointer_to(NodeIndex *dcl) {
+    add_modifier(*dcl,
+                 FlatModifier{.tag = TypeModifier::TypeModKind::PointerTo,
+                              .array_expr = no_node,
+                              .paras = {0, 0}});
+  }
+
+  void init_nothing(NodeIndex *dcl) {
+    ast->decls[*dcl].init_tag = InitValue::DeclKind::Nothing;
+    ast->decls[*dcl].init = no_node;
+  }
+  void init_expr(NodeIndex *dcl, NodeIndex expr) {
+    ast->decls[*dcl].init_tag = InitValue::DeclKind::Expr;
+    ast->decls[*dcl].init = expr;
+  }
+  void init_list(NodeIndex *dcl, NodeIndex exprlist) {
+    ast->decls[*dcl].init_tag = InitValue::DeclKind::ExprList;
+    ast->decls[*dcl].init = exprlist;
+  }
+  void init_body(NodeIndex *dcl, NodeIndex body) {
+    ast->decls[*dcl].init_tag = InitValue::DeclKind::Body;
+    ast->decls[*dcl].init = body;
+  }
+  void end_decl(NodeIndex *, NodeIndex *dcl) {
+    ast->decls[*dcl].end = static_cast<NodeIndex>(ast->decls.size());
+  }
+};
+
+template <typename Tokens, typename Builder>
+Status parse_paralist(Tokens &tks, uint32_t *const offset, Builder *b,
+                      typename Builder::ParaList *pl);
+
+template <typename Tokens, typename Builder>
+Status parseExpr(Tokens &tks, uint32_t *const offset, Builder *b,
+                 typename Builder::ExprRef *expr);
+
+template <typename Tokens, typename Builder>
+Status parseExprList(Tokens &tks, uint32_t *const offset, Builder *b,
+                     TokenKind end_token, typename Builder::ListRef *expr) {
+
+  typename Builder::ListBuilder new_list = b->begin_list();
+
+  while (tks.kind(*offset) != end_token) {
+    typename Builder::ExprRef new_expr;
+    Status err = parseExpr(tks, offset, b, &new_expr);
     if (err != Status::Success) {
       return err;
     }
-    new_list->expr_list.push_back(new_expr);
+    b->list_add(&new_list, new_expr);
+    if (tks.kind(*offset) != end_token) {
+      err = accept_token(tks, offset, TokenKind::COMMA);
+      if (err != Status::Success) {
+        return err;
+      }
+      // no trailing ','
+      if (tks.kind(*offset) == end_token) {
+        return Status::SyntaxError;
+      }
+    }
   }
 
-  *expr = new_list;
+  *expr = b->end_list(&new_list);
 
   return Status::Success;
 }
 
+// Tokens is TokenStream const or TokenPipe: anything with kind(i),
+// operator[](i) and size() that the parser can walk forwards through.
+template <typename Tokens>
+static AST parse_program(Tokens &tks, uint32_t offset = 0) {
+  AST ast;
+  TreeBuilder b = {.arena = &ast.arena};
+  uint32_t top_level = b.begin_decls();
+
+  while (tks.kind(offset) != TokenKind::EVC_EOF) {
+    if (parse_decl(tks, &offset, &b, &top_level) != Status::Success) {
+      ast.error_token = offset;
+      break;
+    }
+  }
+
+  ast.decls.assign(b.pending_decls.begin() + top_level,
+                   b.pending_decls.end());
+  return ast;
+}
+
+AST do_parse(TokenStream const &tks) { return parse_program(tks); }
+
 AST do_parse(Token const *tks, uint32_t length) {
-  uint32_t offset = 0;
-  std::vector<Decl> ret = {};
+  return do_parse(to_token_stream(tks, length));
+}
 
-  while (tks[offset].kind != TokenKind::EVC_EOF) {
-    parse_decl(tks, length, &offset, &ret);
+AST do_parse(TokenPipe &tks) { return parse_program(tks); }
+
+AST do_scan_and_parse(char const *start, uint32_t length, PipeMode mode,
+                      SymbolInterner *symbols) {
+  TokenPipe pipe(start, length, mode, symbols);
+  return do_parse(pipe);
+}
+
+// The tokens of a TokenStream up to `end`, where the parser sees EVC_EOF
+// instead, so that a run of top-level declarations parses as a program of
+// its own.
+struct BoundedTokens {
+  TokenStream const *tks;
+  uint32_t end;
+
+  uint32_t size() const { return end + 1; }
+  TokenKind kind(uint32_t i) const {
+    return i < end ? tks->kind(i) : TokenKind::EVC_EOF;
+  }
+  Token operator[](uint32_t i) const {
+    if (i < end) {
+      return (*tks)[i];
+    }
+    Token eof = tks->back();
+    eof.kind = TokenKind::EVC_EOF;
+    return eof;
   }
+};
 
-  return AST{ret};
+// Where the top-level declarations could end, by brace depth alone: after a
+// ';' outside any braces, or after the '}' closing a function body (one not
+// followed by the ';' or ',' that would make it an initializer list). Only
+// a guess, which the parse of each piece checks.
+static std::vector<uint32_t> split_top_level(TokenStream const &tks,
+                                             uint32_t min_chunk) {
+  std::vector<uint32_t> starts = {0};
+  uint32_t const eof_at = tks.size() - 1;
+  uint32_t depth = 0;
+  for (uint32_t i = 0; i < eof_at; ++i) {
+    bool boundary = false;
+    switch (tks.kind(i)) {
+    case TokenKind::LCURLY:
+      ++depth;
+      break;
+    case TokenKind::RCURLY:
+      if (depth > 0 && --depth == 0) {
+        TokenKind const next = tks.kind(i + 1);
+        boundary = next != TokenKind::SEMICOLON && next != TokenKind::COMMA;
+      }
+      break;
+    case TokenKind::SEMICOLON:
+      boundary = depth == 0;
+      break;
+    default:
+      break;
+    }
+    if (boundary && i + 1 - starts.back() >= min_chunk && i + 1 < eof_at) {
+      starts.push_back(i + 1);
+    }
+  }
+  return starts;
 }
-Status pratt_loop_identifier(Token const *tks, uint32_t length,
-                             uint32_t *const offset, TypeIdent *ti);
 
-// Status parseTypeIdent(Token const *tks, uint32_t length, uint32_t *const
+AST do_parse_parallel(TokenStream const &tks, uint32_t threads,
+                      uint32_t min_chunk) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  if (threads == 1 || tks.size() < 2 * min_chunk) {
+    return parse_program(tks);
+  }
+
+  // a few pieces per thread, so that stealing can even out bodies of
+  // different sizes
+  uint32_t const chunk = std::max(min_chunk, tks.size() / (threads * 4));
+  std::vector<uint32_t> starts = split_top_level(tks, chunk);
+  uint32_t const count = static_cast<uint32_t>(starts.size());
+  if (count == 1) {
+    return parse_program(tks);
+  }
+  starts.push_back(tks.size() - 1);
+
+  // each piece into an arena of its own
+  std::vector<AST> pieces(count);
+  run_work_stealing(count, threads, [&](uint32_t i) {
+    BoundedTokens const piece = {.tks = &tks, .end = starts[i + 1]};
+    pieces[i] = parse_program(piece, starts[i]);
+  });
+
+  AST ast;
+  size_t decl_count = 0;
+  for (AST const &piece : pieces) {
+    decl_count += piece.decls.size();
+  }
+  ast.decls.reserve(decl_count);
+  for (uint32_t i = 0; i < count; ++i) {
+    if (pieces[i].error_token != AST::no_error) {
+      // The piece may have been cut in the wrong place, and its error is
+      // not necessarily where the whole program's is: parse the rest as
+      // do_parse would, stopping at the same token it does.
+      pieces[i] = parse_program(tks, starts[i]);
+      ast.error_token = pieces[i].error_token;
+    }
+    ast.arena.adopt(std::move(pieces[i].arena));
+    ast.decls.insert(ast.decls.end(), pieces[i].decls.begin(),
+                     pieces[i].decls.end());
+    if (ast.error_token != AST::no_error) {
+      break;
+    }
+  }
+  return ast;
+}
+
+void do_parse_flat(TokenStream const &tks, FlatAST *ast) {
+  ast->clear();
+  FlatBuilder b = {.ast = ast};
+  NodeIndex top_level = no_node;
+
+  uint32_t offset = 0;
+  while (tks.kind(offset) != TokenKind::EVC_EOF) {
+    if (parse_decl(tks, &offset, &b, &top_level) != Status::Success) {
+      ast->error_token = offset;
+      break;
+    }
+  }
+}
+
+template <typename Tokens, typename Builder>
+Status pratt_loop_identifier(Tokens &tks, uint32_t *const offset, Builder *b,
+                             typename Builder::DeclRef *dcl);
+
+// Status parseTypeIdent(TokenStream const &tks, uint32_t *const
 // offset,
 //                       TypeIdent *ti);
 
-Status parseCompoundStmt(Token const *tks, uint32_t length,
-                         uint32_t *const offset, CmpdStmt **cmpst);
-
-Status parseIfStmt(Token const *tks, uint32_t length, uint32_t *const offset,
-                   IfStmt **ifst);
+template <typename Tokens, typename Builder>
+Status parseCompoundStmt(Tokens &tks, uint32_t *const offset, Builder *b,
+                         typename Builder::CmpdRef *cmpst);
 
-Status parseForStmt(Token const *tks, uint32_t length, uint32_t *const offset,
-                    ForStmt **forst);
+template <typename Tokens, typename Builder>
+Status parseIfStmt(Tokens &tks, uint32_t *const offset, Builder *b,
+                   typename Builder::StmtRef stmt);
 
-Status parseWhileStmt(Token const *tks, uint32_t length, uint32_t *const offset,
-                      WhileStmt **whilest);
+template <typename Tokens, typename Builder>
+Status parseForStmt(Tokens &tks, uint32_t *const offset, Builder *b,
+                    typename Builder::StmtRef stmt);
 
-Status parseBreakStmt(Token const *tks, uint32_t length,
-                      uint32_t *const offset);
+template <typename Tokens, typename Builder>
+Status parseWhileStmt(Tokens &tks, uint32_t *const offset, Builder *b,
+                      typename Builder::StmtRef stmt);
 
-Status parseContinueStmt(Token const *tks, uint32_t length,
-                         uint32_t *const offset);
+template <typename Tokens>
+Status parseBreakStmt(Tokens &tks, uint32_t *const offset);
 
-Status parseReturnStmt(Token const *tks, uint32_t length,
-                       uint32_t *const offset, RetStmt **retst);
+template <typename Tokens>
+Status parseContinueStmt(Tokens &tks, uint32_t *const offset);
 
-Status parseStmt(Token const *tks, uint32_t length, uint32_t *const offset,
-                 Stmt **stmt) {
-  auto peek_token = tks[*offset];
+template <typename Tokens, typename Builder>
+Status parseReturnStmt(Tokens &tks, uint32_t *const offset, Builder *b,
+                       typename Builder::StmtRef stmt);
 
-  Stmt *new_stmt_node = (Stmt *)malloc(sizeof(Stmt));
+template <typename Tokens, typename Builder>
+Status parseStmt(Tokens &tks, uint32_t *const offset, Builder *b,
+                 typename Builder::StmtRef *stmt) {
+  TokenKind const peek_kind = tks.kind(*offset);
 
-  switch (peek_token.kind) {
-  case TokenKind::LCURLY: {
+  if (peek_kind == TokenKind::LCURLY) {
     // parseCmpdStmt
-    new_stmt_node->tag = Stmt::kind::CmpdStmt;
-    Status err =
-        parseCompoundStmt(tks, length, offset, &new_stmt_node->compound_node);
+    typename Builder::CmpdRef cmpst;
+    Status err = parseCompoundStmt(tks, offset, b, &cmpst);
     if (err != Status::Success) {
       return err;
     }
-  }
+    *stmt = b->compound_stmt(cmpst);
     return Status::Success;
+  }
+
+  typename Builder::StmtRef new_stmt_node = b->begin_stmt();
+  *stmt = new_stmt_node;
+
+  switch (peek_kind) {
   case TokenKind::IF: {
     // parseIfStmt
-    new_stmt_node->tag = Stmt::kind::IfStmt;
-    Status err = parseIfStmt(tks, length, offset, &new_stmt_node->if_node);
+    Status err = parseIfStmt(tks, offset, b, new_stmt_node);
     if (err != Status::Success) {
       return err;
     }
@@ -236,358 +845,369 @@ Status parseStmt(Token const *tks, uint32_t length, uint32_t *const offset,
     break;
   case TokenKind::FOR: {
     // parseIfStmt
-    new_stmt_node->tag = Stmt::kind::ForStmt;
-    Status err = parseForStmt(tks, length, offset, &new_stmt_node->for_node);
+    Status err = parseForStmt(tks, offset, b, new_stmt_node);
     if (err != Status::Success) {
       return err;
     }
   }
     return Status::Success;
   case TokenKind::WHILE: {
-    new_stmt_node->tag = Stmt::kind::WhileStmt;
-    Status err =
-        parseWhileStmt(tks, length, offset, &new_stmt_node->while_node);
+    Status err = parseWhileStmt(tks, offset, b, new_stmt_node);
     if (err != Status::Success) {
       return err;
     }
   }
     return Status::Success;
   case TokenKind::BREAK: {
-    new_stmt_node->tag = Stmt::kind::BreakStmt;
-    new_stmt_node->nothing = 0;
-    Status err = parseBreakStmt(tks, length, offset);
+    b->break_stmt(new_stmt_node);
+    Status err = parseBreakStmt(tks, offset);
     if (err != Status::Success) {
       return err;
     }
   }
     return Status::Success;
   case TokenKind::CONTINUE: {
-    new_stmt_node->tag = Stmt::kind::ContStmt;
-    new_stmt_node->nothing = 0;
-    Status err = parseContinueStmt(tks, length, offset);
+    b->cont_stmt(new_stmt_node);
+    Status err = parseContinueStmt(tks, offset);
     if (err != Status::Success) {
       return err;
     }
   }
     return Status::Success;
   case TokenKind::RETURN: {
-    new_stmt_node->tag = Stmt::kind::RetStmt;
-    Status err =
-        parseReturnStmt(tks, length, offset, &new_stmt_node->return_node);
+    Status err = parseReturnStmt(tks, offset, b, new_stmt_node);
     if (err != Status::Success) {
       return err;
     }
   }
     return Status::Success;
   default: {
-    new_stmt_node->tag = Stmt::kind::ExprStmt;
-    Status err = parseExpr(tks, length, offset, &new_stmt_node->expr_node);
-    if (err != Status::Success) {
-      return err;
+    // an empty statement, `;`, has no expression
+    typename Builder::ExprRef expr = Builder::no_expr;
+    if (peek_kind != TokenKind::SEMICOLON) {
+      Status err = parseExpr(tks, offset, b, &expr);
+      if (err != Status::Success) {
+        return err;
+      }
     }
+    b->expr_stmt(new_stmt_node, expr);
   }
-    return Status::Success;
+    return accept_token(tks, offset, TokenKind::SEMICOLON);
   }
 }
 
-Status parseIfStmt(Token const *tks, uint32_t length, uint32_t *const offset,
-                   IfStmt **ifst) {
+template <typename Tokens, typename Builder>
+Status parseIfStmt(Tokens &tks, uint32_t *const offset, Builder *b,
+                   typename Builder::StmtRef stmt) {
 
-  Status err = accept_token(tks, length, offset, TokenKind::IF);
+  Status err = accept_token(tks, offset, TokenKind::IF);
   if (err != Status::Success) {
     return err;
   }
 
-  err = accept_token(tks, length, offset, TokenKind::LPAREN);
+  err = accept_token(tks, offset, TokenKind::LPAREN);
   if (err != Status::Success) {
     return err;
   }
 
-  IfStmt *new_node = (IfStmt *)malloc(sizeof(IfStmt));
-
-  err = parseExpr(tks, length, offset, &new_node->condition);
+  typename Builder::ExprRef condition;
+  err = parseExpr(tks, offset, b, &condition);
   if (err != Status::Success) {
     return err;
   }
 
-  err = accept_token(tks, length, offset, TokenKind::RPAREN);
+  err = accept_token(tks, offset, TokenKind::RPAREN);
   if (err != Status::Success) {
     return err;
   }
 
-  err = parseStmt(tks, length, offset, &new_node->if_stmt);
+  typename Builder::StmtRef if_stmt;
+  err = parseStmt(tks, offset, b, &if_stmt);
   if (err != Status::Success) {
     return err;
   }
 
-  auto peek_token = tks[*offset];
-  if (peek_token.kind != TokenKind::ELSE) {
-    new_node->else_stmt = nullptr;
-
-    *ifst = new_node;
+  if (tks.kind(*offset) != TokenKind::ELSE) {
+    b->if_stmt(stmt, condition, if_stmt, Builder::no_stmt);
 
     return Status::Success;
   } else {
-    accept_token(tks, length, offset, TokenKind::ELSE);
-    err = parseStmt(tks, length, offset, &new_node->else_stmt);
+    accept_token(tks, offset, TokenKind::ELSE);
+    typename Builder::StmtRef else_stmt;
+    err = parseStmt(tks, offset, b, &else_stmt);
     if (err != Status::Success) {
       return err;
     }
 
-    *ifst = new_node;
+    b->if_stmt(stmt, condition, if_stmt, else_stmt);
 
     return Status::Success;
   }
 }
 
-Status parseForStmt(Token const *tks, uint32_t length, uint32_t *const offset,
-                    ForStmt **forst) {
+template <typename Tokens, typename Builder>
+Status parseForStmt(Tokens &tks, uint32_t *const offset, Builder *b,
+                    typename Builder::StmtRef stmt) {
 
-  Status err = accept_token(tks, length, offset, TokenKind::FOR);
+  Status err = accept_token(tks, offset, TokenKind::FOR);
   if (err != Status::Success) {
     return err;
   }
 
-  err = accept_token(tks, length, offset, TokenKind::LPAREN);
+  err = accept_token(tks, offset, TokenKind::LPAREN);
   if (err != Status::Success) {
     return err;
   }
 
-  ForStmt *new_node = (ForStmt *)malloc(sizeof(ForStmt));
+  typename Builder::ExprRef e1 = Builder::no_expr;
+  typename Builder::ExprRef e2 = Builder::no_expr;
+  typename Builder::ExprRef e3 = Builder::no_expr;
 
-  auto peek_token = tks[*offset];
-  if (peek_token.kind == TokenKind::SEMICOLON) {
-    accept_token(tks, length, offset, TokenKind::SEMICOLON);
-  } else {
-    err = parseExpr(tks, length, offset, &new_node->e1);
+  if (tks.kind(*offset) != TokenKind::SEMICOLON) {
+    err = parseExpr(tks, offset, b, &e1);
     if (err != Status::Success) {
       return err;
     }
   }
+  err = accept_token(tks, offset, TokenKind::SEMICOLON);
+  if (err != Status::Success) {
+    return err;
+  }
 
-  peek_token = tks[*offset];
-  if (peek_token.kind == TokenKind::SEMICOLON) {
-    accept_token(tks, length, offset, TokenKind::SEMICOLON);
-  } else {
-    err = parseExpr(tks, length, offset, &new_node->e2);
+  if (tks.kind(*offset) != TokenKind::SEMICOLON) {
+    err = parseExpr(tks, offset, b, &e2);
     if (err != Status::Success) {
       return err;
     }
   }
+  err = accept_token(tks, offset, TokenKind::SEMICOLON);
+  if (err != Status::Success) {
+    return err;
+  }
 
-  peek_token = tks[*offset];
-  if (peek_token.kind == TokenKind::RPAREN) {
+  if (tks.kind(*offset) == TokenKind::RPAREN) {
     ;
   } else {
-    err = parseExpr(tks, length, offset, &new_node->e3);
+    err = parseExpr(tks, offset, b, &e3);
     if (err != Status::Success) {
       return err;
     }
   }
 
-  err = accept_token(tks, length, offset, TokenKind::RPAREN);
+  err = accept_token(tks, offset, TokenKind::RPAREN);
   if (err != Status::Success) {
     return err;
   }
 
-  err = parseStmt(tks, length, offset, &new_node->for_stmt);
+  typename Builder::StmtRef for_stmt;
+  err = parseStmt(tks, offset, b, &for_stmt);
   if (err != Status::Success) {
     return err;
   }
 
-  *forst = new_node;
+  b->for_stmt(stmt, e1, e2, e3, for_stmt);
   return Status::Success;
 }
 
-Status parseWhileStmt(Token const *tks, uint32_t length, uint32_t *const offset,
-                      WhileStmt **whilest) {
+template <typename Tokens, typename Builder>
+Status parseWhileStmt(Tokens &tks, uint32_t *const offset, Builder *b,
+                      typename Builder::StmtRef stmt) {
 
-  Status err = accept_token(tks, length, offset, TokenKind::WHILE);
+  Status err = accept_token(tks, offset, TokenKind::WHILE);
   if (err != Status::Success) {
     return err;
   }
 
-  err = accept_token(tks, length, offset, TokenKind::LPAREN);
+  err = accept_token(tks, offset, TokenKind::LPAREN);
   if (err != Status::Success) {
     return err;
   }
 
-  WhileStmt *new_node = (WhileStmt *)malloc(sizeof(WhileStmt));
-  err = parseExpr(tks, length, offset, &new_node->condition);
+  typename Builder::ExprRef condition;
+  err = parseExpr(tks, offset, b, &condition);
   if (err != Status::Success) {
     return err;
   }
 
-  err = accept_token(tks, length, offset, TokenKind::RPAREN);
+  err = accept_token(tks, offset, TokenKind::RPAREN);
   if (err != Status::Success) {
     return err;
   }
 
-  err = parseStmt(tks, length, offset, &new_node->while_stmt);
+  typename Builder::StmtRef while_stmt;
+  err = parseStmt(tks, offset, b, &while_stmt);
   if (err != Status::Success) {
     return err;
   }
 
-  *whilest = new_node;
+  b->while_stmt(stmt, condition, while_stmt);
   return Status::Success;
 };
 
-Status parseBreakStmt(Token const *tks, uint32_t length,
-                      uint32_t *const offset) {
-  Status err = accept_token(tks, length, offset, TokenKind::CONTINUE);
+template <typename Tokens>
+Status parseBreakStmt(Tokens &tks, uint32_t *const offset) {
+  Status err = accept_token(tks, offset, TokenKind::BREAK);
   if (err != Status::Success) {
     return err;
   }
-  return accept_token(tks, length, offset, TokenKind::SEMICOLON);
+  return accept_token(tks, offset, TokenKind::SEMICOLON);
 }
 
-Status parseContinueStmt(Token const *tks, uint32_t length,
-                         uint32_t *const offset) {
-  Status err = accept_token(tks, length, offset, TokenKind::CONTINUE);
+template <typename Tokens>
+Status parseContinueStmt(Tokens &tks, uint32_t *const offset) {
+  Status err = accept_token(tks, offset, TokenKind::CONTINUE);
   if (err != Status::Success) {
     return err;
   }
-  return accept_token(tks, length, offset, TokenKind::SEMICOLON);
+  return accept_token(tks, offset, TokenKind::SEMICOLON);
 }
 
-Status parseReturnStmt(Token const *tks, uint32_t length,
-                       uint32_t *const offset, RetStmt **retst) {
-  Status err = accept_token(tks, length, offset, TokenKind::RETURN);
+template <typename Tokens, typename Builder>
+Status parseReturnStmt(Tokens &tks, uint32_t *const offset, Builder *b,
+                       typename Builder::StmtRef stmt) {
+  Status err = accept_token(tks, offset, TokenKind::RETURN);
   if (err != Status::Success) {
     return err;
   }
 
-  auto peek_token = tks[*offset];
+  if (tks.kind(*offset) == TokenKind::SEMICOLON) {
+    accept_token(tks, offset, TokenKind::SEMICOLON);
 
-  if (peek_token.kind == TokenKind::SEMICOLON) {
-    accept_token(tks, length, offset, TokenKind::SEMICOLON);
-
-    *retst = nullptr;
+    b->ret_stmt(stmt, Builder::no_expr);
     return Status::Success;
   } else {
-    RetStmt *new_node = (RetStmt *)malloc(sizeof(RetStmt));
-    Status err = parseExpr(tks, length, offset, &new_node->ret_expr);
+    typename Builder::ExprRef ret_expr;
+    Status err = parseExpr(tks, offset, b, &ret_expr);
     if (err != Status::Success) {
       return err;
     }
-    err = accept_token(tks, length, offset, TokenKind::SEMICOLON);
+    err = accept_token(tks, offset, TokenKind::SEMICOLON);
     if (err != Status::Success) {
       return err;
     }
 
-    *retst = new_node;
+    b->ret_stmt(stmt, ret_expr);
     return Status::Success;
   }
 }
 
-Status parseCompoundStmt(Token const *tks, uint32_t length,
-                         uint32_t *const offset, CmpdStmt **cmpst) {
-  Status err = accept_token(tks, length, offset, TokenKind::LCURLY);
+template <typename Tokens, typename Builder>
+Status parseCompoundStmt(Tokens &tks, uint32_t *const offset, Builder *b,
+                         typename Builder::CmpdRef *cmpst) {
+  Status err = accept_token(tks, offset, TokenKind::LCURLY);
   if (err != Status::Success) {
     return err;
   }
 
-  *cmpst = new CmpdStmt;
+  typename Builder::CmpdBuilder nodes = b->begin_compound();
 
-  for (auto peek_token = tks[*offset]; peek_token.kind != TokenKind::RCURLY;
-       ++*offset, peek_token = tks[*offset]) {
-    if (peek_token.kind == TokenKind::BOOLEAN ||
-        peek_token.kind == TokenKind::INT ||
-        peek_token.kind == TokenKind::FLOAT ||
-        peek_token.kind == TokenKind::VOID) {
-      std::vector<Decl> dcl;
-      err = parse_decl(tks, length, offset, &dcl);
+  for (TokenKind peek_kind = tks.kind(*offset); peek_kind != TokenKind::RCURLY;
+       peek_kind = tks.kind(*offset)) {
+    if (peek_kind == TokenKind::EVC_EOF) {
+      return Status::TokenNotFound;
+    }
+    if (peek_kind == TokenKind::BOOLEAN || peek_kind == TokenKind::INT ||
+        peek_kind == TokenKind::FLOAT || peek_kind == TokenKind::VOID) {
+      typename Builder::DeclGroup dcl = b->begin_decls();
+      err = parse_decl(tks, offset, b, &dcl);
       if (err != Status::Success) {
         return err;
       }
-      CmpdNode cnode = {.tag = CmpdNode::kind::Decl, .decl = dcl};
-      (*cmpst)->nodes.push_back(cnode);
+      b->compound_add_decls(&nodes, &dcl);
     } else {
-      Stmt *stmt_node;
-      err = parseStmt(tks, length, offset, &stmt_node);
+      typename Builder::StmtRef stmt_node;
+      err = parseStmt(tks, offset, b, &stmt_node);
       if (err != Status::Success) {
         return err;
       }
-      CmpdNode cnode = {.tag = CmpdNode::kind::Stmt, .stmt = stmt_node};
-      (*cmpst)->nodes.push_back(cnode);
+      b->compound_add_stmt(&nodes, stmt_node);
     }
   }
 
-  err = accept_token(tks, length, offset, TokenKind::RCURLY);
+  err = accept_token(tks, offset, TokenKind::RCURLY);
   if (err != Status::Success) {
     return err;
   }
+  *cmpst = b->end_compound(&nodes);
   return Status::Success;
 };
 
-Status parse_decl(Token const *tks, uint32_t length, uint32_t *const offset,
-                  std::vector<Decl> *const ret) {
+template <typename Tokens, typename Builder>
+Status parse_decl(Tokens &tks, uint32_t *const offset, Builder *b,
+                  typename Builder::DeclGroup *const ret) {
+  uint32_t const type_at = *offset;
   Token type_tk;
-  Status err = munch_type(tks, length, offset, &type_tk);
+  Status err = munch_type(tks, offset, &type_tk);
   if (err != Status::Success) {
     return err;
   }
-  return Status::Success;
 
   while (1) {
-    Decl dcl;
-    dcl.ti.type = type_tk;
-    Status res = pratt_loop_identifier(tks, length, offset, &dcl.ti);
+    typename Builder::DeclRef dcl = b->begin_decl(type_at, type_tk);
+    Status res = pratt_loop_identifier(tks, offset, b, &dcl);
     if (res != Status::Success) {
       return res;
     }
 
-    Token peek_token = tks[*offset];
-    switch (peek_token.kind) {
+    switch (tks.kind(*offset)) {
     case TokenKind::COMMA: {
-      dcl.init.tag = InitValue::DeclKind::Nothing;
-      dcl.init.nothing = nullptr;
-      ret->emplace_back(dcl);
-      accept_token(tks, length, offset, TokenKind::COMMA);
+      b->init_nothing(&dcl);
+      b->end_decl(ret, &dcl);
+      accept_token(tks, offset, TokenKind::COMMA);
     }
       continue;
     case TokenKind::SEMICOLON: {
-      dcl.init.tag = InitValue::DeclKind::Nothing;
-      dcl.init.nothing = nullptr;
-      ret->emplace_back(dcl);
-      accept_token(tks, length, offset, TokenKind::SEMICOLON);
+      b->init_nothing(&dcl);
+      b->end_decl(ret, &dcl);
+      accept_token(tks, offset, TokenKind::SEMICOLON);
     }
       return Status::Success;
     case TokenKind::LCURLY: {
-      dcl.init.tag = InitValue::DeclKind::Body;
-      err = parseCompoundStmt(tks, length, offset, &dcl.init.body);
-      ret->emplace_back(dcl);
+      typename Builder::CmpdRef body;
+      err = parseCompoundStmt(tks, offset, b, &body);
+      if (err != Status::Success) {
+        return err;
+      }
+      b->init_body(&dcl, body);
+      b->end_decl(ret, &dcl);
     }
       return Status::Success;
     case TokenKind::EQ: {
-      accept_token(tks, length, offset, TokenKind::EQ);
-      if (tks[*offset].kind == TokenKind::LCURLY) {
+      accept_token(tks, offset, TokenKind::EQ);
+      if (tks.kind(*offset) == TokenKind::LCURLY) {
         // can be an expression list!
-        dcl.init.tag = InitValue::DeclKind::ExprList;
-        Status err = accept_token(tks, length, offset, TokenKind::LCURLY);
+        Status err = accept_token(tks, offset, TokenKind::LCURLY);
         if (err != Status::Success) {
           return err;
         }
 
-        err = parseExprList(tks, length, offset, TokenKind::RCURLY,
-                            &dcl.init.exprlist);
+        typename Builder::ListRef exprlist;
+        err = parseExprList(tks, offset, b, TokenKind::RCURLY, &exprlist);
+        if (err != Status::Success) {
+          return err;
+        }
 
-        err = accept_token(tks, length, offset, TokenKind::RCURLY);
+        err = accept_token(tks, offset, TokenKind::RCURLY);
         if (err != Status::Success) {
           return err;
         }
-        ret->emplace_back(dcl);
+        b->init_list(&dcl, exprlist);
+        b->end_decl(ret, &dcl);
       } else {
         // just a plain expression!
-        dcl.init.tag = InitValue::DeclKind::Expr;
-        err = parseExpr(tks, length, offset, &dcl.init.expr);
-        ret->emplace_back(dcl);
+        typename Builder::ExprRef expr;
+        err = parseExpr(tks, offset, b, &expr);
+        if (err != Status::Success) {
+          return err;
+        }
+        b->init_expr(&dcl, expr);
+        b->end_decl(ret, &dcl);
       }
-      if (tks[*offset].kind == TokenKind::SEMICOLON) {
-        accept_token(tks, length, offset, TokenKind::SEMICOLON);
+      if (tks.kind(*offset) == TokenKind::SEMICOLON) {
+        accept_token(tks, offset, TokenKind::SEMICOLON);
         return Status::Success;
-      } else if (tks[*offset].kind == TokenKind::COMMA) {
-        accept_token(tks, length, offset, TokenKind::COMMA);
+      } else if (tks.kind(*offset) == TokenKind::COMMA) {
+        accept_token(tks, offset, TokenKind::COMMA);
         continue;
       } else {
         return Status::SyntaxError;
@@ -599,205 +1219,290 @@ Status parse_decl(Token const *tks, uint32_t length, uint32_t *const offset,
   }
 }
 
-Status pratt_loop_identifier(Token const *tks, uint32_t length,
-                             uint32_t *const offset, TypeIdent *ti) {
+template <typename Tokens, typename Builder>
+Status pratt_loop_identifier(Tokens &tks, uint32_t *const offset, Builder *b,
+                             typename Builder::DeclRef *dcl) {
 
+  uint32_t const curr_at = *offset;
   auto curr_token = tks[*offset];
+  ++*offset;
 
   switch (curr_token.kind) {
   case TokenKind::LPAREN: {
-    pratt_loop_identifier(tks, length, offset, ti);
-    if (tks[*offset].kind != TokenKind::RPAREN) {
+    Status ret = pratt_loop_identifier(tks, offset, b, dcl);
+    if (ret != Status::Success) {
+      return ret;
+    }
+    if (tks.kind(*offset) != TokenKind::RPAREN) {
       return Status::TokenNotFound;
     }
     ++*offset;
   } break;
   case TokenKind::MULT: {
-    pratt_loop_identifier(tks, length, offset, ti);
+    Status ret = pratt_loop_identifier(tks, offset, b, dcl);
+    if (ret != Status::Success) {
+      return ret;
+    }
   } break;
   case TokenKind::ID: {
-    ti->ident = curr_token;
+    b->set_ident(dcl, curr_at, curr_token);
   } break;
   default:
     return Status::TokenNotFound;
   }
 
   while (1) {
-    if (*offset >= length) {
+    if (*offset >= tks.size()) {
       goto END_CON;
     }
-    auto peek_token = tks[*offset];
-    switch (peek_token.kind) {
+    switch (tks.kind(*offset)) {
     case TokenKind::LPAREN: {
       ++*offset;
-      std::vector<Para> paralist = {};
-      Status ret = parse_paralist(tks, length, offset, &paralist);
+      typename Builder::ParaList paralist = b->begin_paras();
+      Status ret = parse_paralist(tks, offset, b, &paralist);
       if (ret != Status::Success) {
         return ret;
       }
 
-      if (tks[*offset].kind != TokenKind::RPAREN) {
+      if (tks.kind(*offset) != TokenKind::RPAREN) {
         return Status::TokenNotFound;
       }
       ++*offset;
 
-      ti->modifiers.push_back(
-          TypeModifier{.tag = TypeModifier::TypeModKind::FunctionReturning,
-                       .para_list = std::move(paralist)});
+      b->function_returning(dcl, &paralist);
     }
       continue;
     case TokenKind::LBRACKET: {
       ++*offset;
-      Expr *expr;
-      Status ret = parseExpr(tks, length, offset, &expr);
-      if (ret != Status::Success) {
-        return ret;
+      // the size can be left out when there is an initializer list
+      typename Builder::ExprRef expr = Builder::no_expr;
+      if (tks.kind(*offset) != TokenKind::RBRACKET) {
+        Status ret = parseExpr(tks, offset, b, &expr);
+        if (ret != Status::Success) {
+          return ret;
+        }
       }
 
-      if (tks[*offset].kind != TokenKind::RBRACKET) {
+      if (tks.kind(*offset) != TokenKind::RBRACKET) {
         return Status::TokenNotFound;
       }
       ++*offset;
 
-      ti->modifiers.push_back(TypeModifier{
-          .tag = TypeModifier::TypeModKind::ArrayOf, .array_expr = expr});
+      b->array_of(dcl, expr);
     }
       continue;
     default:
-      return Status::TokenNotFound;
+      // the declarator ends here
+      break;
     }
     break;
   }
 END_CON:
 
   if (curr_token.kind == TokenKind::MULT) {
-    TypeModifier tm = {.tag = TypeModifier::TypeModKind::PointerTo,
-                       .array_expr = nullptr};
-    ti->modifiers.push_back(tm);
+    b->pointer_to(dcl);
   }
 
   return Status::Success;
 }
 
-Status pratt_loop_expr(Token const *tks, uint32_t length,
-                       uint32_t *const offset, uint8_t bp_level, Expr **expr) {
-
-  auto curr_token = tks[*offset];
-  ++*offset;
-  uint8_t right_bp;
-  Status err;
-  Expr *new_left_node;
-
-  switch (curr_token.kind) {
-  case TokenKind::LPAREN: {
-    err = pratt_loop_expr(tks, length, offset, 0, &new_left_node);
-    if (err != Status::Success) {
-      return err;
-    }
-    if (tks[*offset].kind != TokenKind::RPAREN) {
-      return Status::TokenNotFound;
-    }
-    ++*offset;
-  } break;
-  case CASE_PREFIX: {
-    right_bp = unary_prefix_binding_power(curr_token.kind);
-    new_left_node = (Expr *)malloc(sizeof(Expr));
-    new_left_node->tag = Expr::ExprKind::UnaryExpr;
-    new_left_node->unary_node.op_tk = curr_token;
-    err = pratt_loop_expr(tks, length, offset, right_bp,
-                          &new_left_node->unary_node.expr);
-    if (err != Status::Success) {
-      return err;
-    }
-  } break;
-  case TokenKind::ID: {
-    new_left_node = (Expr *)malloc(sizeof(Expr));
-    new_left_node->tag = Expr::ExprKind::PlainExpr;
-    new_left_node->plain_node.the_tk = curr_token;
-  } break;
-  default:
-    return Status::TokenNotFound;
-  }
+template <typename Tokens, typename Builder>
+Status pratt_loop_expr(Tokens &tks, uint32_t *const offset, Builder *b,
+                       typename Builder::ExprRef *expr) {
+  using Frame =
+      PrattFrame<typename Builder::ExprRef, typename Builder::ListBuilder>;
+  auto &frames = b->pratt_frames;
+  size_t const base = frames.size();
+  auto const fail = [&frames, base](Status err) {
+    frames.resize(base);
+    return err;
+  };
 
-  Token curr_op;
+  typename Builder::ExprRef lhs;
 
   while (1) {
-    if (*offset >= length) {
-      if (*offset > length) {
-        return Status::SyntaxError;
+    // An operand, after any number of prefix operators and '('s.
+    while (1) {
+      uint32_t const curr_at = *offset;
+      TokenKind const curr_kind = tks.kind(*offset);
+      OperatorPowers const ops =
+          operator_powers[static_cast<size_t>(curr_kind)];
+      if (ops.operand) {
+        lhs = b->plain(curr_at, tks[curr_at]);
+        ++*offset;
+        break;
       }
-      goto END_CON;
-    }
-    auto peek_token = tks[*offset];
-    switch (peek_token.kind) {
-    case CASE_POSTFIX: {
-      uint8_t left_bp = unary_postfix_binding_power(peek_token.kind);
-      if (left_bp < bp_level) {
-        goto END_CON;
+      if (ops.prefix != 0) {
+        frames.push_back(Frame{.kind = Frame::Kind::Prefix,
+                               .right_bp = ops.prefix,
+                               .op_at = curr_at,
+                               .op = tks[curr_at],
+                               .lhs = Builder::no_expr,
+                               .args = {}});
+      } else if (curr_kind == TokenKind::LPAREN) {
+        frames.push_back(Frame{.kind = Frame::Kind::Group,
+                               .right_bp = 0,
+                               .op_at = curr_at,
+                               .op = tks[curr_at],
+                               .lhs = Builder::no_expr,
+                               .args = {}});
+      } else {
+        return fail(Status::TokenNotFound);
       }
       ++*offset;
-      if (peek_token.kind == TokenKind::LBRACKET) {
-        Expr *temp_node = (Expr *)malloc(sizeof(Expr));
-        temp_node->tag = Expr::ExprKind::BinaryExpr;
-        temp_node->binary_node.op_tk = peek_token;
-        temp_node->binary_node.left_expr = new_left_node;
-        err = pratt_loop_expr(tks, length, offset, 0,
-                              &temp_node->binary_node.right_expr);
-        if (err != Status::Success) {
-          return err;
+    }
+
+    // Operators after the operand: either one binds it tighter than the
+    // operator on top of the stack and is pushed, going back for its right
+    // operand, or the top of the stack is done and is built around it.
+    bool need_operand = false;
+    while (!need_operand) {
+      OperatorPowers ops = {};
+      TokenKind peek_kind = TokenKind::EVC_EOF;
+      if (*offset >= tks.size()) {
+        if (*offset > tks.size()) {
+          return fail(Status::SyntaxError);
         }
-        new_left_node = temp_node;
       } else {
-        assert(peek_token.kind == TokenKind::LPAREN);
-        Expr *temp_node = (Expr *)malloc(sizeof(Expr));
-        temp_node->tag = Expr::ExprKind::CallExpr;
-        temp_node->call_node.left_expr = new_left_node;
-        err = parseExprList(tks, length, offset, TokenKind::RPAREN,
-                            &temp_node->call_node.exprlist);
-        if (err != Status::Success) {
-          return err;
+        peek_kind = tks.kind(*offset);
+        ops = operator_powers[static_cast<size_t>(peek_kind)];
+      }
+      uint8_t const min_bp = frames.size() > base ? frames.back().right_bp : 0;
+      uint32_t const peek_at = *offset;
+
+      if (ops.postfix != 0 && ops.postfix >= min_bp) {
+        ++*offset;
+        if (peek_kind == TokenKind::LBRACKET) {
+          frames.push_back(Frame{.kind = Frame::Kind::Index,
+                                 .right_bp = 0,
+                                 .op_at = peek_at,
+                                 .op = tks[peek_at],
+                                 .lhs = lhs,
+                                 .args = {}});
+          need_operand = true;
+          continue;
         }
-        new_left_node = temp_node;
+        assert(peek_kind == TokenKind::LPAREN);
+        typename Builder::ListBuilder args = b->begin_list();
+        if (tks.kind(*offset) == TokenKind::RPAREN) {
+          ++*offset;
+          lhs = b->call(peek_at, tks[peek_at], lhs, b->end_list(&args));
+          continue;
+        }
+        frames.push_back(Frame{.kind = Frame::Kind::Call,
+                               .right_bp = 0,
+                               .op_at = peek_at,
+                               .op = tks[peek_at],
+                               .lhs = lhs,
+                               .args = args});
+        need_operand = true;
+        continue;
       }
-    }
-      continue;
-    case CASE_INFIX: {
-      uint8_t left_bp = infix_left_binding_power(peek_token.kind);
-      if (left_bp < bp_level) {
-        goto END_CON;
+      if (ops.infix_left != 0 && ops.infix_left >= min_bp) {
+        frames.push_back(Frame{.kind = Frame::Kind::Infix,
+                               .right_bp = ops.infix_right,
+                               .op_at = peek_at,
+                               .op = tks[peek_at],
+                               .lhs = lhs,
+                               .args = {}});
+        ++*offset;
+        need_operand = true;
+        continue;
       }
-      ++*offset;
-      Expr *temp_node = (Expr *)malloc(sizeof(Expr));
-      temp_node->tag = Expr::ExprKind::BinaryExpr;
-      temp_node->binary_node.op_tk = peek_token;
-      temp_node->binary_node.left_expr = new_left_node;
-      uint8_t right_bp = infix_right_binding_power(peek_token.kind);
-      err = pratt_loop_expr(tks, length, offset, right_bp,
-                            &temp_node->binary_node.right_expr);
-      if (err != Status::Success) {
-        return err;
+
+      if (frames.size() == base) {
+        // whatever follows the expression
+        *expr = lhs;
+        return Status::Success;
+      }
+      Frame top = frames.back();
+      frames.pop_back();
+      switch (top.kind) {
+      case Frame::Kind::Prefix:
+        lhs = b->unary(top.op_at, top.op, lhs);
+        break;
+      case Frame::Kind::Infix:
+        lhs = b->binary(top.op_at, top.op, top.lhs, lhs);
+        break;
+      case Frame::Kind::Group:
+        if (peek_kind != TokenKind::RPAREN) {
+          return fail(Status::TokenNotFound);
+        }
+        ++*offset;
+        break;
+      case Frame::Kind::Index:
+        if (peek_kind != TokenKind::RBRACKET) {
+          return fail(Status::TokenNotFound);
+        }
+        ++*offset;
+        lhs = b->binary(top.op_at, top.op, top.lhs, lhs);
+        break;
+      case Frame::Kind::Call:
+        b->list_add(&top.args, lhs);
+        if (peek_kind == TokenKind::COMMA) {
+          // a ',' is always followed by another argument
+          ++*offset;
+          frames.push_back(top);
+          need_operand = true;
+          break;
+        }
+        if (peek_kind != TokenKind::RPAREN) {
+          return fail(Status::TokenNotFound);
+        }
+        ++*offset;
+        lhs = b->call(top.op_at, top.op, top.lhs, b->end_list(&top.args));
+        break;
       }
-      new_left_node = temp_node;
-    }
-      continue;
-    default:
-      return Status::TokenNotFound;
     }
-    break;
   }
-END_CON:
-  *expr = new_left_node;
-  return Status::Success;
 }
 
-Status parseExpr(Token const *tks, uint32_t length, uint32_t *const offset,
-                 Expr **expr) {
-  Status err = pratt_loop_expr(tks, length, offset, 0, expr);
+template <typename Tokens, typename Builder>
+Status parseExpr(Tokens &tks, uint32_t *const offset, Builder *b,
+                 typename Builder::ExprRef *expr) {
+  Status err = pratt_loop_expr(tks, offset, b, expr);
   if (err != Status::Success) {
     return err;
   }
   return Status::Success;
 };
 
-Status parse_paralist(Token const *tks, uint32_t length, uint32_t *const offset,
-                      std::vector<Para> *pl) {}
+// Parameters up to the closing ')': a type, then any number of '*' and the
+// parameter's name, separated by commas.
+template <typename Tokens, typename Builder>
+Status parse_paralist(Tokens &tks, uint32_t *const offset, Builder *b,
+                      typename Builder::ParaList *pl) {
+  while (tks.kind(*offset) != TokenKind::RPAREN) {
+    uint32_t const type_at = *offset;
+    Token type_tk;
+    Status err = munch_type(tks, offset, &type_tk);
+    if (err != Status::Success) {
+      return err;
+    }
+
+    uint8_t indirection_counter = 0;
+    while (tks.kind(*offset) == TokenKind::MULT) {
+      ++indirection_counter;
+      ++*offset;
+    }
+
+    uint32_t const id_at = *offset;
+    Token id_tk;
+    err = munch_token(tks, offset, TokenKind::ID, &id_tk);
+    if (err != Status::Success) {
+      return err;
+    }
+    b->para_add(pl, indirection_counter, type_at, type_tk, id_at, id_tk);
+
+    if (tks.kind(*offset) != TokenKind::RPAREN) {
+      err = accept_token(tks, offset, TokenKind::COMMA);
+      if (err != Status::Success) {
+        return err;
+      }
+      if (tks.kind(*offset) == TokenKind::RPAREN) {
+        return Status::SyntaxError;
+      }
+    }
+  }
+  return Status::Success;
+}
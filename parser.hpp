@@ -1,10 +1,15 @@
 #pragma once
 
+#include "arena.hpp"
 #include "token.hpp"
+#include "token_pipe.hpp"
+#include "token_stream.hpp"
 
 #include <cstdint>
+#include <type_traits>
 #include <vector>
 
+class SymbolInterner;
 struct Decl;
 
 struct Para {
@@ -30,13 +35,13 @@ struct CmpdNode {
   };
   kind tag;
   union {
-    std::vector<Decl> decl;
+    ArenaSpan<Decl> decl;
     Stmt *stmt;
   };
 };
 
 struct CmpdStmt {
-  std::vector<CmpdNode> nodes;
+  ArenaSpan<CmpdNode> nodes;
 };
 
 struct ForStmt {
@@ -84,8 +89,17 @@ struct Stmt {
   };
 };
 
+// Every node the decls point to, directly or not, is allocated from `arena`
+// and lives exactly as long as the AST does. Nodes are plain data: they are
+// never destroyed one by one, and copying one copies the links, not what
+// they link to.
 struct AST {
+  static constexpr uint32_t no_error = UINT32_MAX;
+
   std::vector<Decl> decls;
+  Arena arena;
+  // index of the token the parser gave up at, or no_error
+  uint32_t error_token = no_error;
 };
 
 enum class PrimitiveType {
@@ -104,9 +118,7 @@ struct TypeModifier {
   };
   TypeModKind tag;
   union {
-
-    std::vector<Para> para_list;
-
+    ArenaSpan<Para> para_list;
     Expr *array_expr;
   };
 };
@@ -114,7 +126,7 @@ struct TypeModifier {
 struct TypeIdent {
   Token ident;
   Token type;
-  std::vector<TypeModifier> modifiers;
+  ArenaSpan<TypeModifier> modifiers;
 };
 
 struct UnaryExprNode {
@@ -129,7 +141,7 @@ struct BinaryExprNode {
 };
 
 struct ExprList {
-  std::vector<Expr *> expr_list;
+  ArenaSpan<Expr *> expr_list;
 };
 
 struct CallExprNode {
@@ -178,4 +190,33 @@ struct Decl {
   InitValue init;
 };
 
+static_assert(std::is_trivially_copyable_v<Decl> &&
+              std::is_trivially_destructible_v<Decl>);
+static_assert(std::is_trivially_copyable_v<CmpdNode> &&
+              std::is_trivially_destructible_v<CmpdNode>);
+static_assert(std::is_trivially_copyable_v<Stmt> &&
+              std::is_trivially_destructible_v<Stmt>);
+static_assert(std::is_trivially_copyable_v<Expr> &&
+              std::is_trivially_destructible_v<Expr>);
+
+AST do_parse(TokenStream const &tks);
 AST do_parse(Token const *tks, uint32_t length);
+
+// Same AST as do_parse, error_token included, with the top-level
+// declarations parsed by up to `threads` threads at once (0: one per
+// hardware thread). Runs of declarations of at least min_chunk tokens each
+// go into an arena of their own, which the AST's arena then takes over.
+// Inputs too small to split are parsed on the calling thread.
+AST do_parse_parallel(TokenStream const &tks, uint32_t threads = 0,
+                      uint32_t min_chunk = 16 * 1024);
+
+// Parse tokens as the pipe's scanner produces them.
+AST do_parse(TokenPipe &tks);
+
+// Scan and parse in one go, without ever holding every token of the file:
+// the parser pulls tokens through a TokenPipe, either scanning on this
+// thread as it goes or overlapping with a scanner thread. With `symbols`,
+// every identifier token in the AST carries its symbol ID as payload.
+AST do_scan_and_parse(char const *start, uint32_t length,
+                      PipeMode mode = PipeMode::ProducerThread,
+                      SymbolInterner *symbols = nullptr);
@@ -0,0 +1,532 @@
+#include "reference_scanner.hpp"
+
+#include <string_view>
+
+enum class ReferenceMode {
+  fresh,
+  identifier,
+  dot,
+  integer,
+  fraction,
+  exponentE,
+  exponentSign,
+  exponentDigits,
+  string,
+  escape,
+  slash,
+  lineComment,
+  blockComment,
+  blockCommentStar,
+  blockCommentCr,
+  cr,
+  // '!', '=', '<', '>', '&' and '|', waiting to see if a second character
+  // makes them longer
+  operatorStart,
+};
+
+static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+static bool is_ident_start(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static bool is_ident_char(char c) { return is_ident_start(c) || is_digit(c); }
+
+static bool is_ascii(char c) { return static_cast<unsigned char>(c) < 0x80; }
+
+static TokenKind keyword_or_id(std::string_view ident) {
+  struct Keyword {
+    std::string_view spelling;
+    TokenKind kind;
+  };
+  static constexpr Keyword keywords[] = {
+      {"boolean", TokenKind::BOOLEAN},
+      {"break", TokenKind::BREAK},
+      {"continue", TokenKind::CONTINUE},
+      {"else", TokenKind::ELSE},
+      {"float", TokenKind::FLOAT},
+      {"for", TokenKind::FOR},
+      {"if", TokenKind::IF},
+      {"int", TokenKind::INT},
+      {"return", TokenKind::RETURN},
+      {"void", TokenKind::VOID},
+      {"while", TokenKind::WHILE},
+      {"true", TokenKind::BOOLEANLITERAL},
+      {"false", TokenKind::BOOLEANLITERAL},
+  };
+  for (Keyword const &kw : keywords) {
+    if (kw.spelling == ident) {
+      return kw.kind;
+    }
+  }
+  return TokenKind::ID;
+}
+
+// Bytes taken by the character at p[0], a non-ASCII byte, and whether it is
+// UTF-8: all of it if so, otherwise the longest start of a valid sequence
+// there is (at least one byte). Table 3-7 of the Unicode standard, with a
+// character cut off by the end of the input counting as invalid.
+static uint32_t utf8_length(unsigned char const *p, uint32_t avail,
+                            bool *valid) {
+  unsigned char const b0 = p[0];
+  uint32_t want;
+  unsigned char lo = 0x80;
+  unsigned char hi = 0xBF;
+  if (b0 >= 0xC2 && b0 <= 0xDF) {
+    want = 2;
+  } else if (b0 >= 0xE0 && b0 <= 0xEF) {
+    want = 3;
+    lo = b0 == 0xE0 ? 0xA0 : 0x80;
+    hi = b0 == 0xED ? 0x9F : 0xBF;
+  } else if (b0 >= 0xF0 && b0 <= 0xF4) {
+    want = 4;
+    lo = b0 == 0xF0 ? 0x90 : 0x80;
+    hi = b0 == 0xF4 ? 0x8F : 0xBF;
+  } else {
+    *valid = false;
+    return 1;
+  }
+
+  uint32_t n = 1;
+  while (n < want && n < avail) {
+    unsigned char const b = p[n];
+    if (b < lo || b > hi) {
+      break;
+    }
+    ++n;
+    lo = 0x80;
+    hi = 0xBF;
+  }
+  *valid = n == want;
+  return n;
+}
+
+class ReferenceScanner {
+public:
+  ReferenceScanner(char const *start, uint32_t length)
+      : src(start), length(length) {}
+
+  std::vector<Token> run() {
+    while (offset < length) {
+      step(src[offset]);
+    }
+    finish();
+    return std::move(tokens);
+  }
+
+private:
+  // Look at c, the byte at `offset`, and either take it (and anything after
+  // it that belongs with it) or leave it for the next mode.
+  void step(char c) {
+    switch (mode) {
+    case ReferenceMode::fresh:
+      return step_fresh(c);
+
+    case ReferenceMode::identifier:
+      if (is_ident_char(c)) {
+        return extend(c);
+      }
+      // classified only once something follows it, like the real scanners
+      token.kind = keyword_or_id(std::string_view(
+          src + token.start_offset, token.end_offset - token.start_offset));
+      return flush();
+
+    case ReferenceMode::dot:
+      if (is_digit(c)) {
+        token.kind = TokenKind::FLOATLITERAL;
+        mode = ReferenceMode::fraction;
+        return extend(c);
+      }
+      // a lone '.' ends where the next character starts
+      token.end_pos = pos;
+      return flush();
+
+    case ReferenceMode::integer:
+    case ReferenceMode::fraction:
+      if (is_digit(c)) {
+        return extend(c);
+      }
+      if (c == '.' && mode == ReferenceMode::integer) {
+        token.kind = TokenKind::FLOATLITERAL;
+        mode = ReferenceMode::fraction;
+        return extend(c);
+      }
+      if (c == 'e' || c == 'E') {
+        // the number is out, unless digits follow and make it a float after
+        // all
+        tokens.push_back(token);
+        begin(TokenKind::ID, offset);
+        mode = ReferenceMode::exponentE;
+        return extend(c);
+      }
+      return flush();
+
+    case ReferenceMode::exponentE:
+      if (c == '+' || c == '-') {
+        tokens.push_back(token);
+        begin(TokenKind::PLUS, offset);
+        mode = ReferenceMode::exponentSign;
+        return extend(c);
+      }
+      if (is_digit(c)) {
+        return take_back_exponent(0, c);
+      }
+      return flush();
+
+    case ReferenceMode::exponentSign:
+      if (is_digit(c)) {
+        return take_back_exponent(1, c);
+      }
+      return flush();
+
+    case ReferenceMode::exponentDigits:
+      if (is_digit(c)) {
+        return extend(c);
+      }
+      return flush();
+
+    case ReferenceMode::string:
+      return step_string(c);
+
+    case ReferenceMode::escape:
+      mode = ReferenceMode::string;
+      if (!is_ascii(c)) {
+        // the string takes all of the character as usual
+        token.kind = TokenKind::ERROR_STRINGLIT_WITH_ILLEGAL_ESCAPE_CHAR;
+        return;
+      }
+      switch (c) {
+      case 'n':
+      case 'b':
+      case 'f':
+      case 'r':
+      case 't':
+      case '\'':
+      case '"':
+      case '\\':
+        break;
+      default:
+        token.kind = TokenKind::ERROR_STRINGLIT_WITH_ILLEGAL_ESCAPE_CHAR;
+        break;
+      }
+      return extend(c);
+
+    case ReferenceMode::slash:
+      if (c == '/') {
+        mode = ReferenceMode::lineComment;
+        return skip(c);
+      }
+      if (c == '*') {
+        mode = ReferenceMode::blockComment;
+        return skip(c);
+      }
+      return flush();
+
+    case ReferenceMode::lineComment:
+      if (c == '\n') {
+        mode = ReferenceMode::fresh;
+      } else if (c == '\r') {
+        mode = ReferenceMode::cr;
+      } else if (!is_ascii(c)) {
+        return skip_character();
+      }
+      return skip(c);
+
+    case ReferenceMode::blockComment:
+      if (c == '*') {
+        mode = ReferenceMode::blockCommentStar;
+      } else if (c == '\r') {
+        mode = ReferenceMode::blockCommentCr;
+      } else if (!is_ascii(c)) {
+        return skip_character();
+      }
+      return skip(c);
+
+    case ReferenceMode::blockCommentStar:
+      if (c == '/') {
+        mode = ReferenceMode::fresh;
+        return skip(c);
+      }
+      if (c == '*') {
+        return skip(c);
+      }
+      if (c == '\r') {
+        mode = ReferenceMode::blockCommentCr;
+        return skip(c);
+      }
+      mode = ReferenceMode::blockComment;
+      return;
+
+    case ReferenceMode::blockCommentCr:
+    case ReferenceMode::cr:
+      // "\r\n" is one line break, and the '\r' already made it
+      if (c == '\n') {
+        ++offset;
+      }
+      mode = mode == ReferenceMode::cr ? ReferenceMode::fresh
+                                       : ReferenceMode::blockComment;
+      return;
+
+    case ReferenceMode::operatorStart: {
+      char const first = src[token.start_offset];
+      if (first == '&' && c == '&') {
+        token.kind = TokenKind::ANDAND;
+      } else if (first == '|' && c == '|') {
+        token.kind = TokenKind::OROR;
+      } else if (first == '!' && c == '=') {
+        token.kind = TokenKind::NOTEQ;
+      } else if (first == '=' && c == '=') {
+        token.kind = TokenKind::EQEQ;
+      } else if (first == '<' && c == '=') {
+        token.kind = TokenKind::LTEQ;
+      } else if (first == '>' && c == '=') {
+        token.kind = TokenKind::GTEQ;
+      } else {
+        return flush();
+      }
+      extend(c);
+      tokens.push_back(token);
+      mode = ReferenceMode::fresh;
+      return;
+    }
+    }
+  }
+
+  void step_fresh(char c) {
+    if (!is_ascii(c)) {
+      // not part of any token, but an error if it is not UTF-8
+      return skip_character();
+    }
+    if (is_digit(c)) {
+      begin(TokenKind::INTLITERAL, offset);
+      mode = ReferenceMode::integer;
+      return extend(c);
+    }
+    if (is_ident_start(c)) {
+      begin(TokenKind::ID, offset);
+      mode = ReferenceMode::identifier;
+      return extend(c);
+    }
+
+    switch (c) {
+    case '\r':
+      mode = ReferenceMode::cr;
+      return skip(c);
+    case '"':
+      // the quotes are not part of the token
+      begin(TokenKind::STRINGLITERAL, offset + 1);
+      token.end_offset = offset + 1;
+      mode = ReferenceMode::string;
+      return skip(c);
+    case '.':
+      begin(TokenKind::ERROR, offset);
+      mode = ReferenceMode::dot;
+      return extend(c);
+    case '/':
+      begin(TokenKind::DIV, offset);
+      mode = ReferenceMode::slash;
+      return extend(c);
+    case '!':
+    case '=':
+    case '<':
+    case '>':
+    case '&':
+    case '|':
+      begin(c == '!'   ? TokenKind::NOT
+            : c == '=' ? TokenKind::EQ
+            : c == '<' ? TokenKind::LT
+            : c == '>' ? TokenKind::GT
+            : c == '&' ? TokenKind::AMPERSAND
+                       : TokenKind::ERROR,
+            offset);
+      mode = ReferenceMode::operatorStart;
+      return extend(c);
+    }
+
+    TokenKind kind;
+    switch (c) {
+    case '(':
+      kind = TokenKind::LPAREN;
+      break;
+    case ')':
+      kind = TokenKind::RPAREN;
+      break;
+    case '{':
+      kind = TokenKind::LCURLY;
+      break;
+    case '}':
+      kind = TokenKind::RCURLY;
+      break;
+    case '[':
+      kind = TokenKind::LBRACKET;
+      break;
+    case ']':
+      kind = TokenKind::RBRACKET;
+      break;
+    case ';':
+      kind = TokenKind::SEMICOLON;
+      break;
+    case ',':
+      kind = TokenKind::COMMA;
+      break;
+    case '+':
+      kind = TokenKind::PLUS;
+      break;
+    case '-':
+      kind = TokenKind::MINUS;
+      break;
+    case '*':
+      kind = TokenKind::MULT;
+      break;
+    default:
+      // blanks, and bytes that mean nothing outside strings and comments
+      return skip(c);
+    }
+    begin(kind, offset);
+    extend(c);
+    tokens.push_back(token);
+  }
+
+  void step_string(char c) {
+    if (!is_ascii(c)) {
+      SourcePosition const char_pos = pos;
+      bool valid;
+      uint32_t const n = utf8_length(
+          reinterpret_cast<unsigned char const *>(src + offset),
+          length - offset, &valid);
+      if (!valid) {
+        token.kind = TokenKind::ERROR_STRINGLIT_WITH_INVALID_UTF8;
+      }
+      offset += n;
+      ++pos.col_pos;
+      token.end_offset = offset;
+      token.end_pos = char_pos;
+      return;
+    }
+
+    switch (c) {
+    case '"':
+      token.end_pos = pos;
+      tokens.push_back(token);
+      mode = ReferenceMode::fresh;
+      return skip(c);
+    case '\n':
+    case '\r':
+      token.end_pos = pos;
+      token.kind = TokenKind::ERROR_UNTERMINATED_STRING;
+      tokens.push_back(token);
+      mode = c == '\r' ? ReferenceMode::cr : ReferenceMode::fresh;
+      return skip(c);
+    case '\\':
+      mode = ReferenceMode::escape;
+      return extend(c);
+    default:
+      return extend(c);
+    }
+  }
+
+  // The digits after an 'e' (and maybe a sign) make a float of the number
+  // before it: drop what was pushed after it (the 'e', if a sign came too)
+  // and carry on with the number.
+  void take_back_exponent(uint32_t dropped, char c) {
+    tokens.resize(tokens.size() - dropped);
+    token = tokens.back();
+    tokens.pop_back();
+    token.kind = TokenKind::FLOATLITERAL;
+    mode = ReferenceMode::exponentDigits;
+    extend(c);
+  }
+
+  void begin(TokenKind kind, uint32_t at) {
+    token = Token{
+        .kind = kind,
+        .start_offset = at,
+        .end_offset = at,
+        .start_pos = pos,
+        .end_pos = pos,
+    };
+  }
+
+  // c, the byte at offset, is the last one in the token so far.
+  void extend(char c) {
+    token.end_offset = offset + 1;
+    token.end_pos = pos;
+    skip(c);
+  }
+
+  // The token is complete without the byte at `offset`, which has to be
+  // looked at again from the start.
+  void flush() {
+    tokens.push_back(token);
+    mode = ReferenceMode::fresh;
+  }
+
+  void skip(char c) {
+    ++offset;
+    if (c == '\t') {
+      do {
+        ++pos.col_pos;
+      } while (pos.col_pos % 8 != 1);
+    } else if (c == '\n' || c == '\r') {
+      pos.col_pos = 1;
+      ++pos.line_num;
+    } else {
+      ++pos.col_pos;
+    }
+  }
+
+  // A non-ASCII character outside any string: one column, or an error token
+  // of its own if it is not UTF-8.
+  void skip_character() {
+    bool valid;
+    uint32_t const n =
+        utf8_length(reinterpret_cast<unsigned char const *>(src + offset),
+                    length - offset, &valid);
+    if (!valid) {
+      tokens.push_back(Token{
+          .kind = TokenKind::ERROR_INVALID_UTF8,
+          .start_offset = offset,
+          .end_offset = offset + n,
+          .start_pos = pos,
+          .end_pos = pos,
+      });
+    }
+    offset += n;
+    ++pos.col_pos;
+  }
+
+  // What is left over when the input ends is a token as it stands, however
+  // far it got; an open block comment is an error reaching to the end.
+  void finish() {
+    if (mode == ReferenceMode::blockComment) {
+      token.kind = TokenKind::ERROR_UNTERMINATED_COMMENT;
+      token.end_offset = offset;
+      token.end_pos = pos;
+    }
+    if (mode != ReferenceMode::fresh) {
+      tokens.push_back(token);
+    }
+    begin(TokenKind::EVC_EOF, offset);
+    tokens.push_back(token);
+  }
+
+  char const *src;
+  uint32_t length;
+
+  std::vector<Token> tokens;
+  uint32_t offset = 0;
+  SourcePosition pos = SourcePosition{1, 1};
+  ReferenceMode mode = ReferenceMode::fresh;
+  // the token being scanned, or the last one if there is none
+  Token token = Token{
+      .kind = TokenKind::PLACEHOLDER,
+      .start_offset = 0,
+      .end_offset = 0,
+      .start_pos = SourcePosition{1, 1},
+      .end_pos = SourcePosition{1, 1},
+  };
+};
+
+std::vector<Token> reference_scan(char const *start, uint32_t length) {
+  return ReferenceScanner(start, length).run();
+}
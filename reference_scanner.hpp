@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "token.hpp"
+
+// The scanner's rules written out plainly, a byte at a time, for
+// fuzz_scanner to hold the real engines against. It shares no code with
+// them (not the state machine, the SIMD kernels, the UTF-8 decoder or the
+// keyword lookup), so a bug in any of those shows up as a mismatch instead
+// of in the expected tokens as well. Slow on purpose; not for anything else.
+std::vector<Token> reference_scan(char const *start, uint32_t length);
@@ -5,6 +5,12 @@
 #include <string>
 #include <vector>
 
+#include "line_index.hpp"
+#include "scanner_core.hpp"
+#include "scanner_internal.hpp"
+#include "stream_scanner.hpp"
+#include "token_stream.hpp"
+#include "scanner_simd.hpp"
 #include "token.hpp"
 
 template <size_t N, typename T>
@@ -17,21 +23,6 @@ constexpr size_t const_size_of(T const (&arr)[N]) {
 //   return N;
 // }
 
-#define CASE_DIGIT                                                             \
-  '0' : case '1' : case '2' : case '3' : case '4' : case '5' : case '6'        \
-      : case '7' : case '8' : case '9'
-
-#define CASE_LETTER                                                            \
-  'A' : case 'B' : case 'C' : case 'D' : case 'E' : case 'F' : case 'G'        \
-      : case 'H' : case 'I' : case 'J' : case 'K' : case 'L' : case 'M'        \
-      : case 'N' : case 'O' : case 'P' : case 'Q' : case 'R' : case 'S'        \
-      : case 'T' : case 'U' : case 'V' : case 'W' : case 'X' : case 'Y'        \
-      : case 'Z' : case 'a' : case 'b' : case 'c' : case 'd' : case 'e'        \
-      : case 'f' : case 'g' : case 'h' : case 'i' : case 'j' : case 'k'        \
-      : case 'l' : case 'm' : case 'n' : case 'o' : case 'p' : case 'q'        \
-      : case 'r' : case 's' : case 't' : case 'u' : case 'v' : case 'w'        \
-      : case 'x' : case 'y' : case 'z'
-
 struct StringKeyword {
   char const *str;
   TokenKind tk;
@@ -58,61 +49,111 @@ static constexpr size_t size_of_keywords = const_size_of(keywords);
 static_assert(size_of_keywords == 13, "can't count rip\n");
 // static_assert(keywords[0].str[7] == '\0', "last character is null right??");
 
-TokenKind process_identifier(char const *start, uint32_t length,
-                             uint32_t start_offset, uint32_t end_offset) {
-  for (size_t i = 0; i < const_size_of(keywords); ++i) {
-    uint8_t broken = 0;
-    for (uint32_t j = 0; j < (end_offset - start_offset); ++j) {
-      if (start[start_offset + j] != keywords[i].str[j]) {
-        broken = 1;
-        break;
-      }
-      if (keywords[i].str[j] == '\0') {
-        broken = 1;
-        break;
-      }
-    }
+static constexpr uint32_t const_str_len(char const *str) {
+  uint32_t len = 0;
+  while (str[len] != '\0') {
+    ++len;
+  }
+  return len;
+}
+
+// Keywords are told apart by a perfect hash over (length, first character,
+// last character). The multiplier is searched for at compile time; the
+// static_asserts below fail the build if a new keyword ever collides.
 
-    if (broken == 0 && (keywords[i].str[end_offset - start_offset] != '\0')) {
-      broken = 1;
+static constexpr uint32_t keyword_table_size = 32;
+
+static constexpr uint32_t keyword_hash(uint32_t len, char first, char last,
+                                       uint32_t mul) {
+  return (len * mul + static_cast<uint8_t>(first) * 3 +
+          static_cast<uint8_t>(last)) &
+         (keyword_table_size - 1);
+}
+
+static constexpr bool keyword_hash_is_perfect(uint32_t mul) {
+  bool taken[keyword_table_size] = {};
+  for (auto const &kw : keywords) {
+    uint32_t const len = const_str_len(kw.str);
+    uint32_t const h = keyword_hash(len, kw.str[0], kw.str[len - 1], mul);
+    if (taken[h]) {
+      return false;
     }
+    taken[h] = true;
+  }
+  return true;
+}
 
-    if (broken == 0) {
-      return keywords[i].tk;
-    } else {
-      continue;
+static constexpr uint32_t find_keyword_hash_multiplier() {
+  for (uint32_t mul = 1; mul < 256; ++mul) {
+    if (keyword_hash_is_perfect(mul)) {
+      return mul;
     }
   }
-  return TokenKind::ID;
+  return 0;
 }
 
-enum class ScannerMode {
-  midStringLit,
-  foundBackwardsSlashMidStringLit,
-  midDoubleSlashComment,
-  midSlashDotComment,
-  threeQuartersThruSlashDotComment,
-  freshStart,
-  maxMunchingCont,
-  foundOneForwardSlash,
-  foundEquals,
-  foundExclamation,
-  foundLT,
-  foundGT,
-  foundAmp,
-  foundStick,
-  foundDot,
-  foundSlashR,
-  foundSlashRMidSlashDotComment,
-  foundQuotationMark,
-  foundDigit,
-  foundFractionalPartAfterInt,
-  foundEAfterNumber,
-  foundSignAfterEAfterNumber,
-  foundDigitAfterExponentNumber,
-  foundLetter,
+static constexpr uint32_t keyword_hash_mul = find_keyword_hash_multiplier();
+
+static_assert(keyword_hash_mul != 0, "no collision free keyword hash found");
+static_assert(keyword_hash_is_perfect(keyword_hash_mul));
+
+struct KeywordSlot {
+  // index into keywords[], or -1 for an empty slot
+  int8_t keyword;
+  uint8_t len;
+};
+
+struct KeywordTable {
+  KeywordSlot slots[keyword_table_size];
+  uint32_t min_len;
+  uint32_t max_len;
 };
 
+static constexpr KeywordTable build_keyword_table() {
+  KeywordTable t = {};
+  t.min_len = UINT32_MAX;
+  t.max_len = 0;
+  for (auto &slot : t.slots) {
+    slot = KeywordSlot{-1, 0};
+  }
+  for (size_t i = 0; i < size_of_keywords; ++i) {
+    uint32_t const len = const_str_len(keywords[i].str);
+    uint32_t const h = keyword_hash(len, keywords[i].str[0],
+                                    keywords[i].str[len - 1], keyword_hash_mul);
+    t.slots[h] = KeywordSlot{static_cast<int8_t>(i), static_cast<uint8_t>(len)};
+    t.min_len = len < t.min_len ? len : t.min_len;
+    t.max_len = len > t.max_len ? len : t.max_len;
+  }
+  return t;
+}
+
+static constexpr KeywordTable keyword_table = build_keyword_table();
+
+static_assert(keyword_table.max_len == max_keyword_length);
+
+TokenKind process_identifier(char const *start, uint32_t length,
+                             uint32_t start_offset, uint32_t end_offset) {
+  uint32_t const len = end_offset - start_offset;
+  if (len < keyword_table.min_len || len > keyword_table.max_len) {
+    return TokenKind::ID;
+  }
+
+  char const *ident = start + start_offset;
+  KeywordSlot const slot = keyword_table.slots[keyword_hash(
+      len, ident[0], ident[len - 1], keyword_hash_mul)];
+  if (slot.keyword < 0 || slot.len != len) {
+    return TokenKind::ID;
+  }
+
+  StringKeyword const &kw = keywords[slot.keyword];
+  for (uint32_t j = 0; j < len; ++j) {
+    if (ident[j] != kw.str[j]) {
+      return TokenKind::ID;
+    }
+  }
+  return kw.tk;
+}
+
 void move_up_tab(SourcePosition *pos) {
   do {
     ++pos->col_pos;
@@ -127,646 +168,107 @@ void move_up_newline(SourcePosition *pos) {
 
 void move_up_space(SourcePosition *pos) { ++pos->col_pos; }
 
+void scan_chunk_offsets(ScanState *state, char const *chunk, uint32_t base,
+                        uint32_t chunk_length, std::vector<Token> *out) {
+  scan_chunk<OffsetScan>(state, chunk, base, chunk_length, out);
+}
+
 std::vector<Token> do_scan(char const *start, uint32_t length) {
   auto ret = std::vector<Token>{};
+  ret.reserve(estimated_token_count(length));
 
-  // Initialise some state!
-  //
-  uint32_t offset = 0;
-  ScannerMode mode = ScannerMode::freshStart;
-  SourcePosition curr_pos = SourcePosition{1, 1};
-
-  auto curr_token_fragment = Token{
-      .kind = TokenKind::PLACEHOLDER,
-      .start_offset = offset,
-      .end_offset = offset,
-      .start_pos = curr_pos,
-      .end_pos = curr_pos,
-  };
-
-  while (offset < length) {
-
-    char c = start[offset];
-    // std::printf("Offset is %u, mode is %d, last char is %d\n", offset, mode,
-    // c);
-
-    switch (mode) {
-    case ScannerMode::freshStart:
-      switch (c) {
-      case '\t':
-      case ' ':
-      case '\n':
-        break;
-      case '\r':
-        mode = ScannerMode::foundSlashR;
-        break;
-      case '"':
-        restart_token(&curr_token_fragment, TokenKind::STRINGLITERAL,
-                      offset + 1, curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-
-        mode = ScannerMode::foundQuotationMark;
-        break;
-      case CASE_DIGIT:
-        restart_token(&curr_token_fragment, TokenKind::INTLITERAL, offset,
-                      curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-
-        mode = ScannerMode::foundDigit;
-        break;
-      case '_':
-      case CASE_LETTER:
-        restart_token(&curr_token_fragment, TokenKind::ID, offset, curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-
-        mode = ScannerMode::foundLetter;
-        break;
-      case '.':
-        restart_token(&curr_token_fragment, TokenKind::ERROR, offset, curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-
-        mode = ScannerMode::foundDot;
-        break;
-      case '(':
-        restart_token(&curr_token_fragment, TokenKind::LPAREN, offset,
-                      curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        ret.push_back(curr_token_fragment);
-        break;
-      case ')':
-        restart_token(&curr_token_fragment, TokenKind::RPAREN, offset,
-                      curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        ret.push_back(curr_token_fragment);
-        break;
-      case '{':
-        restart_token(&curr_token_fragment, TokenKind::LCURLY, offset,
-                      curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        ret.push_back(curr_token_fragment);
-        break;
-      case '}':
-        restart_token(&curr_token_fragment, TokenKind::RCURLY, offset,
-                      curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        ret.push_back(curr_token_fragment);
-        break;
-      case '[':
-        restart_token(&curr_token_fragment, TokenKind::LBRACKET, offset,
-                      curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        ret.push_back(curr_token_fragment);
-        break;
-      case ']':
-        restart_token(&curr_token_fragment, TokenKind::RBRACKET, offset,
-                      curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        ret.push_back(curr_token_fragment);
-        break;
-      case ';':
-        restart_token(&curr_token_fragment, TokenKind::SEMICOLON, offset,
-                      curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        ret.push_back(curr_token_fragment);
-        break;
-      case ',':
-        restart_token(&curr_token_fragment, TokenKind::COMMA, offset, curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        ret.push_back(curr_token_fragment);
-        break;
-      case '+':
-        restart_token(&curr_token_fragment, TokenKind::PLUS, offset, curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        ret.push_back(curr_token_fragment);
-        break;
-      case '-':
-        restart_token(&curr_token_fragment, TokenKind::MINUS, offset, curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        ret.push_back(curr_token_fragment);
-        break;
-      case '*':
-        restart_token(&curr_token_fragment, TokenKind::MULT, offset, curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        ret.push_back(curr_token_fragment);
-        break;
-
-      case '!':
-        restart_token(&curr_token_fragment, TokenKind::NOT, offset, curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-
-        mode = ScannerMode::foundExclamation;
-        break;
-      case '=':
-        restart_token(&curr_token_fragment, TokenKind::EQ, offset, curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-
-        mode = ScannerMode::foundEquals;
-        break;
-
-      case '<':
-        restart_token(&curr_token_fragment, TokenKind::LT, offset, curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-
-        mode = ScannerMode::foundLT;
-        break;
-
-      case '>':
-        restart_token(&curr_token_fragment, TokenKind::GT, offset, curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-
-        mode = ScannerMode::foundGT;
-        break;
-
-      case '&':
-        restart_token(&curr_token_fragment, TokenKind::AMPERSAND, offset,
-                      curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-
-        mode = ScannerMode::foundAmp;
-        break;
-
-      case '|':
-        restart_token(&curr_token_fragment, TokenKind::ERROR, offset, curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-
-        mode = ScannerMode::foundStick;
-        break;
-      case '/':
-        restart_token(&curr_token_fragment, TokenKind::DIV, offset, curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-
-        mode = ScannerMode::foundOneForwardSlash;
-        // ret.push_back(curr_token_fragment);
-        break;
-      }
-      break;
-    case ScannerMode::foundLetter:
-      switch (c) {
-      case CASE_LETTER:
-      case CASE_DIGIT:
-      case '_':
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        break;
-      default:
-        curr_token_fragment.kind =
-            process_identifier(start, length, curr_token_fragment.start_offset,
-                               curr_token_fragment.end_offset);
-
-        ret.push_back(curr_token_fragment);
-
-        mode = ScannerMode::freshStart;
-        continue;
-      }
-      break;
-    case ScannerMode::foundDot:
-      switch (c) {
-      case CASE_DIGIT:
-        curr_token_fragment.kind = TokenKind::FLOATLITERAL;
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-
-        mode = ScannerMode::foundFractionalPartAfterInt;
-        break;
-      default:
-        curr_token_fragment.end_offset = offset;
-        curr_token_fragment.end_pos = curr_pos;
-        ret.push_back(curr_token_fragment);
-
-        mode = ScannerMode::freshStart;
-        continue;
-      }
-      break;
-    case ScannerMode::foundDigit:
-      switch (c) {
-      case CASE_DIGIT:
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        break;
-      case '.':
-        curr_token_fragment.kind = TokenKind::FLOATLITERAL;
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-
-        mode = ScannerMode::foundFractionalPartAfterInt;
-        break;
-      case 'E':
-      case 'e':
-        ret.push_back(curr_token_fragment);
-
-        restart_token(&curr_token_fragment, TokenKind::ID, offset, curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        mode = ScannerMode::foundEAfterNumber;
-        break;
-      default:
-        ret.push_back(curr_token_fragment);
-
-        mode = ScannerMode::freshStart;
-        continue;
-      }
-      break;
-    case ScannerMode::foundFractionalPartAfterInt:
-      switch (c) {
-      case CASE_DIGIT:
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        break;
-      case 'E':
-      case 'e':
-        ret.push_back(curr_token_fragment);
-
-        restart_token(&curr_token_fragment, TokenKind::ID, offset, curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        mode = ScannerMode::foundEAfterNumber;
-        break;
-      default:
-        ret.push_back(curr_token_fragment);
-        mode = ScannerMode::freshStart;
-        continue;
-      }
-      break;
-    case ScannerMode::foundEAfterNumber:
-      switch (c) {
-      case '+':
-      case '-':
-        ret.push_back(curr_token_fragment);
-        restart_token(&curr_token_fragment, TokenKind::PLUS, offset, curr_pos);
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-
-        mode = ScannerMode::foundSignAfterEAfterNumber;
-        break;
-      case CASE_DIGIT:
-        // note that we have an E as current token, and a number as the last
-        // element of ret
-        curr_token_fragment = ret.back();
-        ret.pop_back();
-
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        curr_token_fragment.kind = TokenKind::FLOATLITERAL;
-
-        mode = ScannerMode::foundDigitAfterExponentNumber;
-        break;
-      default:
-        ret.push_back(curr_token_fragment);
-        mode = ScannerMode::freshStart;
-        continue;
-      }
-      break;
-    case ScannerMode::foundSignAfterEAfterNumber:
-      switch (c) {
-      case CASE_DIGIT:
-        // note that we have an + as current token, and an 'E' and a number as
-        // the last 2 element of ret
-        ret.pop_back();
-        curr_token_fragment = ret.back();
-        ret.pop_back();
-
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        curr_token_fragment.kind = TokenKind::FLOATLITERAL;
-
-        mode = ScannerMode::foundDigitAfterExponentNumber;
-        break;
-      default:
-        ret.push_back(curr_token_fragment);
-        mode = ScannerMode::freshStart;
-        continue;
-      }
-      break;
-    case ScannerMode::foundDigitAfterExponentNumber:
-      switch (c) {
-      case CASE_DIGIT:
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        break;
-      default:
-        ret.push_back(curr_token_fragment);
-
-        mode = ScannerMode::freshStart;
-        continue;
-      }
-      break;
-    case ScannerMode::foundQuotationMark:
-      switch (c) {
-      default:
-        mode = ScannerMode::midStringLit;
-        continue;
-      }
-      break;
-    case ScannerMode::midStringLit:
-      switch (c) {
-      case '"':
-        curr_token_fragment.end_pos = curr_pos;
-        ret.push_back(curr_token_fragment);
-
-        mode = ScannerMode::freshStart;
-        break;
-      case '\n':
-        curr_token_fragment.end_pos = curr_pos;
-        curr_token_fragment.kind = TokenKind::ERROR_UNTERMINATED_STRING;
-        ret.push_back(curr_token_fragment);
-
-        mode = ScannerMode::freshStart;
-        break;
-      case '\r':
-        curr_token_fragment.end_pos = curr_pos;
-        curr_token_fragment.kind = TokenKind::ERROR_UNTERMINATED_STRING;
-        ret.push_back(curr_token_fragment);
-
-        mode = ScannerMode::foundSlashR;
-        break;
-
-      case '\\':
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-
-        mode = ScannerMode::foundBackwardsSlashMidStringLit;
-        break;
-      default:
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        break;
-      }
-      break;
-    case ScannerMode::foundBackwardsSlashMidStringLit:
-      switch (c) {
-      case 'n':
-      case 'b':
-      case 'f':
-      case 'r':
-      case 't':
-      case '\'':
-      case '"':
-      case '\\':
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-
-        mode = ScannerMode::midStringLit;
-        break;
-      default:
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        curr_token_fragment.kind =
-            TokenKind::ERROR_STRINGLIT_WITH_ILLEGAL_ESCAPE_CHAR;
-
-        mode = ScannerMode::midStringLit;
-        break;
-      }
-      break;
-    case ScannerMode::foundOneForwardSlash:
-      switch (c) {
-      case '/':
-        mode = ScannerMode::midDoubleSlashComment;
-        break;
-      case '*':
-        mode = ScannerMode::midSlashDotComment;
-        break;
-      default:
-        ret.push_back(curr_token_fragment);
-        mode = ScannerMode::freshStart;
-        continue;
-      }
-      break;
-    case ScannerMode::midDoubleSlashComment:
-      switch (c) {
-      case '\n':
-        mode = ScannerMode::freshStart;
-        break;
-      case '\r':
-        mode = ScannerMode::foundSlashR;
-        break;
-      default:
-        break;
-      }
-      break;
-    case ScannerMode::midSlashDotComment:
-      switch (c) {
-      case '*':
-        mode = ScannerMode::threeQuartersThruSlashDotComment;
-        break;
-      case '\r':
-        mode = ScannerMode::foundSlashRMidSlashDotComment;
-        break;
-      default:
-        break;
-      }
-      break;
-    case ScannerMode::threeQuartersThruSlashDotComment:
-      switch (c) {
-      case '/':
-        mode = ScannerMode::freshStart;
-        break;
-      case '*':
-        // stay in the same state!
-        break;
-      case '\r':
-        mode = ScannerMode::foundSlashRMidSlashDotComment;
-        break;
-      default:
-        mode = ScannerMode::midSlashDotComment;
-        break;
-      }
-      break;
-    case ScannerMode::foundSlashRMidSlashDotComment:
-      switch (c) {
-      case '\n':
-        ++offset;
-        mode = ScannerMode::midSlashDotComment;
-        continue;
-      default:
-        mode = ScannerMode::midSlashDotComment;
-        continue;
-      }
-      break;
-    case ScannerMode::foundSlashR:
-      switch (c) {
-      case '\n':
-        ++offset;
-        mode = ScannerMode::freshStart;
-        continue;
-      default:
-        mode = ScannerMode::freshStart;
-        continue;
-      }
-      break;
-    case ScannerMode::foundExclamation:
-      switch (c) {
-      case '=':
-        curr_token_fragment.kind = TokenKind::NOTEQ;
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        ret.push_back(curr_token_fragment);
-
-        mode = ScannerMode::freshStart;
-        break;
-      default:
-        // push back what is currently there
-        ret.push_back(curr_token_fragment);
-        mode = ScannerMode::freshStart;
-        continue;
-      }
-      break;
-    case ScannerMode::foundEquals:
-      switch (c) {
-      case '=':
-        curr_token_fragment.kind = TokenKind::EQEQ;
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        ret.push_back(curr_token_fragment);
-
-        mode = ScannerMode::freshStart;
-        break;
-      default:
-        // push back what is currently there
-        ret.push_back(curr_token_fragment);
-        mode = ScannerMode::freshStart;
-        continue;
-      }
-      break;
-
-    case ScannerMode::foundLT:
-      switch (c) {
-      case '=':
-        curr_token_fragment.kind = TokenKind::LTEQ;
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        ret.push_back(curr_token_fragment);
-
-        mode = ScannerMode::freshStart;
-        break;
-      default:
-        // push back what is currently there
-        ret.push_back(curr_token_fragment);
-        mode = ScannerMode::freshStart;
-        continue;
-      }
-      break;
-
-    case ScannerMode::foundGT:
-      switch (c) {
-      case '=':
-        curr_token_fragment.kind = TokenKind::GTEQ;
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        ret.push_back(curr_token_fragment);
-
-        mode = ScannerMode::freshStart;
-        break;
-      default:
-        // push back what is currently there
-        ret.push_back(curr_token_fragment);
-        mode = ScannerMode::freshStart;
-        continue;
-      }
-      break;
-
-    case ScannerMode::foundAmp:
-      switch (c) {
-      case '&':
-        curr_token_fragment.kind = TokenKind::ANDAND;
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        ret.push_back(curr_token_fragment);
-
-        mode = ScannerMode::freshStart;
-        break;
-      default:
-        // push back what is currently there
-        // this is an error token!
-        ret.push_back(curr_token_fragment);
-        mode = ScannerMode::freshStart;
-        continue;
-      }
-      break;
-
-    case ScannerMode::foundStick:
-      switch (c) {
-      case '|':
-        curr_token_fragment.kind = TokenKind::OROR;
-        curr_token_fragment.end_offset = offset + 1;
-        curr_token_fragment.end_pos = curr_pos;
-        ret.push_back(curr_token_fragment);
-
-        mode = ScannerMode::freshStart;
-        break;
-      default:
-        // push back what is currently there
-        // this is an error token!
-        ret.push_back(curr_token_fragment);
-        mode = ScannerMode::freshStart;
-        continue;
-      }
-      break;
-
-    default:
-      assert(!"Unreachable");
-    };
-
-    ++offset;
-
-    switch (c) {
-    case '\t':
-      move_up_tab(&curr_pos);
-      break;
-    case '\n':
-      move_up_newline(&curr_pos);
-      break;
-    case '\r':
-      move_up_newline(&curr_pos);
-      break;
-    default:
-      move_up_space(&curr_pos);
-      break;
-    }
+  scan_source<FullScan>(start, length, &ret);
+
+  // std::printf("finito!\n");
+  return ret;
+}
+
+void do_scan(char const *start, uint32_t length, TokenStream *out) {
+  out->reserve(out->size() + estimated_token_count(length));
+
+  scan_source<FullScan>(start, length, out);
+}
+
+std::vector<Token> do_scan_offsets(char const *start, uint32_t length,
+                                   std::vector<uint32_t> *escaped_crs) {
+  auto ret = std::vector<Token>{};
+  ret.reserve(estimated_token_count(length));
+
+  scan_source<OffsetScan>(start, length, &ret,
+                          ScanSideOutputs{.escaped_crs = escaped_crs});
+
+  return ret;
+}
+
+bool check_scan(char const *start, uint32_t length, Token *first_error) {
+  FirstErrorSink sink;
+  std::vector<uint32_t> escaped_crs;
+  scan_source<CheckScan>(start, length, &sink,
+                         ScanSideOutputs{.escaped_crs = &escaped_crs});
+  if (!sink.stopped()) {
+    return true;
   }
 
+  if (first_error != nullptr) {
+    // the one token anybody will look at the position of
+    *first_error = sink.first_error();
+    resolve_positions(first_error, LineIndex(start, length, escaped_crs));
+  }
+  return false;
+}
+
+// A number followed by 'e' (and maybe a sign) is emitted early and taken
+// back if exponent digits follow, so those tokens can't leave the scanner
+// until the next chunk has decided.
+static uint32_t tokens_open_to_take_back(ScannerMode mode) {
   switch (mode) {
-  case ScannerMode::freshStart:
-    // nop: do nothing since the assumption is we have completed everything
-    break;
-  case ScannerMode::midSlashDotComment:
-    curr_token_fragment.kind = TokenKind::ERROR_UNTERMINATED_COMMENT;
-    curr_token_fragment.end_offset = offset;
-    curr_token_fragment.end_pos = curr_pos;
-    ret.push_back(curr_token_fragment);
-    break;
+  case ScannerMode::foundEAfterNumber:
+    return 1;
+  case ScannerMode::foundSignAfterEAfterNumber:
+    return 2;
   default:
-    ret.push_back(curr_token_fragment);
-    break;
+    return 0;
+  }
+}
+
+void StreamScanner::feed(char const *chunk, uint32_t size,
+                         std::vector<Token> *out) {
+  for (uint32_t i = 0; i < held_count; ++i) {
+    out->push_back(held[i]);
   }
+  held_count = 0;
 
-  // final token
-  restart_token(&curr_token_fragment, TokenKind::EVC_EOF, offset, curr_pos);
-  curr_token_fragment.end_offset = offset;
-  curr_token_fragment.end_pos = curr_pos;
-  ret.push_back(curr_token_fragment);
+  uint32_t const base = state.offset;
+  scan_chunk<FullScan>(&state, chunk, base, size, out);
 
-  // std::printf("finito!\n");
-  return ret;
+  held_count = tokens_open_to_take_back(state.mode);
+  for (uint32_t i = 0; i < held_count; ++i) {
+    held[i] = (*out)[out->size() - held_count + i];
+  }
+  out->resize(out->size() - held_count);
+
+  // keep enough of an unfinished identifier to tell whether it is a keyword
+  if (state.mode == ScannerMode::foundLetter) {
+    Token const &ident = state.curr_token_fragment;
+    uint32_t from = ident.start_offset;
+    if (from >= base) {
+      state.ident_carry_len = 0;
+    } else {
+      from = base;
+    }
+    for (uint32_t o = from; o < ident.end_offset &&
+                            state.ident_carry_len < max_keyword_length;
+         ++o) {
+      state.ident_carry[state.ident_carry_len++] = chunk[o - base];
+    }
+  }
+}
+
+void StreamScanner::finish(std::vector<Token> *out) {
+  for (uint32_t i = 0; i < held_count; ++i) {
+    out->push_back(held[i]);
+  }
+  held_count = 0;
+
+  finish_scan(&state, out);
 }
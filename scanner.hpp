@@ -5,5 +5,56 @@
 #include <vector>
 
 #include "token.hpp"
+#include "token_stream.hpp"
 
-std::vector<Token> do_scan(char const *start, uint32_t length);
\ No newline at end of file
+enum class ScanEngine {
+  // the hand written switch scanner, the reference behaviour
+  Switch,
+  // character class + transition table scanner from scanner_table.cpp
+  Table,
+};
+
+#ifdef EVC_DEFAULT_SCAN_ENGINE_TABLE
+static constexpr ScanEngine default_scan_engine = ScanEngine::Table;
+#else
+static constexpr ScanEngine default_scan_engine = ScanEngine::Switch;
+#endif
+
+std::vector<Token> do_scan(char const *start, uint32_t length);
+std::vector<Token> do_scan_table(char const *start, uint32_t length);
+
+// Same tokens as do_scan, appended to a structure of arrays stream.
+void do_scan(char const *start, uint32_t length, TokenStream *out);
+
+// Same tokens as do_scan, minus all line and column bookkeeping: start_pos
+// and end_pos are left meaningless. The offsets of any '\r' read as a string
+// escape are appended to *escaped_crs; pass them to a LineIndex and use
+// resolve_positions() (line_index.hpp) to get do_scan's positions back for
+// the tokens that need them.
+std::vector<Token> do_scan_offsets(char const *start, uint32_t length,
+                                   std::vector<uint32_t> *escaped_crs);
+
+// Whether start[0, length) lexes without a single error token, scanning no
+// further than the first one and keeping no other tokens. If there is one
+// and first_error is given, it gets that token, positions included.
+bool check_scan(char const *start, uint32_t length,
+                Token *first_error = nullptr);
+
+// Same tokens as do_scan, positions included, lexed by up to `threads`
+// threads at once (0: one per hardware thread) that each take a piece of at
+// least min_chunk bytes. Inputs too small to split are scanned on the
+// calling thread. See scanner_parallel.cpp.
+std::vector<Token> do_scan_parallel(char const *start, uint32_t length,
+                                    uint32_t threads = 0,
+                                    uint32_t min_chunk = 256 * 1024);
+
+inline std::vector<Token> do_scan(char const *start, uint32_t length,
+                                  ScanEngine engine) {
+  switch (engine) {
+  case ScanEngine::Table:
+    return do_scan_table(start, length);
+  case ScanEngine::Switch:
+  default:
+    return do_scan(start, length);
+  }
+}
@@ -0,0 +1,934 @@
+#pragma once
+
+// The switch scanner itself, as a template over where tokens go so that
+// do_scan's callers can have them delivered straight to their own sink (see
+// token_sink.hpp). Internal, like scanner_internal.hpp.
+
+#include <cassert>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "literal_table.hpp"
+#include "scanner_internal.hpp"
+#include "scanner_simd.hpp"
+#include "symbol_interner.hpp"
+#include "token.hpp"
+#include "utf8.hpp"
+
+#define CASE_DIGIT                                                             \
+  '0' : case '1' : case '2' : case '3' : case '4' : case '5' : case '6'        \
+      : case '7' : case '8' : case '9'
+
+#define CASE_LETTER                                                            \
+  'A' : case 'B' : case 'C' : case 'D' : case 'E' : case 'F' : case 'G'        \
+      : case 'H' : case 'I' : case 'J' : case 'K' : case 'L' : case 'M'        \
+      : case 'N' : case 'O' : case 'P' : case 'Q' : case 'R' : case 'S'        \
+      : case 'T' : case 'U' : case 'V' : case 'W' : case 'X' : case 'Y'        \
+      : case 'Z' : case 'a' : case 'b' : case 'c' : case 'd' : case 'e'        \
+      : case 'f' : case 'g' : case 'h' : case 'i' : case 'j' : case 'k'        \
+      : case 'l' : case 'm' : case 'n' : case 'o' : case 'p' : case 'q'        \
+      : case 'r' : case 's' : case 't' : case 'u' : case 'v' : case 'w'        \
+      : case 'x' : case 'y' : case 'z'
+
+// Identifiers that started in an earlier chunk are classified from the bytes
+// kept in state->ident_carry plus the part in this chunk.
+inline TokenKind classify_identifier(ScanState const *state, char const *chunk,
+                                     uint32_t base, uint32_t chunk_length,
+                                     Token const &ident) {
+  if (ident.start_offset >= base) {
+    return process_identifier(chunk, chunk_length, ident.start_offset - base,
+                              ident.end_offset - base);
+  }
+
+  uint32_t const len = ident.end_offset - ident.start_offset;
+  if (len > max_keyword_length) {
+    return TokenKind::ID;
+  }
+
+  char joined[max_keyword_length];
+  uint32_t joined_len = 0;
+  for (uint32_t i = 0; i < state->ident_carry_len; ++i) {
+    joined[joined_len++] = state->ident_carry[i];
+  }
+  for (uint32_t i = 0; joined_len < len; ++i) {
+    joined[joined_len++] = chunk[i];
+  }
+  return process_identifier(joined, joined_len, 0, joined_len);
+}
+
+// Runs the scanner over chunk[0, chunk_length), which holds the input bytes
+// at offsets [base, base + chunk_length). Everything needed to pick up where
+// it stopped is written back to *state; the caller flushes the last token
+// with finish_scan() once there is no more input.
+//
+// Out is std::vector<Token>, TokenStream or a HoldBackSink: tokens go in with
+// push_back, and the exponent handling takes the last one or two back with
+// back() and pop_back(). Policy is a ScanPolicy; decode_literals is up to the
+// Out that scan_source() picks, the rest is done here.
+// Without track_positions no line or column is kept at all: every recorded
+// position is stale, and the offsets of '\r's eaten as string escapes are
+// collected into state->escaped_crs so a LineIndex can work the positions
+// out afterwards (see resolve_positions()).
+// Without emit_errors, Out also has stopped(), and the scan ends as soon as
+// that is true.
+template <typename Policy, typename Out>
+void scan_chunk(ScanState *state, char const *chunk, uint32_t base,
+                uint32_t chunk_length, Out *out) {
+  uint32_t offset = state->offset;
+  ScannerMode mode = state->mode;
+  SourcePosition curr_pos = state->curr_pos;
+  Token curr_token_fragment = state->curr_token_fragment;
+
+  uint32_t const limit = base + chunk_length;
+
+  // The character at `offset` is not ASCII: lex it as one column, or as an
+  // error if it is not UTF-8. One that runs past the chunk is finished off
+  // at the start of the next. Inlined, as anything taking the locals by
+  // reference out of line keeps them from living in registers.
+  auto const scan_non_ascii = [&]() __attribute__((always_inline)) {
+    Utf8Decoder d;
+    Utf8Char what;
+    uint32_t const n =
+        utf8_char(chunk + (offset - base), limit - offset, &d, &what);
+    if (what == Utf8Char::Invalid) {
+      report_invalid_utf8(mode, offset, offset + n, curr_pos,
+                          &curr_token_fragment, out);
+    } else if (what == Utf8Char::Open) {
+      state->utf8 = d;
+      state->utf8_start = offset;
+      state->utf8_pos = curr_pos;
+    }
+    offset += n;
+    if constexpr (Policy::track_positions) {
+      move_up_space(&curr_pos);
+    }
+  };
+
+  if (state->utf8.need > 0 && offset < limit) {
+    offset += utf8_continue(&state->utf8, chunk + (offset - base),
+                            limit - offset);
+    if (state->utf8.need > 0 && offset < limit) {
+      report_invalid_utf8(mode, state->utf8_start, offset, state->utf8_pos,
+                          &curr_token_fragment, out);
+      state->utf8 = Utf8Decoder{};
+    }
+    if (mode == ScannerMode::midStringLit) {
+      curr_token_fragment.end_offset = offset;
+    }
+  }
+
+  while (offset < limit) {
+    if constexpr (!Policy::emit_errors) {
+      if (out->stopped()) {
+        break;
+      }
+    }
+
+    char c = chunk[offset - base];
+    // std::printf("Offset is %u, mode is %d, last char is %d\n", offset, mode,
+    // c);
+
+    switch (mode) {
+    case ScannerMode::freshStart:
+      switch (c) {
+      case ' ': {
+        // a run of blanks only moves the column along
+        uint32_t const stop =
+            base + skip_blanks(chunk, offset - base, chunk_length);
+        if constexpr (Policy::track_positions) {
+          curr_pos.col_pos += stop - offset;
+        }
+        offset = stop;
+      }
+        continue;
+      case '\t':
+      case '\n':
+        break;
+      case '\r':
+        mode = ScannerMode::foundSlashR;
+        break;
+      case '"':
+        restart_token(&curr_token_fragment, TokenKind::STRINGLITERAL,
+                      offset + 1, curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+
+        mode = ScannerMode::foundQuotationMark;
+        break;
+      case CASE_DIGIT:
+        restart_token(&curr_token_fragment, TokenKind::INTLITERAL, offset,
+                      curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+
+        mode = ScannerMode::foundDigit;
+        break;
+      case '_':
+      case CASE_LETTER:
+        restart_token(&curr_token_fragment, TokenKind::ID, offset, curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+
+        mode = ScannerMode::foundLetter;
+        break;
+      case '.':
+        restart_token(&curr_token_fragment, TokenKind::ERROR, offset, curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+
+        mode = ScannerMode::foundDot;
+        break;
+      case '(':
+        restart_token(&curr_token_fragment, TokenKind::LPAREN, offset,
+                      curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        out->push_back(curr_token_fragment);
+        break;
+      case ')':
+        restart_token(&curr_token_fragment, TokenKind::RPAREN, offset,
+                      curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        out->push_back(curr_token_fragment);
+        break;
+      case '{':
+        restart_token(&curr_token_fragment, TokenKind::LCURLY, offset,
+                      curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        out->push_back(curr_token_fragment);
+        break;
+      case '}':
+        restart_token(&curr_token_fragment, TokenKind::RCURLY, offset,
+                      curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        out->push_back(curr_token_fragment);
+        break;
+      case '[':
+        restart_token(&curr_token_fragment, TokenKind::LBRACKET, offset,
+                      curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        out->push_back(curr_token_fragment);
+        break;
+      case ']':
+        restart_token(&curr_token_fragment, TokenKind::RBRACKET, offset,
+                      curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        out->push_back(curr_token_fragment);
+        break;
+      case ';':
+        restart_token(&curr_token_fragment, TokenKind::SEMICOLON, offset,
+                      curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        out->push_back(curr_token_fragment);
+        break;
+      case ',':
+        restart_token(&curr_token_fragment, TokenKind::COMMA, offset, curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        out->push_back(curr_token_fragment);
+        break;
+      case '+':
+        restart_token(&curr_token_fragment, TokenKind::PLUS, offset, curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        out->push_back(curr_token_fragment);
+        break;
+      case '-':
+        restart_token(&curr_token_fragment, TokenKind::MINUS, offset, curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        out->push_back(curr_token_fragment);
+        break;
+      case '*':
+        restart_token(&curr_token_fragment, TokenKind::MULT, offset, curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        out->push_back(curr_token_fragment);
+        break;
+
+      case '!':
+        restart_token(&curr_token_fragment, TokenKind::NOT, offset, curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+
+        mode = ScannerMode::foundExclamation;
+        break;
+      case '=':
+        restart_token(&curr_token_fragment, TokenKind::EQ, offset, curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+
+        mode = ScannerMode::foundEquals;
+        break;
+
+      case '<':
+        restart_token(&curr_token_fragment, TokenKind::LT, offset, curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+
+        mode = ScannerMode::foundLT;
+        break;
+
+      case '>':
+        restart_token(&curr_token_fragment, TokenKind::GT, offset, curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+
+        mode = ScannerMode::foundGT;
+        break;
+
+      case '&':
+        restart_token(&curr_token_fragment, TokenKind::AMPERSAND, offset,
+                      curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+
+        mode = ScannerMode::foundAmp;
+        break;
+
+      case '|':
+        restart_token(&curr_token_fragment, TokenKind::ERROR, offset, curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+
+        mode = ScannerMode::foundStick;
+        break;
+      case '/':
+        restart_token(&curr_token_fragment, TokenKind::DIV, offset, curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+
+        mode = ScannerMode::foundOneForwardSlash;
+        // out->push_back(curr_token_fragment);
+        break;
+      default:
+        if (is_non_ascii(c)) {
+          // not part of any token, but an error if it is not UTF-8
+          scan_non_ascii();
+          continue;
+        }
+        break;
+      }
+      break;
+    case ScannerMode::foundLetter:
+      switch (c) {
+      case CASE_LETTER:
+      case CASE_DIGIT:
+      case '_':
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        break;
+      default:
+        curr_token_fragment.kind = classify_identifier(
+            state, chunk, base, chunk_length, curr_token_fragment);
+
+        out->push_back(curr_token_fragment);
+
+        mode = ScannerMode::freshStart;
+        continue;
+      }
+      break;
+    case ScannerMode::foundDot:
+      switch (c) {
+      case CASE_DIGIT:
+        curr_token_fragment.kind = TokenKind::FLOATLITERAL;
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+
+        mode = ScannerMode::foundFractionalPartAfterInt;
+        break;
+      default:
+        curr_token_fragment.end_offset = offset;
+        curr_token_fragment.end_pos = curr_pos;
+        out->push_back(curr_token_fragment);
+
+        mode = ScannerMode::freshStart;
+        continue;
+      }
+      break;
+    case ScannerMode::foundDigit:
+      switch (c) {
+      case CASE_DIGIT:
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        break;
+      case '.':
+        curr_token_fragment.kind = TokenKind::FLOATLITERAL;
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+
+        mode = ScannerMode::foundFractionalPartAfterInt;
+        break;
+      case 'E':
+      case 'e':
+        out->push_back(curr_token_fragment);
+
+        restart_token(&curr_token_fragment, TokenKind::ID, offset, curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        mode = ScannerMode::foundEAfterNumber;
+        break;
+      default:
+        out->push_back(curr_token_fragment);
+
+        mode = ScannerMode::freshStart;
+        continue;
+      }
+      break;
+    case ScannerMode::foundFractionalPartAfterInt:
+      switch (c) {
+      case CASE_DIGIT:
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        break;
+      case 'E':
+      case 'e':
+        out->push_back(curr_token_fragment);
+
+        restart_token(&curr_token_fragment, TokenKind::ID, offset, curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        mode = ScannerMode::foundEAfterNumber;
+        break;
+      default:
+        out->push_back(curr_token_fragment);
+        mode = ScannerMode::freshStart;
+        continue;
+      }
+      break;
+    case ScannerMode::foundEAfterNumber:
+      switch (c) {
+      case '+':
+      case '-':
+        out->push_back(curr_token_fragment);
+        restart_token(&curr_token_fragment, TokenKind::PLUS, offset, curr_pos);
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+
+        mode = ScannerMode::foundSignAfterEAfterNumber;
+        break;
+      case CASE_DIGIT:
+        // note that we have an E as current token, and a number as the last
+        // element of ret
+        curr_token_fragment = out->back();
+        out->pop_back();
+
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        curr_token_fragment.kind = TokenKind::FLOATLITERAL;
+
+        mode = ScannerMode::foundDigitAfterExponentNumber;
+        break;
+      default:
+        out->push_back(curr_token_fragment);
+        mode = ScannerMode::freshStart;
+        continue;
+      }
+      break;
+    case ScannerMode::foundSignAfterEAfterNumber:
+      switch (c) {
+      case CASE_DIGIT:
+        // note that we have an + as current token, and an 'E' and a number as
+        // the last 2 element of ret
+        out->pop_back();
+        curr_token_fragment = out->back();
+        out->pop_back();
+
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        curr_token_fragment.kind = TokenKind::FLOATLITERAL;
+
+        mode = ScannerMode::foundDigitAfterExponentNumber;
+        break;
+      default:
+        out->push_back(curr_token_fragment);
+        mode = ScannerMode::freshStart;
+        continue;
+      }
+      break;
+    case ScannerMode::foundDigitAfterExponentNumber:
+      switch (c) {
+      case CASE_DIGIT:
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        break;
+      default:
+        out->push_back(curr_token_fragment);
+
+        mode = ScannerMode::freshStart;
+        continue;
+      }
+      break;
+    case ScannerMode::foundQuotationMark:
+      switch (c) {
+      default:
+        mode = ScannerMode::midStringLit;
+        continue;
+      }
+      break;
+    case ScannerMode::midStringLit:
+      switch (c) {
+      case '"':
+        curr_token_fragment.end_pos = curr_pos;
+        out->push_back(curr_token_fragment);
+
+        mode = ScannerMode::freshStart;
+        break;
+      case '\n':
+        curr_token_fragment.end_pos = curr_pos;
+        curr_token_fragment.kind = TokenKind::ERROR_UNTERMINATED_STRING;
+        out->push_back(curr_token_fragment);
+
+        mode = ScannerMode::freshStart;
+        break;
+      case '\r':
+        curr_token_fragment.end_pos = curr_pos;
+        curr_token_fragment.kind = TokenKind::ERROR_UNTERMINATED_STRING;
+        out->push_back(curr_token_fragment);
+
+        mode = ScannerMode::foundSlashR;
+        break;
+
+      case '\\':
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+
+        mode = ScannerMode::foundBackwardsSlashMidStringLit;
+        break;
+      case '\t':
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        break;
+      default: {
+        if (is_non_ascii(c)) {
+          SourcePosition const char_pos = curr_pos;
+          scan_non_ascii();
+          curr_token_fragment.end_offset = offset;
+          curr_token_fragment.end_pos = char_pos;
+          continue;
+        }
+
+        // plain characters up to the next quote, escape or line break all
+        // extend the literal by one column each
+        uint32_t const stop =
+            base + skip_string_body(chunk, offset - base, chunk_length);
+        if constexpr (Policy::track_positions) {
+          curr_pos.col_pos += stop - offset;
+        }
+        offset = stop;
+
+        curr_token_fragment.end_offset = offset;
+        curr_token_fragment.end_pos =
+            SourcePosition{curr_pos.col_pos - 1, curr_pos.line_num};
+      }
+        continue;
+      }
+      break;
+    case ScannerMode::foundBackwardsSlashMidStringLit:
+      switch (c) {
+      case 'n':
+      case 'b':
+      case 'f':
+      case 'r':
+      case 't':
+      case '\'':
+      case '"':
+      case '\\':
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+
+        mode = ScannerMode::midStringLit;
+        break;
+      default:
+        if (is_non_ascii(c)) {
+          // the string goes on with the whole character
+          curr_token_fragment.kind =
+              TokenKind::ERROR_STRINGLIT_WITH_ILLEGAL_ESCAPE_CHAR;
+          mode = ScannerMode::midStringLit;
+          continue;
+        }
+        if constexpr (!Policy::track_positions) {
+          // the only line break that does not follow from the bytes alone:
+          // a '\n' after this '\r' starts yet another line
+          if (c == '\r') {
+            state->escaped_crs->push_back(offset);
+          }
+        }
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        curr_token_fragment.kind =
+            TokenKind::ERROR_STRINGLIT_WITH_ILLEGAL_ESCAPE_CHAR;
+
+        mode = ScannerMode::midStringLit;
+        break;
+      }
+      break;
+    case ScannerMode::foundOneForwardSlash:
+      switch (c) {
+      case '/':
+        mode = ScannerMode::midDoubleSlashComment;
+        break;
+      case '*':
+        mode = ScannerMode::midSlashDotComment;
+        break;
+      default:
+        out->push_back(curr_token_fragment);
+        mode = ScannerMode::freshStart;
+        continue;
+      }
+      break;
+    case ScannerMode::midDoubleSlashComment:
+      switch (c) {
+      case '\n':
+        mode = ScannerMode::freshStart;
+        break;
+      case '\r':
+        mode = ScannerMode::foundSlashR;
+        break;
+      case '\t':
+        break;
+      default: {
+        if (is_non_ascii(c)) {
+          scan_non_ascii();
+          continue;
+        }
+
+        // jump straight to the end of the line (or the next tab)
+        uint32_t const stop =
+            base + skip_line_comment_body(chunk, offset - base, chunk_length);
+        if constexpr (Policy::track_positions) {
+          curr_pos.col_pos += stop - offset;
+        }
+        offset = stop;
+      }
+        continue;
+      }
+      break;
+    case ScannerMode::midSlashDotComment:
+      switch (c) {
+      case '*':
+        mode = ScannerMode::threeQuartersThruSlashDotComment;
+        break;
+      case '\r':
+        mode = ScannerMode::foundSlashRMidSlashDotComment;
+        break;
+      case '\t':
+      case '\n':
+        break;
+      default: {
+        if (is_non_ascii(c)) {
+          scan_non_ascii();
+          continue;
+        }
+
+        // jump to the next possible end of comment (or line break, or tab)
+        uint32_t const stop =
+            base + skip_block_comment_body(chunk, offset - base, chunk_length);
+        if constexpr (Policy::track_positions) {
+          curr_pos.col_pos += stop - offset;
+        }
+        offset = stop;
+      }
+        continue;
+      }
+      break;
+    case ScannerMode::threeQuartersThruSlashDotComment:
+      switch (c) {
+      case '/':
+        mode = ScannerMode::freshStart;
+        break;
+      case '*':
+        // stay in the same state!
+        break;
+      case '\r':
+        mode = ScannerMode::foundSlashRMidSlashDotComment;
+        break;
+      default:
+        // the comment body lexes it, all of a character if it is not ASCII
+        mode = ScannerMode::midSlashDotComment;
+        continue;
+      }
+      break;
+    case ScannerMode::foundSlashRMidSlashDotComment:
+      switch (c) {
+      case '\n':
+        ++offset;
+        mode = ScannerMode::midSlashDotComment;
+        continue;
+      default:
+        mode = ScannerMode::midSlashDotComment;
+        continue;
+      }
+      break;
+    case ScannerMode::foundSlashR:
+      switch (c) {
+      case '\n':
+        ++offset;
+        mode = ScannerMode::freshStart;
+        continue;
+      default:
+        mode = ScannerMode::freshStart;
+        continue;
+      }
+      break;
+    case ScannerMode::foundExclamation:
+      switch (c) {
+      case '=':
+        curr_token_fragment.kind = TokenKind::NOTEQ;
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        out->push_back(curr_token_fragment);
+
+        mode = ScannerMode::freshStart;
+        break;
+      default:
+        // push back what is currently there
+        out->push_back(curr_token_fragment);
+        mode = ScannerMode::freshStart;
+        continue;
+      }
+      break;
+    case ScannerMode::foundEquals:
+      switch (c) {
+      case '=':
+        curr_token_fragment.kind = TokenKind::EQEQ;
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        out->push_back(curr_token_fragment);
+
+        mode = ScannerMode::freshStart;
+        break;
+      default:
+        // push back what is currently there
+        out->push_back(curr_token_fragment);
+        mode = ScannerMode::freshStart;
+        continue;
+      }
+      break;
+
+    case ScannerMode::foundLT:
+      switch (c) {
+      case '=':
+        curr_token_fragment.kind = TokenKind::LTEQ;
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        out->push_back(curr_token_fragment);
+
+        mode = ScannerMode::freshStart;
+        break;
+      default:
+        // push back what is currently there
+        out->push_back(curr_token_fragment);
+        mode = ScannerMode::freshStart;
+        continue;
+      }
+      break;
+
+    case ScannerMode::foundGT:
+      switch (c) {
+      case '=':
+        curr_token_fragment.kind = TokenKind::GTEQ;
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        out->push_back(curr_token_fragment);
+
+        mode = ScannerMode::freshStart;
+        break;
+      default:
+        // push back what is currently there
+        out->push_back(curr_token_fragment);
+        mode = ScannerMode::freshStart;
+        continue;
+      }
+      break;
+
+    case ScannerMode::foundAmp:
+      switch (c) {
+      case '&':
+        curr_token_fragment.kind = TokenKind::ANDAND;
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        out->push_back(curr_token_fragment);
+
+        mode = ScannerMode::freshStart;
+        break;
+      default:
+        // push back what is currently there
+        // this is an error token!
+        out->push_back(curr_token_fragment);
+        mode = ScannerMode::freshStart;
+        continue;
+      }
+      break;
+
+    case ScannerMode::foundStick:
+      switch (c) {
+      case '|':
+        curr_token_fragment.kind = TokenKind::OROR;
+        curr_token_fragment.end_offset = offset + 1;
+        curr_token_fragment.end_pos = curr_pos;
+        out->push_back(curr_token_fragment);
+
+        mode = ScannerMode::freshStart;
+        break;
+      default:
+        // push back what is currently there
+        // this is an error token!
+        out->push_back(curr_token_fragment);
+        mode = ScannerMode::freshStart;
+        continue;
+      }
+      break;
+
+    default:
+      assert(!"Unreachable");
+    };
+
+    ++offset;
+
+    if constexpr (!Policy::track_positions) {
+      continue;
+    }
+
+    switch (c) {
+    case '\t':
+      move_up_tab(&curr_pos);
+      break;
+    case '\n':
+      move_up_newline(&curr_pos);
+      break;
+    case '\r':
+      move_up_newline(&curr_pos);
+      break;
+    default:
+      move_up_space(&curr_pos);
+      break;
+    }
+  }
+
+  state->offset = offset;
+  state->mode = mode;
+  state->curr_pos = curr_pos;
+  state->curr_token_fragment = curr_token_fragment;
+}
+
+// Collects tokens like the vector it wraps, decoding each one once the
+// scanner can no longer take it back for an exponent, i.e. once two more
+// tokens came after it.
+class DecodingSink {
+public:
+  DecodingSink(char const *start, std::vector<Token> *tokens,
+               LiteralTable *table, SymbolInterner *symbols)
+      : start(start), tokens(tokens), table(table), symbols(symbols) {}
+
+  void push_back(Token const &tk) {
+    tokens->push_back(tk);
+    if (decoded + 2 < tokens->size()) {
+      decode((*tokens)[decoded++]);
+    }
+  }
+
+  Token const &back() const { return tokens->back(); }
+  void pop_back() { tokens->pop_back(); }
+
+  // The scan has to be finished.
+  void flush() {
+    for (; decoded < tokens->size(); ++decoded) {
+      decode((*tokens)[decoded]);
+    }
+  }
+
+private:
+  void decode(Token &tk) {
+    if (tk.kind == TokenKind::ID) {
+      if (symbols != nullptr) {
+        tk.payload = symbols->intern(std::string_view(
+            start + tk.start_offset, tk.end_offset - tk.start_offset));
+      }
+    } else {
+      tk.payload = decode_literal(tk, start, table);
+    }
+  }
+
+  char const *start;
+  std::vector<Token> *tokens;
+  LiteralTable *table;
+  SymbolInterner *symbols;
+  size_t decoded = 0;
+};
+
+// For scans that stop at the first error: keeps the first error token, and
+// otherwise only the two tokens the exponent handling may take back.
+class FirstErrorSink {
+public:
+  void push_back(Token const &tk) {
+    if (is_error(tk.kind) && !found) {
+      error = tk;
+      found = true;
+    }
+    if (held == 2) {
+      tokens[0] = tokens[1];
+      held = 1;
+    }
+    tokens[held++] = tk;
+  }
+
+  Token const &back() const { return tokens[held - 1]; }
+  void pop_back() { --held; }
+
+  bool stopped() const { return found; }
+  Token const &first_error() const { return error; }
+
+private:
+  Token tokens[2];
+  uint32_t held = 0;
+  Token error;
+  bool found = false;
+};
+
+// Where a scan_source() puts what it finds besides the tokens, as far as
+// its policy asks for it.
+struct ScanSideOutputs {
+  // without track_positions
+  std::vector<uint32_t> *escaped_crs = nullptr;
+  // with decode_literals; symbols may be left out
+  LiteralTable *literals = nullptr;
+  SymbolInterner *symbols = nullptr;
+};
+
+// Scans all of start[0, length) into *out as Policy says, EOF included,
+// unless the scan stopped at an error. With decode_literals Out has to be
+// std::vector<Token>.
+template <typename Policy, typename Out>
+void scan_source(char const *start, uint32_t length, Out *out,
+                 ScanSideOutputs const &side = {}) {
+  ScanState state = {};
+  state.escaped_crs = side.escaped_crs;
+
+  if constexpr (Policy::decode_literals) {
+    static_assert(Policy::emit_errors,
+                  "a scan that stops at an error has no use for literals");
+    DecodingSink sink(start, out, side.literals, side.symbols);
+    scan_chunk<Policy>(&state, start, 0, length, &sink);
+    finish_scan(&state, &sink);
+    sink.flush();
+  } else {
+    scan_chunk<Policy>(&state, start, 0, length, out);
+    if constexpr (!Policy::emit_errors) {
+      if (out->stopped()) {
+        return;
+      }
+    }
+    finish_scan(&state, out);
+  }
+}
+
+#undef CASE_DIGIT
+#undef CASE_LETTER
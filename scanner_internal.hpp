@@ -0,0 +1,181 @@
+#pragma once
+
+// Pieces of the scanner shared between the scanning engines. Not part of the
+// public interface, see scanner.hpp for that.
+
+#include <cstdint>
+#include <vector>
+
+#include "token.hpp"
+#include "utf8.hpp"
+
+enum class ScannerMode : uint8_t {
+  midStringLit,
+  foundBackwardsSlashMidStringLit,
+  midDoubleSlashComment,
+  midSlashDotComment,
+  threeQuartersThruSlashDotComment,
+  freshStart,
+  maxMunchingCont,
+  foundOneForwardSlash,
+  foundEquals,
+  foundExclamation,
+  foundLT,
+  foundGT,
+  foundAmp,
+  foundStick,
+  foundDot,
+  foundSlashR,
+  foundSlashRMidSlashDotComment,
+  foundQuotationMark,
+  foundDigit,
+  foundFractionalPartAfterInt,
+  foundEAfterNumber,
+  foundSignAfterEAfterNumber,
+  foundDigitAfterExponentNumber,
+  foundLetter,
+};
+
+static constexpr int scanner_mode_count =
+    static_cast<int>(ScannerMode::foundLetter) + 1;
+
+// Longest keyword; any identifier longer than this is an ID.
+static constexpr uint32_t max_keyword_length = 8;
+
+// Source bytes per token, on the low side, for sizing token buffers up front.
+// bench_scanner puts the seed files at about 12, and identifier or float
+// heavy code at about 5.
+static constexpr uint32_t bytes_per_token_estimate = 6;
+
+inline uint32_t estimated_token_count(uint32_t length) {
+  return length / bytes_per_token_estimate + 2;
+}
+
+TokenKind process_identifier(char const *start, uint32_t length,
+                             uint32_t start_offset, uint32_t end_offset);
+
+void move_up_tab(SourcePosition *pos);
+void move_up_newline(SourcePosition *pos);
+void move_up_space(SourcePosition *pos);
+
+// Everything the scanner needs to carry on from where it stopped.
+struct ScanState {
+  ScannerMode mode = ScannerMode::freshStart;
+  uint32_t offset = 0;
+  SourcePosition curr_pos = SourcePosition{1, 1};
+  Token curr_token_fragment = Token{
+      .kind = TokenKind::PLACEHOLDER,
+      .start_offset = 0,
+      .end_offset = 0,
+      .start_pos = SourcePosition{1, 1},
+      .end_pos = SourcePosition{1, 1},
+  };
+
+  // Leading bytes of an identifier that started in an earlier chunk, enough
+  // to tell whether it is a keyword.
+  uint8_t ident_carry_len = 0;
+  char ident_carry[max_keyword_length] = {};
+
+  // A non-ASCII character the last chunk ended in the middle of, if
+  // utf8.need > 0: where it started and how it has to go on.
+  Utf8Decoder utf8 = {};
+  uint32_t utf8_start = 0;
+  SourcePosition utf8_pos = SourcePosition{1, 1};
+
+  // Only used when positions are not tracked, see do_scan_offsets().
+  std::vector<uint32_t> *escaped_crs = nullptr;
+};
+
+// What a scan does besides cutting the input into tokens, fixed at compile
+// time so that every kind of caller gets a scanner loop without the work it
+// has no use for:
+//  - TrackPositions: keep start_pos and end_pos. Without it they are left
+//    meaningless, and '\r's eaten as string escapes are collected in
+//    ScanState::escaped_crs for a LineIndex instead.
+//  - EmitErrors: carry on past error tokens. Without it the scan stops at
+//    the first one, which is all a caller checking the input needs.
+//  - DecodeLiterals: decode literal values into a LiteralTable (and intern
+//    identifiers, if given a SymbolInterner) as the tokens complete.
+template <bool TrackPositions, bool EmitErrors, bool DecodeLiterals>
+struct ScanPolicy {
+  static constexpr bool track_positions = TrackPositions;
+  static constexpr bool emit_errors = EmitErrors;
+  static constexpr bool decode_literals = DecodeLiterals;
+};
+
+// do_scan
+using FullScan = ScanPolicy<true, true, false>;
+// do_scan_offsets and the parallel scanner
+using OffsetScan = ScanPolicy<false, true, false>;
+// do_scan_literals
+using LiteralScan = ScanPolicy<true, true, true>;
+// check_scan
+using CheckScan = ScanPolicy<false, false, false>;
+
+// scan_chunk() from scanner.cpp without position tracking, for scanners that
+// lex pieces of a buffer independently and work positions out afterwards
+// (see scanner_parallel.cpp).
+void scan_chunk_offsets(ScanState *state, char const *chunk, uint32_t base,
+                        uint32_t chunk_length, std::vector<Token> *out);
+
+// Bytes [start, end) in `mode` are not UTF-8. Inside a string literal that
+// makes the literal an error, anywhere else (comments included) they are an
+// error token of their own, one column wide.
+template <typename Out>
+void report_invalid_utf8(ScannerMode mode, uint32_t start, uint32_t end,
+                         SourcePosition pos, Token *curr_token_fragment,
+                         Out *out) {
+  if (mode == ScannerMode::midStringLit ||
+      mode == ScannerMode::foundBackwardsSlashMidStringLit) {
+    curr_token_fragment->kind = TokenKind::ERROR_STRINGLIT_WITH_INVALID_UTF8;
+    return;
+  }
+  out->push_back(Token{
+      .kind = TokenKind::ERROR_INVALID_UTF8,
+      .start_offset = start,
+      .end_offset = end,
+      .start_pos = pos,
+      .end_pos = pos,
+  });
+}
+
+// Flush whatever token is still open once the input runs out, then append
+// the EOF token. Out is std::vector<Token> or anything with the same
+// push_back.
+template <typename Out>
+void finish_scan(ScannerMode mode, uint32_t offset, SourcePosition curr_pos,
+                 Token *curr_token_fragment, Out *ret) {
+  switch (mode) {
+  case ScannerMode::freshStart:
+    // nop: do nothing since the assumption is we have completed everything
+    break;
+  case ScannerMode::midSlashDotComment:
+    curr_token_fragment->kind = TokenKind::ERROR_UNTERMINATED_COMMENT;
+    curr_token_fragment->end_offset = offset;
+    curr_token_fragment->end_pos = curr_pos;
+    ret->push_back(*curr_token_fragment);
+    break;
+  default:
+    ret->push_back(*curr_token_fragment);
+    break;
+  }
+
+  // final token
+  restart_token(curr_token_fragment, TokenKind::EVC_EOF, offset, curr_pos);
+  curr_token_fragment->end_offset = offset;
+  curr_token_fragment->end_pos = curr_pos;
+  ret->push_back(*curr_token_fragment);
+}
+
+// finish_scan() for a scanner that stopped in *state, which may have been in
+// the middle of a character: cut short by the end of the input, that is an
+// error.
+template <typename Out> void finish_scan(ScanState *state, Out *ret) {
+  if (state->utf8.need > 0) {
+    report_invalid_utf8(state->mode, state->utf8_start, state->offset,
+                        state->utf8_pos, &state->curr_token_fragment, ret);
+    state->utf8 = Utf8Decoder{};
+  }
+  finish_scan(state->mode, state->offset, state->curr_pos,
+              &state->curr_token_fragment, ret);
+}
@@ -0,0 +1,294 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "line_index.hpp"
+#include "scanner.hpp"
+#include "scanner_internal.hpp"
+#include "scanner_simd.hpp"
+#include "token.hpp"
+#include "work_pool.hpp"
+
+// The buffer is cut just after line feeds. Whatever came before, the scanner
+// is then in one of three modes: between tokens, inside a block comment, or
+// inside a string whose last line ended in a backslash. Which one only
+// depends on where strings and comments open and close, so a first pass
+// works that out for every piece and every possible start, the pieces'
+// real start modes are chained together, and a second pass lexes every
+// piece from its real mode. Positions are left to a LineIndex at the end.
+//
+// Each pass starts its threads afresh through run_work_stealing, as batch
+// mode and the parallel parser do. That is some tens of microseconds per
+// thread, small next to lexing a piece of min_chunk bytes, so no threads
+// are kept around between calls.
+
+// Just enough of the scanner to follow strings and comments.
+enum class Region : uint8_t {
+  Code,
+  Slash,
+  String,
+  Escape,
+  LineComment,
+  BlockComment,
+  BlockStar,
+};
+
+// The regions a piece can start in, in Chunk::exit_from order.
+static constexpr Region entry_regions[] = {Region::Code, Region::String,
+                                           Region::BlockComment};
+
+static uint32_t entry_index(Region region) {
+  switch (region) {
+  case Region::Code:
+    return 0;
+  case Region::String:
+    return 1;
+  case Region::BlockComment:
+  default:
+    return 2;
+  }
+}
+
+// Region the scanner is in after start[offset, limit), having started that
+// range in `region`.
+static Region region_after(char const *start, uint32_t offset, uint32_t limit,
+                           Region region) {
+  while (offset < limit) {
+    char const c = start[offset];
+    switch (region) {
+    case Region::Code:
+      if (c == '"') {
+        region = Region::String;
+      } else if (c == '/') {
+        region = Region::Slash;
+      }
+      break;
+    case Region::Slash:
+      if (c == '/') {
+        region = Region::LineComment;
+      } else if (c == '*') {
+        region = Region::BlockComment;
+      } else {
+        // a division, the character after it starts something new
+        region = Region::Code;
+        continue;
+      }
+      break;
+    case Region::String:
+      switch (c) {
+      case '"':
+      case '\n':
+      case '\r':
+        region = Region::Code;
+        break;
+      case '\\':
+        region = Region::Escape;
+        break;
+      case '\t':
+        break;
+      default:
+        offset = skip_string_body(start, offset + 1, limit);
+        continue;
+      }
+      break;
+    case Region::Escape:
+      // whatever follows, line breaks included, is part of the string
+      region = Region::String;
+      break;
+    case Region::LineComment:
+      if (c == '\n' || c == '\r') {
+        region = Region::Code;
+      } else {
+        offset = skip_line_comment_body(start, offset + 1, limit);
+        continue;
+      }
+      break;
+    case Region::BlockComment:
+      if (c == '*') {
+        region = Region::BlockStar;
+      } else {
+        offset = skip_block_comment_body(start, offset + 1, limit);
+        continue;
+      }
+      break;
+    case Region::BlockStar:
+      if (c == '/') {
+        region = Region::Code;
+      } else if (c != '*') {
+        region = Region::BlockComment;
+      }
+      break;
+    }
+    ++offset;
+  }
+  return region;
+}
+
+static ScannerMode scanner_mode_for(Region region) {
+  switch (region) {
+  case Region::String:
+    return ScannerMode::midStringLit;
+  case Region::BlockComment:
+    return ScannerMode::midSlashDotComment;
+  case Region::Code:
+  default:
+    return ScannerMode::freshStart;
+  }
+}
+
+// Stands in for the token that was open when a piece started, which is only
+// known once the pieces before it are done.
+static constexpr uint32_t unknown_fragment_offset = UINT32_MAX;
+
+struct Chunk {
+  uint32_t begin = 0;
+  uint32_t end = 0;
+
+  // first pass: the region after this piece for each of entry_regions
+  Region exit_from[3] = {};
+  Region entry = Region::Code;
+
+  // second pass
+  ScanState exit = {};
+  std::vector<Token> tokens;
+  std::vector<uint32_t> escaped_crs;
+};
+
+// Pieces of at least min_chunk bytes, each ending just after a '\n' (or at
+// the end of the buffer).
+static std::vector<Chunk> split_chunks(char const *start, uint32_t length,
+                                       uint32_t threads, uint32_t min_chunk) {
+  uint32_t count = std::max(1u, length / std::max(1u, min_chunk));
+  count = std::min(count, threads);
+
+  std::vector<Chunk> chunks;
+  uint32_t begin = 0;
+  for (uint32_t i = 1; i < count && begin < length; ++i) {
+    uint32_t const target = static_cast<uint32_t>(
+        std::max<uint64_t>(begin, uint64_t{length} * i / count));
+    void const *const lf = std::memchr(start + target, '\n', length - target);
+    if (lf == nullptr) {
+      break;
+    }
+
+    uint32_t const end =
+        static_cast<uint32_t>(static_cast<char const *>(lf) - start) + 1;
+    chunks.push_back(Chunk{.begin = begin,
+                           .end = end,
+                           .exit_from = {},
+                           .entry = Region::Code,
+                           .exit = {},
+                           .tokens = {},
+                           .escaped_crs = {}});
+    begin = end;
+  }
+  if (begin < length || chunks.empty()) {
+    chunks.push_back(Chunk{.begin = begin,
+                           .end = length,
+                           .exit_from = {},
+                           .entry = Region::Code,
+                           .exit = {},
+                           .tokens = {},
+                           .escaped_crs = {}});
+  }
+  return chunks;
+}
+
+std::vector<Token> do_scan_parallel(char const *start, uint32_t length,
+                                    uint32_t threads, uint32_t min_chunk) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  std::vector<Chunk> chunks = split_chunks(start, length, threads, min_chunk);
+  uint32_t const count = static_cast<uint32_t>(chunks.size());
+  if (count == 1) {
+    return do_scan(start, length);
+  }
+
+  // where strings and comments are at every cut
+  run_work_stealing(count - 1, count - 1, [&](uint32_t i) {
+    Chunk *const chunk = &chunks[i];
+    for (Region const region : entry_regions) {
+      chunk->exit_from[entry_index(region)] =
+          region_after(start, chunk->begin, chunk->end, region);
+      if (i == 0) {
+        // the first piece always starts between tokens
+        break;
+      }
+    }
+  });
+  for (uint32_t i = 1; i < count; ++i) {
+    Chunk const &prev = chunks[i - 1];
+    chunks[i].entry = prev.exit_from[entry_index(prev.entry)];
+  }
+
+  run_work_stealing(count, count, [&](uint32_t i) {
+    Chunk *const chunk = &chunks[i];
+    if (chunk->entry == Region::String) {
+      // Carries on a string from an earlier piece, which only happens when
+      // a string continued by a backslash spans the cut. The string's token
+      // starts in that earlier piece and, unlike a comment, has to come out
+      // in this one, so the piece is lexed on one thread below, once the
+      // state it starts from is known.
+      return;
+    }
+
+    ScanState state = {};
+    state.mode = scanner_mode_for(chunk->entry);
+    state.offset = chunk->begin;
+    if (i != 0) {
+      state.curr_token_fragment.start_offset = unknown_fragment_offset;
+    }
+    state.escaped_crs = &chunk->escaped_crs;
+    chunk->tokens.reserve(estimated_token_count(chunk->end - chunk->begin));
+    scan_chunk_offsets(&state, start, 0, chunk->end, &chunk->tokens);
+    chunk->exit = state;
+  });
+
+  // stitch the pieces together in order
+  size_t total = 0;
+  for (auto const &chunk : chunks) {
+    total += chunk.tokens.size();
+  }
+
+  std::vector<Token> ret;
+  ret.reserve(total + 2);
+  std::vector<uint32_t> escaped_crs;
+  ScanState state = {};
+  for (auto &chunk : chunks) {
+    if (chunk.entry == Region::String) {
+      // the serial fallback for pieces starting inside a string
+      state.escaped_crs = &escaped_crs;
+      scan_chunk_offsets(&state, start, 0, chunk.end, &ret);
+      continue;
+    }
+
+    ret.insert(ret.end(), chunk.tokens.begin(), chunk.tokens.end());
+    escaped_crs.insert(escaped_crs.end(), chunk.escaped_crs.begin(),
+                       chunk.escaped_crs.end());
+
+    Token const fragment =
+        chunk.exit.curr_token_fragment.start_offset == unknown_fragment_offset
+            ? state.curr_token_fragment
+            : chunk.exit.curr_token_fragment;
+    state = chunk.exit;
+    state.curr_token_fragment = fragment;
+  }
+  finish_scan(&state, &ret);
+
+  // positions, a slice of the tokens per thread
+  LineIndex const lines(start, length, escaped_crs);
+  uint32_t const token_count = static_cast<uint32_t>(ret.size());
+  run_work_stealing(count, count, [&](uint32_t i) {
+    uint32_t const from =
+        static_cast<uint32_t>(uint64_t{token_count} * i / count);
+    uint32_t const to =
+        static_cast<uint32_t>(uint64_t{token_count} * (i + 1) / count);
+    resolve_positions(ret.data() + from, to - from, lines);
+  });
+
+  return ret;
+}
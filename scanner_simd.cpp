@@ -0,0 +1,188 @@
+#include <atomic>
+#include <cstdint>
+
+#include "scanner_simd.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define EVC_HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define EVC_HAVE_X86_SIMD 0
+#endif
+
+// A stop set is a list of bytes. With Invert the set is flipped, i.e. the
+// kernel stops at every byte *not* in the list (used for runs of blanks).
+// With StopHigh it also takes in every byte that is not ASCII, which costs
+// the vector kernels nothing as movemask reads exactly the high bits.
+
+template <bool Invert, bool StopHigh, char... Cs>
+static inline bool stops_at(char c) {
+  return (((c == Cs) || ...) != Invert) ||
+         (StopHigh && static_cast<unsigned char>(c) >= 0x80);
+}
+
+template <bool Invert, bool StopHigh, char... Cs>
+static uint32_t skip_scalar(char const *start, uint32_t offset,
+                            uint32_t length) {
+  while (offset < length &&
+         !stops_at<Invert, StopHigh, Cs...>(start[offset])) {
+    ++offset;
+  }
+  return offset;
+}
+
+#if EVC_HAVE_X86_SIMD
+
+template <bool Invert, bool StopHigh, char... Cs>
+__attribute__((target("sse2"))) static uint32_t
+skip_sse2(char const *start, uint32_t offset, uint32_t length) {
+  while (length - offset >= 16) {
+    __m128i const v =
+        _mm_loadu_si128(reinterpret_cast<__m128i const *>(start + offset));
+    __m128i hits = StopHigh ? v : _mm_setzero_si128();
+    ((hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, _mm_set1_epi8(Cs)))), ...);
+
+    uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(hits));
+    if (Invert) {
+      mask ^= 0xFFFFu;
+    }
+    if (mask != 0) {
+      return offset + __builtin_ctz(mask);
+    }
+    offset += 16;
+  }
+  return skip_scalar<Invert, StopHigh, Cs...>(start, offset, length);
+}
+
+template <bool Invert, bool StopHigh, char... Cs>
+__attribute__((target("avx2"))) static uint32_t
+skip_avx2(char const *start, uint32_t offset, uint32_t length) {
+  while (length - offset >= 32) {
+    __m256i const v =
+        _mm256_loadu_si256(reinterpret_cast<__m256i const *>(start + offset));
+    __m256i hits = StopHigh ? v : _mm256_setzero_si256();
+    ((hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(Cs)))),
+     ...);
+
+    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hits));
+    if (Invert) {
+      mask = ~mask;
+    }
+    if (mask != 0) {
+      return offset + __builtin_ctz(mask);
+    }
+    offset += 32;
+  }
+  // less than a full vector left: finish off with the 16 byte kernel
+  return skip_sse2<Invert, StopHigh, Cs...>(start, offset, length);
+}
+
+#endif
+
+using SkipFn = uint32_t (*)(char const *, uint32_t, uint32_t);
+
+struct SkipKernels {
+  SkipFn line_comment;
+  SkipFn block_comment;
+  SkipFn string_body;
+  SkipFn blanks;
+  SkipFn line_break;
+};
+
+#define EVC_SKIP_KERNELS(kernel)                                               \
+  SkipKernels {                                                                \
+    kernel<false, true, '\n', '\r', '\t'>,                                     \
+        kernel<false, true, '*', '\n', '\r', '\t'>,                            \
+        kernel<false, true, '"', '\\', '\n', '\r', '\t'>,                      \
+        kernel<true, false, ' '>, kernel<false, false, '\n', '\r'>             \
+  }
+
+static constexpr SkipKernels scalar_kernels = EVC_SKIP_KERNELS(skip_scalar);
+#if EVC_HAVE_X86_SIMD
+static constexpr SkipKernels sse2_kernels = EVC_SKIP_KERNELS(skip_sse2);
+static constexpr SkipKernels avx2_kernels = EVC_SKIP_KERNELS(skip_avx2);
+#endif
+
+#undef EVC_SKIP_KERNELS
+
+// Resolved lazily on first use so that nothing depends on static
+// initialisation order. Threads scanning at once may all resolve it; they
+// agree on the result.
+static std::atomic<SkipKernels const *> current_kernels{nullptr};
+static std::atomic<SimdLevel> current_level{SimdLevel::Scalar};
+
+SimdLevel detect_simd_level() {
+#if EVC_HAVE_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return SimdLevel::AVX2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return SimdLevel::SSE2;
+  }
+#endif
+  return SimdLevel::Scalar;
+}
+
+void set_simd_level(SimdLevel level) {
+  SimdLevel const best = detect_simd_level();
+  if (static_cast<int>(level) > static_cast<int>(best)) {
+    level = best;
+  }
+
+  SkipKernels const *kernels;
+  switch (level) {
+#if EVC_HAVE_X86_SIMD
+  case SimdLevel::AVX2:
+    kernels = &avx2_kernels;
+    break;
+  case SimdLevel::SSE2:
+    kernels = &sse2_kernels;
+    break;
+#endif
+  default:
+    level = SimdLevel::Scalar;
+    kernels = &scalar_kernels;
+    break;
+  }
+  current_level.store(level, std::memory_order_relaxed);
+  current_kernels.store(kernels, std::memory_order_release);
+}
+
+static inline SkipKernels const *kernels() {
+  SkipKernels const *ret = current_kernels.load(std::memory_order_acquire);
+  if (ret == nullptr) {
+    set_simd_level(detect_simd_level());
+    ret = current_kernels.load(std::memory_order_acquire);
+  }
+  return ret;
+}
+
+SimdLevel active_simd_level() {
+  kernels();
+  return current_level.load(std::memory_order_relaxed);
+}
+
+uint32_t skip_line_comment_body(char const *start, uint32_t offset,
+                                uint32_t length) {
+  return kernels()->line_comment(start, offset, length);
+}
+
+uint32_t skip_block_comment_body(char const *start, uint32_t offset,
+                                 uint32_t length) {
+  return kernels()->block_comment(start, offset, length);
+}
+
+uint32_t skip_string_body(char const *start, uint32_t offset,
+                          uint32_t length) {
+  return kernels()->string_body(start, offset, length);
+}
+
+uint32_t skip_blanks(char const *start, uint32_t offset, uint32_t length) {
+  return kernels()->blanks(start, offset, length);
+}
+
+uint32_t skip_to_line_break(char const *start, uint32_t offset,
+                            uint32_t length) {
+  return kernels()->line_break(start, offset, length);
+}
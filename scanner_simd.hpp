@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+
+// Vectorised helpers for the scanner modes where most bytes change nothing
+// but the column: comment bodies, string literal bodies and runs of blanks.
+//
+// Every helper takes the byte at `offset` as the first candidate and returns
+// the first offset in [offset, length) holding a byte the scanner has to look
+// at, or `length` if there is none. Skipped bytes are always plain one-column
+// characters, so the caller only has to add the distance to `col_pos`: the
+// helpers for comment and string bodies stop at every byte that is not ASCII
+// too, leaving multibyte characters to the scanner.
+
+enum class SimdLevel {
+  Scalar,
+  SSE2,
+  AVX2,
+};
+
+// Best level the running CPU supports.
+SimdLevel detect_simd_level();
+
+// Level the skip_* helpers currently dispatch to. Defaults to
+// detect_simd_level(); set_simd_level() clamps requests to what the CPU
+// supports and is meant for tests and benchmarks.
+SimdLevel active_simd_level();
+void set_simd_level(SimdLevel level);
+
+// Stops at '\n', '\r', '\t' and non-ASCII.
+uint32_t skip_line_comment_body(char const *start, uint32_t offset,
+                                uint32_t length);
+
+// Stops at '*', '\n', '\r', '\t' and non-ASCII.
+uint32_t skip_block_comment_body(char const *start, uint32_t offset,
+                                 uint32_t length);
+
+// Stops at '"', '\\', '\n', '\r', '\t' and non-ASCII.
+uint32_t skip_string_body(char const *start, uint32_t offset,
+                          uint32_t length);
+
+// Stops at '\n' and '\r'. For building line tables: unlike the others it
+// skips over tabs too.
+uint32_t skip_to_line_break(char const *start, uint32_t offset,
+                            uint32_t length);
+
+// Stops at anything that is not ' '.
+uint32_t skip_blanks(char const *start, uint32_t offset, uint32_t length);
@@ -0,0 +1,552 @@
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "scanner.hpp"
+#include "scanner_internal.hpp"
+#include "scanner_simd.hpp"
+#include "token.hpp"
+#include "utf8.hpp"
+
+// Table driven version of do_scan. Every byte is mapped to a character class,
+// and (mode, class) picks a Step out of a transition table that is built at
+// compile time. The resulting loop has one indirect branch per byte (the
+// action) instead of the two nested switches of the hand written scanner.
+// Bytes that are not ASCII all share one class, whose action takes in the
+// whole UTF-8 character at once. It must produce exactly the same tokens as
+// do_scan.
+
+enum class CharClass : uint8_t {
+  Other,
+  Tab,
+  Space,
+  LineFeed,
+  CarriageReturn,
+  Quote,
+  Apostrophe,
+  Backslash,
+  Digit,
+  Letter,    // includes '_'
+  LetterE,   // 'e' and 'E', exponent marker
+  LetterEsc, // 'n', 'b', 'f', 'r', 't', legal escapes
+  Dot,
+  Single, // ( ) { } [ ] ; , always a token by itself
+  Sign,   // + -
+  Star,
+  Slash,
+  Bang,
+  Equals,
+  Less,
+  Greater,
+  Amp,
+  Stick,
+  NonAscii, // any byte of 0x80 and up, the start of a UTF-8 character or not
+};
+
+static constexpr int char_class_count =
+    static_cast<int>(CharClass::NonAscii) + 1;
+
+struct SingleCharToken {
+  char c;
+  TokenKind tk;
+};
+
+static constexpr SingleCharToken single_char_tokens[] = {
+    {'(', TokenKind::LPAREN},    {')', TokenKind::RPAREN},
+    {'{', TokenKind::LCURLY},    {'}', TokenKind::RCURLY},
+    {'[', TokenKind::LBRACKET},  {']', TokenKind::RBRACKET},
+    {';', TokenKind::SEMICOLON}, {',', TokenKind::COMMA},
+    {'+', TokenKind::PLUS},      {'-', TokenKind::MINUS},
+    {'*', TokenKind::MULT},      {'/', TokenKind::DIV},
+    {'!', TokenKind::NOT},       {'=', TokenKind::EQ},
+    {'<', TokenKind::LT},        {'>', TokenKind::GT},
+    {'&', TokenKind::AMPERSAND}, {'.', TokenKind::ERROR},
+    {'|', TokenKind::ERROR},
+};
+
+struct CharTables {
+  CharClass cls[256];
+  // kind of the token a character starts in freshStart
+  TokenKind start_kind[256];
+};
+
+static constexpr CharTables build_char_tables() {
+  CharTables t = {};
+  for (int i = 0; i < 256; ++i) {
+    t.cls[i] = CharClass::Other;
+    t.start_kind[i] = TokenKind::PLACEHOLDER;
+  }
+
+  for (char c = '0'; c <= '9'; ++c) {
+    t.cls[static_cast<uint8_t>(c)] = CharClass::Digit;
+    t.start_kind[static_cast<uint8_t>(c)] = TokenKind::INTLITERAL;
+  }
+  for (char c = 'a'; c <= 'z'; ++c) {
+    t.cls[static_cast<uint8_t>(c)] = CharClass::Letter;
+    t.cls[static_cast<uint8_t>(c - 'a' + 'A')] = CharClass::Letter;
+    t.start_kind[static_cast<uint8_t>(c)] = TokenKind::ID;
+    t.start_kind[static_cast<uint8_t>(c - 'a' + 'A')] = TokenKind::ID;
+  }
+  t.cls['_'] = CharClass::Letter;
+  t.start_kind['_'] = TokenKind::ID;
+  t.cls['e'] = CharClass::LetterE;
+  t.cls['E'] = CharClass::LetterE;
+  for (char c : {'n', 'b', 'f', 'r', 't'}) {
+    t.cls[static_cast<uint8_t>(c)] = CharClass::LetterEsc;
+  }
+
+  t.cls['\t'] = CharClass::Tab;
+  t.cls[' '] = CharClass::Space;
+  t.cls['\n'] = CharClass::LineFeed;
+  t.cls['\r'] = CharClass::CarriageReturn;
+  t.cls['"'] = CharClass::Quote;
+  t.cls['\''] = CharClass::Apostrophe;
+  t.cls['\\'] = CharClass::Backslash;
+
+  for (auto const &sct : single_char_tokens) {
+    t.cls[static_cast<uint8_t>(sct.c)] = CharClass::Single;
+    t.start_kind[static_cast<uint8_t>(sct.c)] = sct.tk;
+  }
+  t.cls['+'] = CharClass::Sign;
+  t.cls['-'] = CharClass::Sign;
+  t.cls['*'] = CharClass::Star;
+  t.cls['/'] = CharClass::Slash;
+  t.cls['!'] = CharClass::Bang;
+  t.cls['='] = CharClass::Equals;
+  t.cls['<'] = CharClass::Less;
+  t.cls['>'] = CharClass::Greater;
+  t.cls['&'] = CharClass::Amp;
+  t.cls['|'] = CharClass::Stick;
+  t.cls['.'] = CharClass::Dot;
+  for (int i = 0x80; i < 256; ++i) {
+    t.cls[i] = CharClass::NonAscii;
+  }
+
+  return t;
+}
+
+static constexpr CharTables char_tables = build_char_tables();
+
+static_assert(char_tables.cls['e'] == CharClass::LetterE);
+static_assert(char_tables.start_kind['e'] == TokenKind::ID);
+static_assert(char_tables.start_kind['+'] == TokenKind::PLUS);
+
+enum class Action : uint8_t {
+  Nothing,
+  Start,         // open a token of start_kind[c]
+  StartAndEmit,  // one character token
+  StartString,   // open a string literal just past the quote
+  Extend,        // add c to the open token
+  ExtendFloat,   // add c, and the token is now a float
+  ExtendCompound,// add c, turn the token into its two character form, emit
+  IllegalEscape, // add c, and the string now has a bad escape in it
+  EscapeNonAscii,// the string has a bad escape, the string body takes c
+  Emit,          // emit the open token
+  EmitIdent,     // emit the open token after checking for keywords
+  EmitDot,       // emit a lone '.', ending at the current character
+  CloseString,   // emit the string, closing quote excluded
+  BreakString,   // emit the string as unterminated
+  StartExponent, // emit the number, open an 'e' id in case no digits follow
+  StartSign,     // emit the 'e', open a sign in case no digits follow
+  MergeExponent, // take back the number emitted before the 'e'
+  MergeSign,     // take back the number and 'e' emitted before the sign
+  SkipLineFeed,  // the '\n' of a "\r\n" pair, already counted
+  RunBlanks,
+  RunLineComment,
+  RunBlockComment,
+  RunString,
+  // a whole non-ASCII character: one column, and an error if it is not
+  // UTF-8; in a string literal it also extends the literal
+  Character,
+};
+
+struct Step {
+  ScannerMode next;
+  Action action;
+  // false: look at the same character again in the next mode
+  bool consume;
+};
+
+struct TransitionTable {
+  Step steps[scanner_mode_count][char_class_count];
+
+  constexpr void set(ScannerMode mode, CharClass cls, ScannerMode next,
+                     Action action, bool consume = true) {
+    steps[static_cast<int>(mode)][static_cast<int>(cls)] =
+        Step{next, action, consume};
+  }
+
+  constexpr void set_all(ScannerMode mode, ScannerMode next, Action action,
+                         bool consume = true) {
+    for (int cls = 0; cls < char_class_count; ++cls) {
+      set(mode, static_cast<CharClass>(cls), next, action, consume);
+    }
+  }
+};
+
+// How a mode that is one character short of a two character operator treats
+// the next character: `second` completes it, anything else emits the single
+// character version and is looked at again.
+static constexpr void set_compound(TransitionTable *t, ScannerMode mode,
+                                   CharClass second) {
+  t->set_all(mode, ScannerMode::freshStart, Action::Emit, false);
+  t->set(mode, second, ScannerMode::freshStart, Action::ExtendCompound);
+}
+
+static constexpr TransitionTable build_transition_table() {
+  using M = ScannerMode;
+  using C = CharClass;
+  using A = Action;
+
+  TransitionTable t = {};
+
+  // freshStart: between tokens
+  t.set_all(M::freshStart, M::freshStart, A::Nothing);
+  t.set(M::freshStart, C::Space, M::freshStart, A::RunBlanks, false);
+  t.set(M::freshStart, C::CarriageReturn, M::foundSlashR, A::Nothing);
+  t.set(M::freshStart, C::Quote, M::foundQuotationMark, A::StartString);
+  t.set(M::freshStart, C::Digit, M::foundDigit, A::Start);
+  t.set(M::freshStart, C::Letter, M::foundLetter, A::Start);
+  t.set(M::freshStart, C::LetterE, M::foundLetter, A::Start);
+  t.set(M::freshStart, C::LetterEsc, M::foundLetter, A::Start);
+  t.set(M::freshStart, C::Dot, M::foundDot, A::Start);
+  t.set(M::freshStart, C::Single, M::freshStart, A::StartAndEmit);
+  t.set(M::freshStart, C::Sign, M::freshStart, A::StartAndEmit);
+  t.set(M::freshStart, C::Star, M::freshStart, A::StartAndEmit);
+  t.set(M::freshStart, C::Bang, M::foundExclamation, A::Start);
+  t.set(M::freshStart, C::Equals, M::foundEquals, A::Start);
+  t.set(M::freshStart, C::Less, M::foundLT, A::Start);
+  t.set(M::freshStart, C::Greater, M::foundGT, A::Start);
+  t.set(M::freshStart, C::Amp, M::foundAmp, A::Start);
+  t.set(M::freshStart, C::Stick, M::foundStick, A::Start);
+  t.set(M::freshStart, C::Slash, M::foundOneForwardSlash, A::Start);
+  t.set(M::freshStart, C::NonAscii, M::freshStart, A::Character, false);
+
+  // identifiers and keywords
+  t.set_all(M::foundLetter, M::freshStart, A::EmitIdent, false);
+  for (C cls : {C::Letter, C::LetterE, C::LetterEsc, C::Digit}) {
+    t.set(M::foundLetter, cls, M::foundLetter, A::Extend);
+  }
+
+  // numbers
+  t.set_all(M::foundDot, M::freshStart, A::EmitDot, false);
+  t.set(M::foundDot, C::Digit, M::foundFractionalPartAfterInt,
+        A::ExtendFloat);
+
+  t.set_all(M::foundDigit, M::freshStart, A::Emit, false);
+  t.set(M::foundDigit, C::Digit, M::foundDigit, A::Extend);
+  t.set(M::foundDigit, C::Dot, M::foundFractionalPartAfterInt,
+        A::ExtendFloat);
+  t.set(M::foundDigit, C::LetterE, M::foundEAfterNumber, A::StartExponent);
+
+  t.set_all(M::foundFractionalPartAfterInt, M::freshStart, A::Emit, false);
+  t.set(M::foundFractionalPartAfterInt, C::Digit,
+        M::foundFractionalPartAfterInt, A::Extend);
+  t.set(M::foundFractionalPartAfterInt, C::LetterE, M::foundEAfterNumber,
+        A::StartExponent);
+
+  t.set_all(M::foundEAfterNumber, M::freshStart, A::Emit, false);
+  t.set(M::foundEAfterNumber, C::Sign, M::foundSignAfterEAfterNumber,
+        A::StartSign);
+  t.set(M::foundEAfterNumber, C::Digit, M::foundDigitAfterExponentNumber,
+        A::MergeExponent);
+
+  t.set_all(M::foundSignAfterEAfterNumber, M::freshStart, A::Emit, false);
+  t.set(M::foundSignAfterEAfterNumber, C::Digit,
+        M::foundDigitAfterExponentNumber, A::MergeSign);
+
+  t.set_all(M::foundDigitAfterExponentNumber, M::freshStart, A::Emit, false);
+  t.set(M::foundDigitAfterExponentNumber, C::Digit,
+        M::foundDigitAfterExponentNumber, A::Extend);
+
+  // string literals
+  t.set_all(M::foundQuotationMark, M::midStringLit, A::Nothing, false);
+
+  t.set_all(M::midStringLit, M::midStringLit, A::RunString, false);
+  t.set(M::midStringLit, C::Quote, M::freshStart, A::CloseString);
+  t.set(M::midStringLit, C::LineFeed, M::freshStart, A::BreakString);
+  t.set(M::midStringLit, C::CarriageReturn, M::foundSlashR, A::BreakString);
+  t.set(M::midStringLit, C::Backslash, M::foundBackwardsSlashMidStringLit,
+        A::Extend);
+  t.set(M::midStringLit, C::Tab, M::midStringLit, A::Extend);
+  t.set(M::midStringLit, C::NonAscii, M::midStringLit, A::Character, false);
+
+  t.set_all(M::foundBackwardsSlashMidStringLit, M::midStringLit,
+            A::IllegalEscape);
+  for (C cls : {C::LetterEsc, C::Apostrophe, C::Quote, C::Backslash}) {
+    t.set(M::foundBackwardsSlashMidStringLit, cls, M::midStringLit,
+          A::Extend);
+  }
+  t.set(M::foundBackwardsSlashMidStringLit, C::NonAscii, M::midStringLit,
+        A::EscapeNonAscii, false);
+
+  // comments
+  t.set_all(M::foundOneForwardSlash, M::freshStart, A::Emit, false);
+  t.set(M::foundOneForwardSlash, C::Slash, M::midDoubleSlashComment,
+        A::Nothing);
+  t.set(M::foundOneForwardSlash, C::Star, M::midSlashDotComment, A::Nothing);
+
+  t.set_all(M::midDoubleSlashComment, M::midDoubleSlashComment,
+            A::RunLineComment, false);
+  t.set(M::midDoubleSlashComment, C::LineFeed, M::freshStart, A::Nothing);
+  t.set(M::midDoubleSlashComment, C::CarriageReturn, M::foundSlashR,
+        A::Nothing);
+  t.set(M::midDoubleSlashComment, C::Tab, M::midDoubleSlashComment,
+        A::Nothing);
+  t.set(M::midDoubleSlashComment, C::NonAscii, M::midDoubleSlashComment,
+        A::Character, false);
+
+  t.set_all(M::midSlashDotComment, M::midSlashDotComment, A::RunBlockComment,
+            false);
+  t.set(M::midSlashDotComment, C::Star, M::threeQuartersThruSlashDotComment,
+        A::Nothing);
+  t.set(M::midSlashDotComment, C::CarriageReturn,
+        M::foundSlashRMidSlashDotComment, A::Nothing);
+  t.set(M::midSlashDotComment, C::Tab, M::midSlashDotComment, A::Nothing);
+  t.set(M::midSlashDotComment, C::LineFeed, M::midSlashDotComment,
+        A::Nothing);
+  t.set(M::midSlashDotComment, C::NonAscii, M::midSlashDotComment,
+        A::Character, false);
+
+  t.set_all(M::threeQuartersThruSlashDotComment, M::midSlashDotComment,
+            A::Nothing);
+  t.set(M::threeQuartersThruSlashDotComment, C::Slash, M::freshStart,
+        A::Nothing);
+  t.set(M::threeQuartersThruSlashDotComment, C::Star,
+        M::threeQuartersThruSlashDotComment, A::Nothing);
+  t.set(M::threeQuartersThruSlashDotComment, C::CarriageReturn,
+        M::foundSlashRMidSlashDotComment, A::Nothing);
+  // all of the character goes to the comment body
+  t.set(M::threeQuartersThruSlashDotComment, C::NonAscii,
+        M::midSlashDotComment, A::Nothing, false);
+
+  // line breaks
+  t.set_all(M::foundSlashRMidSlashDotComment, M::midSlashDotComment,
+            A::Nothing, false);
+  t.set(M::foundSlashRMidSlashDotComment, C::LineFeed, M::midSlashDotComment,
+        A::SkipLineFeed, false);
+
+  t.set_all(M::foundSlashR, M::freshStart, A::Nothing, false);
+  t.set(M::foundSlashR, C::LineFeed, M::freshStart, A::SkipLineFeed, false);
+
+  // two character operators
+  set_compound(&t, M::foundExclamation, C::Equals);
+  set_compound(&t, M::foundEquals, C::Equals);
+  set_compound(&t, M::foundLT, C::Equals);
+  set_compound(&t, M::foundGT, C::Equals);
+  set_compound(&t, M::foundAmp, C::Amp);
+  set_compound(&t, M::foundStick, C::Stick);
+
+  // maxMunchingCont is never entered
+  t.set_all(M::maxMunchingCont, M::freshStart, A::Nothing, false);
+
+  return t;
+}
+
+static constexpr TransitionTable transitions = build_transition_table();
+
+// Two character operator each of the found* modes above turns into.
+static constexpr TokenKind compound_kind(ScannerMode mode) {
+  switch (mode) {
+  case ScannerMode::foundExclamation:
+    return TokenKind::NOTEQ;
+  case ScannerMode::foundEquals:
+    return TokenKind::EQEQ;
+  case ScannerMode::foundLT:
+    return TokenKind::LTEQ;
+  case ScannerMode::foundGT:
+    return TokenKind::GTEQ;
+  case ScannerMode::foundAmp:
+    return TokenKind::ANDAND;
+  case ScannerMode::foundStick:
+    return TokenKind::OROR;
+  default:
+    return TokenKind::PLACEHOLDER;
+  }
+}
+
+static_assert(transitions
+                  .steps[static_cast<int>(ScannerMode::foundStick)]
+                        [static_cast<int>(CharClass::Stick)]
+                  .action == Action::ExtendCompound);
+
+std::vector<Token> do_scan_table(char const *start, uint32_t length) {
+  auto ret = std::vector<Token>{};
+  ret.reserve(estimated_token_count(length));
+
+  uint32_t offset = 0;
+  ScannerMode mode = ScannerMode::freshStart;
+  SourcePosition curr_pos = SourcePosition{1, 1};
+
+  auto curr_token_fragment = Token{
+      .kind = TokenKind::PLACEHOLDER,
+      .start_offset = offset,
+      .end_offset = offset,
+      .start_pos = curr_pos,
+      .end_pos = curr_pos,
+  };
+
+  while (offset < length) {
+    uint8_t const c = static_cast<uint8_t>(start[offset]);
+    CharClass const cls = char_tables.cls[c];
+    Step const step =
+        transitions.steps[static_cast<int>(mode)][static_cast<int>(cls)];
+
+    switch (step.action) {
+    case Action::Nothing:
+      break;
+    case Action::Start:
+      restart_token(&curr_token_fragment, char_tables.start_kind[c], offset,
+                    curr_pos);
+      curr_token_fragment.end_offset = offset + 1;
+      break;
+    case Action::StartAndEmit:
+      restart_token(&curr_token_fragment, char_tables.start_kind[c], offset,
+                    curr_pos);
+      curr_token_fragment.end_offset = offset + 1;
+      ret.push_back(curr_token_fragment);
+      break;
+    case Action::StartString:
+      restart_token(&curr_token_fragment, TokenKind::STRINGLITERAL,
+                    offset + 1, curr_pos);
+      curr_token_fragment.end_offset = offset + 1;
+      break;
+    case Action::Extend:
+      curr_token_fragment.end_offset = offset + 1;
+      curr_token_fragment.end_pos = curr_pos;
+      break;
+    case Action::ExtendFloat:
+      curr_token_fragment.kind = TokenKind::FLOATLITERAL;
+      curr_token_fragment.end_offset = offset + 1;
+      curr_token_fragment.end_pos = curr_pos;
+      break;
+    case Action::ExtendCompound:
+      curr_token_fragment.kind = compound_kind(mode);
+      curr_token_fragment.end_offset = offset + 1;
+      curr_token_fragment.end_pos = curr_pos;
+      ret.push_back(curr_token_fragment);
+      break;
+    case Action::IllegalEscape:
+      curr_token_fragment.end_offset = offset + 1;
+      curr_token_fragment.end_pos = curr_pos;
+      curr_token_fragment.kind =
+          TokenKind::ERROR_STRINGLIT_WITH_ILLEGAL_ESCAPE_CHAR;
+      break;
+    case Action::EscapeNonAscii:
+      curr_token_fragment.kind =
+          TokenKind::ERROR_STRINGLIT_WITH_ILLEGAL_ESCAPE_CHAR;
+      break;
+    case Action::Emit:
+      ret.push_back(curr_token_fragment);
+      break;
+    case Action::EmitIdent:
+      curr_token_fragment.kind =
+          process_identifier(start, length, curr_token_fragment.start_offset,
+                             curr_token_fragment.end_offset);
+      ret.push_back(curr_token_fragment);
+      break;
+    case Action::EmitDot:
+      curr_token_fragment.end_offset = offset;
+      curr_token_fragment.end_pos = curr_pos;
+      ret.push_back(curr_token_fragment);
+      break;
+    case Action::CloseString:
+      curr_token_fragment.end_pos = curr_pos;
+      ret.push_back(curr_token_fragment);
+      break;
+    case Action::BreakString:
+      curr_token_fragment.end_pos = curr_pos;
+      curr_token_fragment.kind = TokenKind::ERROR_UNTERMINATED_STRING;
+      ret.push_back(curr_token_fragment);
+      break;
+    case Action::StartExponent:
+      ret.push_back(curr_token_fragment);
+      restart_token(&curr_token_fragment, TokenKind::ID, offset, curr_pos);
+      curr_token_fragment.end_offset = offset + 1;
+      break;
+    case Action::StartSign:
+      ret.push_back(curr_token_fragment);
+      restart_token(&curr_token_fragment, TokenKind::PLUS, offset, curr_pos);
+      curr_token_fragment.end_offset = offset + 1;
+      break;
+    case Action::MergeSign:
+      ret.pop_back();
+      [[fallthrough]];
+    case Action::MergeExponent:
+      curr_token_fragment = ret.back();
+      ret.pop_back();
+      curr_token_fragment.end_offset = offset + 1;
+      curr_token_fragment.end_pos = curr_pos;
+      curr_token_fragment.kind = TokenKind::FLOATLITERAL;
+      break;
+    case Action::SkipLineFeed:
+      ++offset;
+      break;
+    case Action::RunBlanks: {
+      uint32_t const stop = skip_blanks(start, offset, length);
+      curr_pos.col_pos += stop - offset;
+      offset = stop;
+    } break;
+    case Action::RunLineComment: {
+      uint32_t const stop = skip_line_comment_body(start, offset, length);
+      curr_pos.col_pos += stop - offset;
+      offset = stop;
+    } break;
+    case Action::RunBlockComment: {
+      uint32_t const stop = skip_block_comment_body(start, offset, length);
+      curr_pos.col_pos += stop - offset;
+      offset = stop;
+    } break;
+    case Action::RunString: {
+      uint32_t const stop = skip_string_body(start, offset, length);
+      curr_pos.col_pos += stop - offset;
+      offset = stop;
+      curr_token_fragment.end_offset = offset;
+      curr_token_fragment.end_pos =
+          SourcePosition{curr_pos.col_pos - 1, curr_pos.line_num};
+    } break;
+    case Action::Character: {
+      Utf8Decoder d;
+      Utf8Char what;
+      uint32_t const n = utf8_char(start + offset, length - offset, &d, &what);
+      // with all of the input at hand, a character still open has been cut
+      // short by its end
+      if (what != Utf8Char::Valid) {
+        report_invalid_utf8(mode, offset, offset + n, curr_pos,
+                            &curr_token_fragment, &ret);
+      }
+      if (mode == ScannerMode::midStringLit) {
+        curr_token_fragment.end_offset = offset + n;
+        curr_token_fragment.end_pos = curr_pos;
+      }
+      offset += n;
+      move_up_space(&curr_pos);
+    } break;
+    }
+
+    mode = step.next;
+    if (!step.consume) {
+      continue;
+    }
+
+    ++offset;
+
+    switch (cls) {
+    case CharClass::Tab:
+      move_up_tab(&curr_pos);
+      break;
+    case CharClass::LineFeed:
+    case CharClass::CarriageReturn:
+      move_up_newline(&curr_pos);
+      break;
+    default:
+      move_up_space(&curr_pos);
+      break;
+    }
+  }
+
+  finish_scan(mode, offset, curr_pos, &curr_token_fragment, &ret);
+
+  return ret;
+}
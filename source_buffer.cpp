@@ -0,0 +1,120 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "source_buffer.hpp"
+
+SourceBuffer::~SourceBuffer() { release(); }
+
+SourceBuffer::SourceBuffer(SourceBuffer &&other) noexcept
+    : bytes(std::exchange(other.bytes, nullptr)),
+      length(std::exchange(other.length, 0)),
+      mapped(std::exchange(other.mapped, false)) {}
+
+SourceBuffer &SourceBuffer::operator=(SourceBuffer &&other) noexcept {
+  if (this != &other) {
+    release();
+    bytes = std::exchange(other.bytes, nullptr);
+    length = std::exchange(other.length, 0);
+    mapped = std::exchange(other.mapped, false);
+  }
+  return *this;
+}
+
+void SourceBuffer::release() {
+  if (mapped) {
+    munmap(const_cast<char *>(bytes), length);
+  } else {
+    std::free(const_cast<char *>(bytes));
+  }
+  bytes = nullptr;
+  length = 0;
+  mapped = false;
+}
+
+bool SourceBuffer::open(char const *path) {
+  if (std::strcmp(path, "-") == 0) {
+    return load_fd(STDIN_FILENO);
+  }
+
+  int const fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  bool const ok = load_fd(fd);
+  ::close(fd);
+  return ok;
+}
+
+bool SourceBuffer::load_fd(int fd) {
+  release();
+
+  // Files that say they are empty are read() as well: procfs and sysfs
+  // report a size of 0 for files that have contents, and an empty file
+  // gives EOF on the first read anyway.
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size != 0) {
+    if (static_cast<uint64_t>(st.st_size) > UINT32_MAX) {
+      return false;
+    }
+
+    void *const addr =
+        mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+      // the scanner makes a single front to back pass
+      madvise(addr, st.st_size, MADV_SEQUENTIAL);
+      bytes = static_cast<char const *>(addr);
+      length = static_cast<uint32_t>(st.st_size);
+      mapped = true;
+      return true;
+    }
+    // fall through and read() it
+  }
+
+  size_t capacity = 1 << 16;
+  size_t used = 0;
+  char *buf = static_cast<char *>(std::malloc(capacity));
+  if (buf == nullptr) {
+    return false;
+  }
+
+  while (true) {
+    if (used == capacity) {
+      capacity *= 2;
+      char *const bigger = static_cast<char *>(std::realloc(buf, capacity));
+      if (bigger == nullptr) {
+        std::free(buf);
+        return false;
+      }
+      buf = bigger;
+    }
+
+    ssize_t const got = ::read(fd, buf + used, capacity - used);
+    if (got < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::free(buf);
+      return false;
+    }
+    if (got == 0) {
+      break;
+    }
+    used += static_cast<size_t>(got);
+    if (used > UINT32_MAX) {
+      std::free(buf);
+      return false;
+    }
+  }
+
+  bytes = buf;
+  length = static_cast<uint32_t>(used);
+  return true;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+
+// Read-only view of a whole source file. Regular files are mmap'ed, so the
+// scanner and to_string() read the page cache directly and token offsets stay
+// valid for as long as the buffer lives. Pipes, terminals and other files
+// that can't be mapped are read() into a heap buffer instead.
+class SourceBuffer {
+public:
+  SourceBuffer() = default;
+  ~SourceBuffer();
+
+  SourceBuffer(SourceBuffer const &) = delete;
+  SourceBuffer &operator=(SourceBuffer const &) = delete;
+  SourceBuffer(SourceBuffer &&other) noexcept;
+  SourceBuffer &operator=(SourceBuffer &&other) noexcept;
+
+  // Load `path`; "-" means standard input. Returns false if the file can't
+  // be opened or read, or is too big for 32 bit token offsets.
+  bool open(char const *path);
+
+  // Load everything readable from an already open descriptor. The
+  // descriptor is not closed.
+  bool load_fd(int fd);
+
+  char const *data() const { return bytes; }
+  uint32_t size() const { return length; }
+  bool is_mapped() const { return mapped; }
+
+private:
+  void release();
+
+  char const *bytes = nullptr;
+  uint32_t length = 0;
+  bool mapped = false;
+};
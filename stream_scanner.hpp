@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "scanner_internal.hpp"
+#include "token.hpp"
+
+// Scanner that takes its input a chunk at a time, e.g. straight off a pipe.
+// Chunks may split the input anywhere: inside a token, a comment or a
+// "\r\n" pair. Token offsets count from the start of the whole input, and
+// feeding every chunk then calling finish() gives the same tokens as one
+// do_scan() over the concatenation.
+//
+// The scanner only keeps its mode, the open token and a few bytes of it, so
+// memory stays bounded however long the input is.
+class StreamScanner {
+public:
+  // Scan the next `size` bytes. Tokens they complete are appended to *out.
+  // The chunk does not need to outlive the call.
+  void feed(char const *chunk, uint32_t size, std::vector<Token> *out);
+
+  // End of input: append the last open token, if any, and EVC_EOF.
+  void finish(std::vector<Token> *out);
+
+  uint32_t bytes_consumed() const { return state.offset; }
+
+private:
+  ScanState state = {};
+
+  // tokens that may still be merged into a float by the next chunk
+  Token held[2];
+  uint32_t held_count = 0;
+};
@@ -0,0 +1,154 @@
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include "symbol_interner.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Control byte of a slot nothing was put in. Full slots hold the top 7 bits
+// of their symbol's hash, so never have the high bit set.
+static constexpr uint8_t empty_control = 0x80;
+
+static constexpr uint32_t initial_capacity = 64;
+
+static uint64_t mix(uint64_t h) {
+  h ^= h >> 32;
+  h *= 0xD6E8FEB86659FD93;
+  h ^= h >> 32;
+  return h;
+}
+
+// Identifiers are short, so the bytes are taken eight at a time with the
+// tail padded with zeroes, rather than one at a time.
+static uint64_t hash_spelling(std::string_view s) {
+  uint64_t h = 0x9E3779B97F4A7C15 ^ s.size();
+  size_t i = 0;
+  for (; i + 8 <= s.size(); i += 8) {
+    uint64_t word;
+    std::memcpy(&word, s.data() + i, 8);
+    h = mix(h ^ word);
+  }
+  if (i < s.size()) {
+    uint64_t word = 0;
+    std::memcpy(&word, s.data() + i, s.size() - i);
+    h = mix(h ^ word);
+  }
+  return mix(h);
+}
+
+static uint8_t control_of(uint64_t hash) {
+  return static_cast<uint8_t>(hash >> 57);
+}
+
+// Bit i set for every group[i] equal to `byte`.
+static uint32_t match_group(uint8_t const *group, uint8_t byte) {
+#if defined(__SSE2__)
+  __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(group));
+  return static_cast<uint32_t>(_mm_movemask_epi8(
+      _mm_cmpeq_epi8(v, _mm_set1_epi8(static_cast<char>(byte)))));
+#else
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < 16; ++i) {
+    mask |= static_cast<uint32_t>(group[i] == byte) << i;
+  }
+  return mask;
+#endif
+}
+
+SymbolInterner::SymbolInterner()
+    : control(initial_capacity, empty_control), slots(initial_capacity) {
+  static_assert(group_size == 16, "match_group compares 16 bytes at a time");
+}
+
+uint32_t SymbolInterner::probe(std::string_view spelling, uint64_t hash,
+                               bool *found) const {
+  uint32_t const group_mask = capacity() / group_size - 1;
+  uint8_t const tag = control_of(hash);
+
+  // triangular steps visit every group once the count is a power of two
+  uint32_t group = static_cast<uint32_t>(hash) & group_mask;
+  for (uint32_t step = 1;; ++step) {
+    uint8_t const *const ctrl = control.data() + group * group_size;
+
+    for (uint32_t m = match_group(ctrl, tag); m != 0; m &= m - 1) {
+      uint32_t const slot = group * group_size + __builtin_ctz(m);
+      Symbol const &sym = symbols[slots[slot]];
+      if (sym.hash == hash && sym.length == spelling.size() &&
+          std::memcmp(pool.data() + sym.offset, spelling.data(),
+                      spelling.size()) == 0) {
+        *found = true;
+        return slot;
+      }
+    }
+
+    if (uint32_t const empty = match_group(ctrl, empty_control)) {
+      *found = false;
+      return group * group_size + __builtin_ctz(empty);
+    }
+    group = (group + step) & group_mask;
+  }
+}
+
+uint32_t SymbolInterner::empty_slot(uint64_t hash) const {
+  uint32_t const group_mask = capacity() / group_size - 1;
+  uint32_t group = static_cast<uint32_t>(hash) & group_mask;
+  for (uint32_t step = 1;; ++step) {
+    if (uint32_t const empty = match_group(
+            control.data() + group * group_size, empty_control)) {
+      return group * group_size + __builtin_ctz(empty);
+    }
+    group = (group + step) & group_mask;
+  }
+}
+
+void SymbolInterner::grow() {
+  uint32_t const new_capacity = capacity() * 2;
+  control.assign(new_capacity, empty_control);
+  slots.assign(new_capacity, 0);
+
+  for (uint32_t id = 0; id < size(); ++id) {
+    uint32_t const slot = empty_slot(symbols[id].hash);
+    control[slot] = control_of(symbols[id].hash);
+    slots[slot] = id;
+  }
+}
+
+uint32_t SymbolInterner::intern(std::string_view spelling) {
+  uint64_t const hash = hash_spelling(spelling);
+  bool found;
+  uint32_t slot = probe(spelling, hash, &found);
+  if (found) {
+    return slots[slot];
+  }
+
+  // at most 7/8 full, so that every probe meets an empty slot soon
+  if ((size() + 1) * 8 > capacity() * 7) {
+    grow();
+    slot = empty_slot(hash);
+  }
+
+  uint32_t const id = size();
+  control[slot] = control_of(hash);
+  slots[slot] = id;
+  symbols.push_back(Symbol{.offset = static_cast<uint32_t>(pool.size()),
+                           .length = static_cast<uint32_t>(spelling.size()),
+                           .hash = hash});
+  pool.append(spelling);
+  return id;
+}
+
+uint32_t SymbolInterner::find(std::string_view spelling) const {
+  bool found;
+  uint32_t const slot = probe(spelling, hash_spelling(spelling), &found);
+  return found ? slots[slot] : no_symbol;
+}
+
+void SymbolInterner::clear() {
+  control.assign(initial_capacity, empty_control);
+  slots.assign(initial_capacity, 0);
+  symbols.clear();
+  pool.clear();
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Maps identifier spellings to dense symbol IDs, 0, 1, 2, ... in the order
+// they were first seen, so that later stages compare and index by integer
+// instead of by string. The spellings themselves are kept in one pool.
+//
+// The table is open addressed with one control byte per slot, probed 16
+// slots at a time: a control byte holds 7 bits of the spelling's hash (or
+// marks the slot empty), so one vector compare finds the few slots in a
+// group worth comparing spellings against.
+class SymbolInterner {
+public:
+  static constexpr uint32_t no_symbol = UINT32_MAX;
+
+  SymbolInterner();
+
+  // ID of `spelling`, adding it if it is new.
+  uint32_t intern(std::string_view spelling);
+
+  // ID of `spelling`, or no_symbol if it has not been interned.
+  uint32_t find(std::string_view spelling) const;
+
+  std::string_view spelling(uint32_t id) const {
+    Symbol const &sym = symbols[id];
+    return std::string_view(pool).substr(sym.offset, sym.length);
+  }
+
+  uint32_t size() const { return static_cast<uint32_t>(symbols.size()); }
+
+  void clear();
+
+private:
+  static constexpr uint32_t group_size = 16;
+
+  struct Symbol {
+    uint32_t offset;
+    uint32_t length;
+    uint64_t hash;
+  };
+
+  // Slot the spelling is in, or the empty slot it would go in, with *found
+  // set accordingly.
+  uint32_t probe(std::string_view spelling, uint64_t hash, bool *found) const;
+  // First empty slot along the hash's probe sequence.
+  uint32_t empty_slot(uint64_t hash) const;
+  void grow();
+
+  // one byte per slot, groups being aligned runs of group_size slots
+  std::vector<uint8_t> control;
+  std::vector<uint32_t> slots;
+  std::vector<Symbol> symbols;
+  std::string pool;
+
+  uint32_t capacity() const { return static_cast<uint32_t>(slots.size()); }
+};
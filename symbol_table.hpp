@@ -1,9 +1,10 @@
 #pragma once
 
-#include <map>
+#include <cstdint>
 #include <memory>
-#include <string>
-#include <vector>
+#include <unordered_map>
+
+#include "arena.hpp"
 
 enum class BaseType {
   Integer,
@@ -25,12 +26,13 @@ struct DeclarationType {
   BaseType base;
 
   union {
-    std::vector<DeclarationType> argTypes;
+    ArenaSpan<DeclarationType> argTypes;
     int arraySize;
   };
 };
 
 struct SymbolMap {
   std::unique_ptr<SymbolMap> parent = nullptr;
-  std::map<std::string, DeclarationType> name_to_type = {};
+  // keyed by symbol ID, see SymbolInterner
+  std::unordered_map<uint32_t, DeclarationType> id_to_type = {};
 };
@@ -1,9 +1,35 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
+#include "arena.hpp"
+#include "batch.hpp"
+#include "compile_server.hpp"
+#include "flat_ast.hpp"
+#include "incremental_scanner.hpp"
+#include "line_index.hpp"
+#include "literal_table.hpp"
+#include "parser.hpp"
 #include "scanner.hpp"
+#include "scanner_simd.hpp"
+#include "source_buffer.hpp"
+#include "stream_scanner.hpp"
+#include "symbol_interner.hpp"
 #include "token.hpp"
+#include "token_pipe.hpp"
+#include "token_sink.hpp"
+#include "token_writer.hpp"
+#include "work_pool.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <unistd.h>
 
 template <size_t N, typename T>
 constexpr size_t const_size_of(T const (&arr)[N]) {
@@ -23,33 +49,1669 @@ TEST_CASE("testing the factorial function") {
 
 TEST_CASE("basic parsing test") {
   char const src_file[] = R"(1.2e+ 2)";
-  std::vector<Token> const v1 = do_scan(src_file, const_size_of(src_file));
+  std::vector<Token> const v1 =
+      do_scan(src_file, const_size_of(src_file) - 1);
   std::vector<Token> const v2 = std::vector<Token>{
       Token{.kind = TokenKind::FLOATLITERAL,
             .start_offset = 0,
             .end_offset = 3,
             .start_pos = SourcePosition{1, 1},
-            .end_pos = SourcePosition{1, 3}},
+            .end_pos = SourcePosition{3, 1}},
       Token{.kind = TokenKind::ID,
             .start_offset = 3,
             .end_offset = 4,
-            .start_pos = SourcePosition{1, 4},
-            .end_pos = SourcePosition{1, 4}},
+            .start_pos = SourcePosition{4, 1},
+            .end_pos = SourcePosition{4, 1}},
       Token{.kind = TokenKind::PLUS,
             .start_offset = 4,
             .end_offset = 5,
-            .start_pos = SourcePosition{1, 51},
-            .end_pos = SourcePosition{1, 5}},
+            .start_pos = SourcePosition{5, 1},
+            .end_pos = SourcePosition{5, 1}},
       Token{.kind = TokenKind::INTLITERAL,
             .start_offset = 6,
             .end_offset = 7,
-            .start_pos = SourcePosition{1, 6},
-            .end_pos = SourcePosition{1, 6}},
+            .start_pos = SourcePosition{7, 1},
+            .end_pos = SourcePosition{7, 1}},
       Token{.kind = TokenKind::EVC_EOF,
             .start_offset = 7,
             .end_offset = 7,
-            .start_pos = SourcePosition{2, 1},
-            .end_pos = SourcePosition{2, 1}},
+            .start_pos = SourcePosition{8, 1},
+            .end_pos = SourcePosition{8, 1}},
   };
   CHECK(v1 == v2);
-}
\ No newline at end of file
+}
+
+static std::vector<std::string> scanner_test_sources() {
+  std::vector<std::string> ret;
+  for (auto const &entry : std::filesystem::directory_iterator(
+           std::filesystem::path(EVC_SCANNER_TESTS_DIR) / "test")) {
+    std::ifstream src_file(entry.path());
+    std::stringstream filebuf;
+    filebuf << src_file.rdbuf();
+    ret.push_back(filebuf.str());
+  }
+  return ret;
+}
+
+// Inputs that push every skip_* kernel across vector boundaries, into tabs
+// and line breaks, and off the end of the buffer.
+static std::vector<std::string> long_run_sources() {
+  std::vector<std::string> ret;
+  for (size_t n : {0, 1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 200}) {
+    std::string const run(n, 'x');
+    std::string const blanks(n, ' ');
+    ret.push_back("/*" + run + "*" + run + "\t" + run + "\n" + run + "*/a");
+    ret.push_back("/*" + run + "\r\n" + run + "**/" + blanks + "b");
+    ret.push_back("//" + run + "\t" + run + "\r\n" + blanks + "\tc");
+    ret.push_back("\"" + run + "\\n" + run + "\t" + run + "\"" + blanks);
+    ret.push_back("\"" + run + "\r\n\"" + run + "\n" + run);
+    ret.push_back("/*" + run);
+    ret.push_back("//" + run);
+    ret.push_back("\"" + run);
+    ret.push_back(blanks);
+  }
+  return ret;
+}
+
+// Both ASTs written out the same way, as S-expressions over the tokens'
+// text, so that they can be compared with each other and with the expected
+// shape.
+struct AstPrinter {
+  std::string_view src;
+  TokenStream const *tks = nullptr;
+  FlatAST const *flat = nullptr;
+  std::string out = {};
+
+  void text(Token const &tk) {
+    out += src.substr(tk.start_offset, tk.end_offset - tk.start_offset);
+  }
+  void text(NodeIndex tk) { text((*tks)[tk]); }
+
+  void expr(Expr const *e) {
+    switch (e->tag) {
+    case Expr::ExprKind::PlainExpr:
+      text(e->plain_node.the_tk);
+      break;
+    case Expr::ExprKind::UnaryExpr:
+      out += "(";
+      text(e->unary_node.op_tk);
+      out += " ";
+      expr(e->unary_node.expr);
+      out += ")";
+      break;
+    case Expr::ExprKind::BinaryExpr:
+      out += "(";
+      text(e->binary_node.op_tk);
+      out += " ";
+      expr(e->binary_node.left_expr);
+      out += " ";
+      expr(e->binary_node.right_expr);
+      out += ")";
+      break;
+    case Expr::ExprKind::CallExpr:
+      out += "(call ";
+      expr(e->call_node.left_expr);
+      for (Expr const *arg : e->call_node.exprlist->expr_list) {
+        out += " ";
+        expr(arg);
+      }
+      out += ")";
+      break;
+    }
+  }
+
+  void stmt(Stmt const *s) {
+    switch (s->tag) {
+    case Stmt::kind::CmpdStmt:
+      out += "{";
+      for (CmpdNode const &node : s->compound_node->nodes) {
+        out += " ";
+        if (node.tag == CmpdNode::kind::Stmt) {
+          stmt(node.stmt);
+        } else {
+          decls(node.decl.begin(), node.decl.end());
+        }
+      }
+      out += " }";
+      break;
+    case Stmt::kind::IfStmt:
+      out += "(if ";
+      expr(s->if_node->condition);
+      out += " ";
+      stmt(s->if_node->if_stmt);
+      if (s->if_node->else_stmt != nullptr) {
+        out += " ";
+        stmt(s->if_node->else_stmt);
+      }
+      out += ")";
+      break;
+    case Stmt::kind::ForStmt:
+      out += "(for ";
+      for (Expr const *e : {s->for_node->e1, s->for_node->e2,
+                            s->for_node->e3}) {
+        if (e != nullptr) {
+          expr(e);
+        } else {
+          out += "_";
+        }
+        out += " ";
+      }
+      stmt(s->for_node->for_stmt);
+      out += ")";
+      break;
+    case Stmt::kind::WhileStmt:
+      out += "(while ";
+      expr(s->while_node->condition);
+      out += " ";
+      stmt(s->while_node->while_stmt);
+      out += ")";
+      break;
+    case Stmt::kind::BreakStmt:
+      out += "break";
+      break;
+    case Stmt::kind::ContStmt:
+      out += "continue";
+      break;
+    case Stmt::kind::RetStmt:
+      out += "(return";
+      if (s->return_node != nullptr) {
+        out += " ";
+        expr(s->return_node->ret_expr);
+      }
+      out += ")";
+      break;
+    case Stmt::kind::ExprStmt:
+      if (s->expr_node != nullptr) {
+        expr(s->expr_node);
+      } else {
+        out += ";";
+      }
+      break;
+    }
+  }
+
+  void decls(Decl const *first, Decl const *last) {
+    for (Decl const *d = first; d != last; ++d) {
+      if (d != first) {
+        out += " ";
+      }
+      out += "(";
+      text(d->ti.type);
+      out += " ";
+      text(d->ti.ident);
+      for (TypeModifier const &tm : d->ti.modifiers) {
+        if (tm.tag == TypeModifier::TypeModKind::PointerTo) {
+          out += " *";
+        } else if (tm.tag == TypeModifier::TypeModKind::ArrayOf) {
+          out += " [";
+          if (tm.array_expr != nullptr) {
+            expr(tm.array_expr);
+          }
+          out += "]";
+        } else {
+          out += " (";
+          for (Para const &p : tm.para_list) {
+            out += &p == tm.para_list.begin() ? "" : ", ";
+            text(p.type);
+            out += " " + std::string(p.indirection_counter, '*');
+            text(p.id);
+          }
+          out += ")";
+        }
+      }
+      switch (d->init.tag) {
+      case InitValue::DeclKind::Expr:
+        out += " = ";
+        expr(d->init.expr);
+        break;
+      case InitValue::DeclKind::ExprList:
+        out += " = {";
+        for (Expr const *e : d->init.exprlist->expr_list) {
+          out += " ";
+          expr(e);
+        }
+        out += " }";
+        break;
+      case InitValue::DeclKind::Body:
+        out += " ";
+        stmt_of_body(d->init.body);
+        break;
+      case InitValue::DeclKind::Nothing:
+        break;
+      }
+      out += ")";
+    }
+  }
+
+  void stmt_of_body(CmpdStmt *body) {
+    Stmt s = {.tag = Stmt::kind::CmpdStmt, .compound_node = body};
+    stmt(&s);
+  }
+
+  void list(NodeIndex l) {
+    FlatRange const items = flat->expr_lists[l];
+    for (uint32_t i = 0; i < items.count; ++i) {
+      out += " ";
+      flat_expr(flat->list_items[items.first + i]);
+    }
+  }
+
+  void flat_expr(NodeIndex i) {
+    FlatExpr const &e = flat->exprs[i];
+    // operands come first
+    CHECK((e.lhs == no_node || e.lhs < i));
+    switch (e.tag) {
+    case Expr::ExprKind::PlainExpr:
+      text(e.token);
+      break;
+    case Expr::ExprKind::UnaryExpr:
+      out += "(";
+      text(e.token);
+      out += " ";
+      flat_expr(e.lhs);
+      out += ")";
+      break;
+    case Expr::ExprKind::BinaryExpr:
+      CHECK(e.rhs < i);
+      out += "(";
+      text(e.token);
+      out += " ";
+      flat_expr(e.lhs);
+      out += " ";
+      flat_expr(e.rhs);
+      out += ")";
+      break;
+    case Expr::ExprKind::CallExpr:
+      out += "(call ";
+      flat_expr(e.lhs);
+      list(e.rhs);
+      out += ")";
+      break;
+    }
+  }
+
+  void flat_opt_expr(NodeIndex i) {
+    if (i != no_node) {
+      flat_expr(i);
+    } else {
+      out += "_";
+    }
+  }
+
+  void flat_stmt(NodeIndex i) {
+    FlatStmt const &s = flat->stmts[i];
+    CHECK(s.end > i);
+    switch (s.tag) {
+    case FlatStmt::Kind::CmpdStmt:
+      out += "{";
+      for (NodeIndex c = i + 1; c < s.end; c = flat->stmts[c].end) {
+        out += " ";
+        flat_stmt(c);
+      }
+      out += " }";
+      break;
+    case FlatStmt::Kind::DeclStmt:
+      flat_decls(s.a, s.b);
+      break;
+    case FlatStmt::Kind::IfStmt:
+      out += "(if ";
+      flat_expr(s.a);
+      out += " ";
+      flat_stmt(i + 1);
+      if (s.b != no_node) {
+        CHECK(s.b == flat->stmts[i + 1].end);
+        out += " ";
+        flat_stmt(s.b);
+      }
+      out += ")";
+      break;
+    case FlatStmt::Kind::ForStmt:
+      out += "(for ";
+      for (NodeIndex e : {s.a, s.b, s.c}) {
+        flat_opt_expr(e);
+        out += " ";
+      }
+      flat_stmt(i + 1);
+      out += ")";
+      break;
+    case FlatStmt::Kind::WhileStmt:
+      out += "(while ";
+      flat_expr(s.a);
+      out += " ";
+      flat_stmt(i + 1);
+      out += ")";
+      break;
+    case FlatStmt::Kind::BreakStmt:
+      out += "break";
+      break;
+    case FlatStmt::Kind::ContStmt:
+      out += "continue";
+      break;
+    case FlatStmt::Kind::RetStmt:
+      out += "(return";
+      if (s.a != no_node) {
+        out += " ";
+        flat_expr(s.a);
+      }
+      out += ")";
+      break;
+    case FlatStmt::Kind::ExprStmt:
+      if (s.a != no_node) {
+        flat_expr(s.a);
+      } else {
+        out += ";";
+      }
+      break;
+    }
+  }
+
+  void flat_decls(NodeIndex first, NodeIndex last) {
+    for (NodeIndex i = first; i < last; i = flat->decls[i].end) {
+      FlatDecl const &d = flat->decls[i];
+      CHECK(d.end > i);
+      if (i != first) {
+        out += " ";
+      }
+      out += "(";
+      text(d.type);
+      out += " ";
+      text(d.ident);
+      for (uint32_t m = 0; m < d.modifiers.count; ++m) {
+        FlatModifier const &tm = flat->modifiers[d.modifiers.first + m];
+        if (tm.tag == TypeModifier::TypeModKind::PointerTo) {
+          out += " *";
+        } else if (tm.tag == TypeModifier::TypeModKind::ArrayOf) {
+          out += " [";
+          if (tm.array_expr != no_node) {
+            flat_expr(tm.array_expr);
+          }
+          out += "]";
+        } else {
+          out += " (";
+          for (uint32_t p = 0; p < tm.paras.count; ++p) {
+            FlatPara const &para = flat->paras[tm.paras.first + p];
+            out += p == 0 ? "" : ", ";
+            text(para.type);
+            out += " " + std::string(para.indirection_counter, '*');
+            text(para.id);
+          }
+          out += ")";
+        }
+      }
+      switch (d.init_tag) {
+      case InitValue::DeclKind::Expr:
+        out += " = ";
+        flat_expr(d.init);
+        break;
+      case InitValue::DeclKind::ExprList:
+        out += " = {";
+        list(d.init);
+        out += " }";
+        break;
+      case InitValue::DeclKind::Body:
+        CHECK(d.init < flat->stmts.size());
+        out += " ";
+        flat_stmt(d.init);
+        break;
+      case InitValue::DeclKind::Nothing:
+        break;
+      }
+      out += ")";
+    }
+  }
+};
+
+static std::string print_ast(std::string_view src, AST const &ast) {
+  AstPrinter p = {.src = src};
+  p.decls(ast.decls.data(), ast.decls.data() + ast.decls.size());
+  return p.out;
+}
+
+static std::string print_ast(std::string_view src, TokenStream const &tks,
+                             FlatAST const &ast) {
+  AstPrinter p = {.src = src, .tks = &tks, .flat = &ast};
+  p.flat_decls(0, static_cast<NodeIndex>(ast.decls.size()));
+  return p.out;
+}
+
+static std::string const parser_test_src =
+    "int x = 1 + 2 * 3, *p, a[2] = {1, -x};\n"
+    "float f(int n, float **v) {\n"
+    "  int i;\n"
+    "  if (n <= 1) return n; else { x = a[x] = 2; }\n"
+    "  while (n) n = n - 1;\n"
+    "  for (;;) { break; continue; }\n"
+    "  for (i = 0; i < n; i = i + 1) ;\n"
+    "  g(1, h(2, 3), (4 + 5) * 6);\n"
+    "  return;\n"
+    "}\n"
+    "void main() { putString(\"hi\"); }\n";
+
+static std::string const parser_test_expected =
+    "(int x = (+ 1 (* 2 3))) (int p *) (int a [2] = { 1 (- x) }) "
+    "(float f (int n, float **v) "
+    "{ (int i) "
+    "(if (<= n 1) (return n) { (= x (= ([ a x) 2)) }) "
+    "(while n (= n (- n 1))) "
+    "(for _ _ _ { break continue }) "
+    "(for (= i 0) (< i n) (= i (+ i 1)) ;) "
+    "(call g 1 (call h 2 3) (* (+ 4 5) 6)) "
+    "(return) }) "
+    "(void main () { (call putString hi) })";
+
+TEST_CASE("the parser builds the expected AST") {
+  std::string const &src = parser_test_src;
+  auto const tokens = do_scan(src.data(), src.size());
+  AST const ast = do_parse(tokens.data(), tokens.size());
+  CHECK(ast.error_token == AST::no_error);
+  CHECK(print_ast(src, ast) == parser_test_expected);
+  CHECK(ast.arena.node_count() > 0);
+
+  // the nodes are plain data: a copied AST still prints the same
+  std::vector<Decl> const copied = ast.decls;
+  AstPrinter p = {.src = src};
+  p.decls(copied.data(), copied.data() + copied.size());
+  CHECK(p.out == parser_test_expected);
+
+  TokenStream const tks = to_token_stream(tokens.data(), tokens.size());
+  CHECK(print_ast(src, do_parse(tks)) == parser_test_expected);
+
+  FlatAST flat;
+  do_parse_flat(tks, &flat);
+  CHECK(flat.error_token == AST::no_error);
+  CHECK(print_ast(src, tks, flat) == parser_test_expected);
+
+  for (PipeMode mode : {PipeMode::SameThread, PipeMode::ProducerThread}) {
+    AST const piped = do_scan_and_parse(src.data(), src.size(), mode);
+    CHECK(piped.error_token == AST::no_error);
+    CHECK(print_ast(src, piped) == parser_test_expected);
+  }
+}
+
+TEST_CASE("parallel parsing matches the serial parser") {
+  std::string src;
+  for (int i = 0; i < 200; ++i) {
+    std::string const n = std::to_string(i);
+    src += "int g" + n + " = " + n + ", a" + n + "[2] = {1, -g" + n + "};\n";
+    src += "float f" + n + "(int n, float *v) {\n"
+           "  int x[2] = {n, 2};\n"
+           "  if (n) { while (n) n = n - 1; } else return v[0];\n"
+           "  { int y; y = f" + n + "(n - 1, v) * 2; }\n"
+           "  return;\n"
+           "}\n";
+  }
+
+  auto const check_same = [](std::string const &text) {
+    auto const tokens = do_scan(text.data(), text.size());
+    TokenStream const tks = to_token_stream(tokens.data(), tokens.size());
+    AST const serial = do_parse(tks);
+    std::string const expected = print_ast(text, serial);
+    for (uint32_t threads : {1u, 2u, 4u}) {
+      for (uint32_t min_chunk : {1u, 7u, 100u, 16u * 1024}) {
+        AST const parallel = do_parse_parallel(tks, threads, min_chunk);
+        CHECK(parallel.error_token == serial.error_token);
+        CHECK(parallel.decls.size() == serial.decls.size());
+        CHECK(print_ast(text, parallel) == expected);
+        CHECK(parallel.arena.node_count() == serial.arena.node_count());
+      }
+    }
+    return serial.error_token;
+  };
+
+  CHECK(check_same(src) == AST::no_error);
+
+  // a syntax error part way through, in the middle of a body
+  std::string broken = src;
+  broken.insert(broken.find("{ int y;", src.size() / 2), "int = ");
+  CHECK(check_same(broken) != AST::no_error);
+
+  // braces that fool the splitter: a ';' after a body, and a body that is
+  // never closed
+  CHECK(check_same(src + "int h() {};" + src) != AST::no_error);
+  CHECK(check_same(src + "int h() { {" + src) != AST::no_error);
+  CHECK(check_same("int x;") == AST::no_error);
+}
+
+TEST_CASE("long expressions parse in constant stack space") {
+  // each 100000 deep, far past what one stack frame per operator would allow
+  size_t const n = 100000;
+  std::string sum = "int x = a";
+  std::string assign = "int x = a";
+  std::string nested = "int x = ";
+  for (size_t i = 0; i < n; ++i) {
+    sum += " + a";
+    assign += " = a";
+    nested += "-(";
+  }
+  nested += "f(a[1], 2)";
+  nested.append(n, ')');
+  for (std::string *src : {&sum, &assign, &nested}) {
+    *src += ";";
+  }
+
+  auto const tree = [](std::string const &src) {
+    auto const tokens = do_scan(src.data(), src.size());
+    TokenStream const tks = to_token_stream(tokens.data(), tokens.size());
+    AST ast = do_parse(tks);
+    REQUIRE(ast.error_token == AST::no_error);
+    REQUIRE(ast.decls.size() == 1);
+    return ast;
+  };
+  auto const flat = [](std::string const &src) {
+    auto const tokens = do_scan(src.data(), src.size());
+    TokenStream const tks = to_token_stream(tokens.data(), tokens.size());
+    FlatAST ast;
+    do_parse_flat(tks, &ast);
+    REQUIRE(ast.error_token == AST::no_error);
+    REQUIRE(ast.decls.size() == 1);
+    return ast;
+  };
+
+  // '+' is left associative: the spine runs down the left operands
+  AST const sum_tree = tree(sum);
+  Expr const *e = sum_tree.decls[0].init.expr;
+  size_t depth = 0;
+  while (e->tag == Expr::ExprKind::BinaryExpr) {
+    CHECK(e->binary_node.right_expr->tag == Expr::ExprKind::PlainExpr);
+    e = e->binary_node.left_expr;
+    ++depth;
+  }
+  CHECK(depth == n);
+
+  // '=' is right associative: the spine runs down the right operands
+  AST const assign_tree = tree(assign);
+  e = assign_tree.decls[0].init.expr;
+  depth = 0;
+  while (e->tag == Expr::ExprKind::BinaryExpr) {
+    CHECK(e->binary_node.left_expr->tag == Expr::ExprKind::PlainExpr);
+    e = e->binary_node.right_expr;
+    ++depth;
+  }
+  CHECK(depth == n);
+
+  AST const nested_tree = tree(nested);
+  e = nested_tree.decls[0].init.expr;
+  depth = 0;
+  while (e->tag == Expr::ExprKind::UnaryExpr) {
+    e = e->unary_node.expr;
+    ++depth;
+  }
+  CHECK(depth == n);
+  REQUIRE(e->tag == Expr::ExprKind::CallExpr);
+  CHECK(e->call_node.exprlist->expr_list.size() == 2);
+
+  // flat, operands come before their operator and the root is last
+  FlatAST const sum_flat = flat(sum);
+  CHECK(sum_flat.exprs.size() == 2 * n + 1);
+  CHECK(sum_flat.decls[0].init == sum_flat.exprs.size() - 1);
+  CHECK(sum_flat.exprs.back().rhs == sum_flat.exprs.size() - 2);
+
+  FlatAST const assign_flat = flat(assign);
+  CHECK(assign_flat.exprs.size() == 2 * n + 1);
+  CHECK(assign_flat.exprs.back().lhs == 0);
+
+  FlatAST const nested_flat = flat(nested);
+  CHECK(nested_flat.exprs.size() == n + 6);
+  CHECK(nested_flat.exprs[5].tag == Expr::ExprKind::CallExpr);
+}
+
+TEST_CASE("the parser stops at the first syntax error") {
+  for (char const *src :
+       {"int x = ;", "int f() { x = 1 }", "int f( { }", "x;", "int f() {",
+        "int x = (1;", "int x = a[1;", "int x = f(1,;", "int x = -;",
+        // trailing commas
+        "int x = f(a,);", "void g() { f(a, b,); }", "int a[2] = {1, 2,};",
+        "int f(int a,) {}"}) {
+    std::string_view const sv = src;
+    auto const tokens = do_scan(sv.data(), sv.size());
+    TokenStream const tks = to_token_stream(tokens.data(), tokens.size());
+    CHECK(do_parse(tks).error_token != AST::no_error);
+    FlatAST flat;
+    do_parse_flat(tks, &flat);
+    CHECK(flat.error_token != AST::no_error);
+  }
+
+  std::ifstream src_file(std::filesystem::path(EVC_SCANNER_TESTS_DIR) /
+                         "test" / "fib.vc");
+  std::stringstream filebuf;
+  filebuf << src_file.rdbuf();
+  std::string const fib = filebuf.str();
+  auto const tokens = do_scan(fib.data(), fib.size());
+  TokenStream const tks = to_token_stream(tokens.data(), tokens.size());
+  AST const ast = do_parse(tks);
+  CHECK(ast.error_token == AST::no_error);
+  FlatAST flat;
+  do_parse_flat(tks, &flat);
+  CHECK(print_ast(fib, tks, flat) == print_ast(fib, ast));
+}
+
+TEST_CASE("SIMD fast paths match the scalar scanner") {
+  std::vector<std::string> sources = scanner_test_sources();
+  for (auto const &src : long_run_sources()) {
+    sources.push_back(src);
+  }
+
+  SimdLevel const best = detect_simd_level();
+  for (auto const &src : sources) {
+    set_simd_level(SimdLevel::Scalar);
+    auto const expected = do_scan(src.data(), src.size());
+
+    for (SimdLevel level : {SimdLevel::SSE2, SimdLevel::AVX2}) {
+      set_simd_level(level);
+      CHECK(do_scan(src.data(), src.size()) == expected);
+    }
+  }
+  set_simd_level(best);
+}
+
+TEST_CASE("table driven scanner matches the switch scanner") {
+  std::vector<std::string> sources = scanner_test_sources();
+  for (auto const &src : long_run_sources()) {
+    sources.push_back(src);
+  }
+  for (char const *src : {"1.2e+ 2", "1e5", "1.e-3x", ".5e", "3.e+", "1e+",
+                          "a!=b!c==d=e<=f<g>=h>i&&j&k||l|m", "..1.",
+                          "\"\\q\\n\"", "\"ab\\", "/", "*/", "/*", "\r",
+                          "\r\r\n\n", "/**\r\n**/", "a/b//c\r\nd"}) {
+    sources.push_back(src);
+  }
+  // non-ASCII bytes go through the table too, not to the switch scanner
+  for (char const *src :
+       {"x\xc3\xa9y", "1\xe2\x82\xac.5", "\"\xc3\xa9\t\xff\"", "\"\\\xc3\xa9\"",
+        "/*\xc3\xa9*\xc3\xa9**\xe2\x82*/", "// \xf0\x9f\x98\x80\xc0\n\xe2",
+        "\"ab\xf0\x9f", "/* \xed\xa0\x80", "a\xe2\x82"}) {
+    sources.push_back(src);
+  }
+
+  for (auto const &src : sources) {
+    CHECK(do_scan(src.data(), src.size(), ScanEngine::Table) ==
+          do_scan(src.data(), src.size(), ScanEngine::Switch));
+  }
+}
+
+TEST_CASE("keywords are recognised and near misses are identifiers") {
+  struct Expected {
+    char const *src;
+    TokenKind tk;
+  };
+  Expected const cases[] = {
+      {"boolean", TokenKind::BOOLEAN},  {"break", TokenKind::BREAK},
+      {"continue", TokenKind::CONTINUE}, {"else", TokenKind::ELSE},
+      {"float", TokenKind::FLOAT},      {"for", TokenKind::FOR},
+      {"if", TokenKind::IF},            {"int", TokenKind::INT},
+      {"return", TokenKind::RETURN},    {"void", TokenKind::VOID},
+      {"while", TokenKind::WHILE},      {"true", TokenKind::BOOLEANLITERAL},
+      {"false", TokenKind::BOOLEANLITERAL},
+      {"i", TokenKind::ID},             {"iff", TokenKind::ID},
+      {"fr", TokenKind::ID},            {"Int", TokenKind::ID},
+      {"elsE", TokenKind::ID},          {"eose", TokenKind::ID},
+      {"bolean", TokenKind::ID},        {"continues", TokenKind::ID},
+      {"fxlse", TokenKind::ID},         {"whilf", TokenKind::ID},
+      {"_if", TokenKind::ID},           {"voidvoid", TokenKind::ID},
+  };
+  for (auto const &c : cases) {
+    std::string const src = std::string(c.src) + "\n";
+    auto const tks = do_scan(src.data(), src.size());
+    REQUIRE(tks.size() == 2);
+    CHECK(tks[0].kind == c.tk);
+  }
+}
+
+static std::vector<Token> scan_in_chunks(std::string const &src,
+                                         std::vector<uint32_t> const &cuts) {
+  StreamScanner scanner;
+  std::vector<Token> ret;
+  uint32_t from = 0;
+  for (uint32_t cut : cuts) {
+    // copy the chunk so nothing can read past it
+    std::string const chunk = src.substr(from, cut - from);
+    scanner.feed(chunk.data(), chunk.size(), &ret);
+    from = cut;
+  }
+  std::string const chunk = src.substr(from);
+  scanner.feed(chunk.data(), chunk.size(), &ret);
+  scanner.finish(&ret);
+  return ret;
+}
+
+TEST_CASE("streaming scanner matches do_scan for any chunking") {
+  std::vector<std::string> sources = scanner_test_sources();
+  for (char const *src :
+       {"1.2e+ 2", "1e5", "12.5E-10x", "3.e+", "continue", "whilex while ",
+        "a!=b==c<=d>=e&&f||g", "\"ab\\\"c\"", "/* x **/", "//x\r\ny",
+        "\r\n\r\n", "\"a\r\nb"}) {
+    sources.push_back(src);
+  }
+
+  for (auto const &src : sources) {
+    auto const expected = do_scan(src.data(), src.size());
+
+    // every single split point
+    if (src.size() < 64) {
+      for (uint32_t cut = 0; cut <= src.size(); ++cut) {
+        CHECK(scan_in_chunks(src, {cut}) == expected);
+      }
+    }
+
+    // a byte at a time, and a few fixed chunk sizes
+    for (uint32_t step : {1, 2, 3, 7, 64}) {
+      std::vector<uint32_t> cuts;
+      for (uint32_t cut = step; cut < src.size(); cut += step) {
+        cuts.push_back(cut);
+      }
+      CHECK(scan_in_chunks(src, cuts) == expected);
+    }
+  }
+}
+
+TEST_CASE("source buffer maps files and reads pipes") {
+  auto const path =
+      std::filesystem::path(EVC_SCANNER_TESTS_DIR) / "test" / "fib.vc";
+  std::ifstream src_file(path);
+  std::stringstream filebuf;
+  filebuf << src_file.rdbuf();
+  std::string const expected = filebuf.str();
+
+  SourceBuffer mapped;
+  REQUIRE(mapped.open(path.c_str()));
+  CHECK(mapped.is_mapped());
+  CHECK(std::string(mapped.data(), mapped.size()) == expected);
+
+  int fds[2];
+  REQUIRE(pipe(fds) == 0);
+  REQUIRE(write(fds[1], expected.data(), expected.size()) ==
+          static_cast<ssize_t>(expected.size()));
+  close(fds[1]);
+
+  SourceBuffer piped;
+  REQUIRE(piped.load_fd(fds[0]));
+  close(fds[0]);
+  CHECK(!piped.is_mapped());
+  CHECK(std::string(piped.data(), piped.size()) == expected);
+
+  SourceBuffer moved = std::move(mapped);
+  CHECK(mapped.data() == nullptr);
+  CHECK(do_scan(moved.data(), moved.size()) ==
+        do_scan(expected.data(), expected.size()));
+
+  SourceBuffer missing;
+  CHECK(!missing.open("/nonexistent/evc/source.vc"));
+
+  std::FILE *empty_file = std::tmpfile();
+  REQUIRE(empty_file != nullptr);
+  SourceBuffer empty;
+  CHECK(empty.load_fd(fileno(empty_file)));
+  CHECK(empty.size() == 0);
+  std::fclose(empty_file);
+
+  // procfs says its files are empty; they have to be read to find out
+  if (std::filesystem::exists("/proc/self/status")) {
+    SourceBuffer proc;
+    REQUIRE(proc.open("/proc/self/status"));
+    CHECK(!proc.is_mapped());
+    CHECK(std::string_view(proc.data(), proc.size()).starts_with("Name:"));
+  }
+}
+
+TEST_CASE("token stream holds the same tokens as the vector") {
+  for (auto const &src : scanner_test_sources()) {
+    auto const expected = do_scan(src.data(), src.size());
+
+    TokenStream stream;
+    do_scan(src.data(), src.size(), &stream);
+
+    REQUIRE(stream.size() == expected.size());
+    for (uint32_t i = 0; i < stream.size(); ++i) {
+      CHECK(stream.kind(i) == expected[i].kind);
+      CHECK(stream[i] == expected[i]);
+    }
+    CHECK(static_cast<TokenKind>(stream.kind_data()[stream.size() - 1]) ==
+          TokenKind::EVC_EOF);
+
+    TokenStream const copied =
+        to_token_stream(expected.data(), expected.size());
+    REQUIRE(copied.size() == expected.size());
+    CHECK(copied.back() == expected.back());
+  }
+}
+
+TEST_CASE("lazily resolved positions match the tracked ones") {
+  std::vector<std::string> sources = scanner_test_sources();
+  for (auto const &src : long_run_sources()) {
+    sources.push_back(src);
+  }
+  for (char const *src :
+       {"\r", "a;\r", "\"ab\\\r\nc\"", "\"x\\\r\r\n", "\t\ta\tb\r\n\tc",
+        "x.\n.", ".", "\"", "\"abc", "/* \t", "1.5e+\r\n2", "//\r\n\n"}) {
+    sources.push_back(src);
+  }
+  // one long line, where resolving each token from the start of its line
+  // would take minutes
+  std::string line;
+  for (uint32_t i = 0; i < 100000; ++i) {
+    line += "x = y\t+ 1; ";
+  }
+  sources.push_back(line);
+
+  for (auto const &src : sources) {
+    std::vector<uint32_t> escaped_crs;
+    auto tks = do_scan_offsets(src.data(), src.size(), &escaped_crs);
+    LineIndex const lines(src.data(), src.size(), escaped_crs);
+    resolve_positions(&tks, lines);
+
+    CHECK(tks == do_scan(src.data(), src.size()));
+  }
+
+  // and so does the driver's dump, which resolves them the same way
+  auto const dumped = [&line](bool lazy) {
+    CompileOptions opts;
+    opts.lazy_positions = lazy;
+    std::string ret;
+    TokenWriter out(&ret);
+    dump_tokens(line.data(), line.size(), opts, &out);
+    out.flush();
+    return ret;
+  };
+  CHECK(dumped(true) == dumped(false));
+}
+
+TEST_CASE("parallel scanning matches the sequential scanner") {
+  std::vector<std::string> sources = scanner_test_sources();
+  for (auto const &src : long_run_sources()) {
+    sources.push_back(src);
+  }
+  // pieces starting inside a block comment, inside a string continued by a
+  // backslash, and after a "\r\n"
+  for (char const *src :
+       {"a\n/* x\n\"y\n*/ b\n", "\"ab\\\ncd\\\n\" e\n1\n", "x\r\ny\r\n\r\nz",
+        "/* never\nclosed\n", "\"open\\\n", "\r\n\r", "1.2e\n+3\n"}) {
+    sources.push_back(src);
+  }
+
+  for (auto const &src : sources) {
+    auto const expected = do_scan(src.data(), src.size());
+    for (uint32_t threads : {2u, 3u, 8u}) {
+      CHECK(do_scan_parallel(src.data(), src.size(), threads, 1) == expected);
+    }
+  }
+
+  // Pieces starting inside a string are lexed serially when the pieces are
+  // stitched together. Here most cuts land inside one long continued
+  // string, some of them after an escaped "\r\n", with code on both sides.
+  std::string strings = "int x;\n\"";
+  for (uint32_t i = 0; i < 2000; ++i) {
+    strings += "line " + std::to_string(i) + (i % 3 == 0 ? "\\\r\n" : "\\\n");
+  }
+  strings += "\" y = 1.5;\n/* after\n */ z\n";
+  auto const expected = do_scan(strings.data(), strings.size());
+  for (uint32_t threads : {2u, 4u, 16u}) {
+    CHECK(do_scan_parallel(strings.data(), strings.size(), threads, 64) ==
+          expected);
+  }
+}
+
+// Everything written to the descriptor of a temporary file.
+static std::string read_back(std::FILE *file) {
+  lseek(fileno(file), 0, SEEK_SET);
+  SourceBuffer written;
+  REQUIRE(written.load_fd(fileno(file)));
+  return std::string(written.data(), written.size());
+}
+
+TEST_CASE("token writer dumps what to_string gives") {
+  std::vector<std::string> sources = scanner_test_sources();
+  // a literal longer than the buffer goes out without being copied in
+  sources.push_back("x = \"" + std::string(1000, 'y') + "\";\n");
+
+  for (auto const &src : sources) {
+    auto const tks = do_scan(src.data(), src.size());
+
+    std::string expected;
+    for (auto const &t : tks) {
+      expected += to_string(t, src.data(), src.size()) + "\n";
+    }
+
+    std::FILE *text = std::tmpfile();
+    std::FILE *binary = std::tmpfile();
+    REQUIRE(text != nullptr);
+    REQUIRE(binary != nullptr);
+    {
+      // the smallest buffer there is, to flush as often as possible
+      TokenWriter text_out(fileno(text), 1);
+      TokenWriter binary_out(fileno(binary), 1);
+      binary_out.write_binary_header();
+      for (auto const &t : tks) {
+        text_out.write_text(t, src.data());
+        binary_out.write_binary(t);
+      }
+      CHECK(text_out.flush());
+      CHECK(binary_out.flush());
+    }
+    CHECK(read_back(text) == expected);
+
+    std::string const dump = read_back(binary);
+    REQUIRE(dump.size() == sizeof(BinaryDumpHeader) +
+                               tks.size() * sizeof(BinaryTokenRecord));
+    BinaryDumpHeader header;
+    std::memcpy(&header, dump.data(), sizeof(header));
+    CHECK(std::string(header.magic, 4) == "EVCT");
+    CHECK(header.version == binary_dump_version);
+    CHECK(header.record_size == sizeof(BinaryTokenRecord));
+    for (size_t i = 0; i < tks.size(); ++i) {
+      BinaryTokenRecord record;
+      std::memcpy(&record,
+                  dump.data() + sizeof(header) + i * sizeof(record),
+                  sizeof(record));
+      CHECK(record.kind == static_cast<uint8_t>(tks[i].kind));
+      CHECK(record.start_offset == tks[i].start_offset);
+      CHECK(record.end_offset == tks[i].end_offset);
+      CHECK(record.start_line ==
+            static_cast<uint32_t>(tks[i].start_pos.line_num));
+      CHECK(record.end_col == static_cast<uint32_t>(tks[i].end_pos.col_pos));
+    }
+
+    std::fclose(text);
+    std::fclose(binary);
+  }
+}
+
+TEST_CASE("token sinks see the same tokens as the vector") {
+  std::vector<std::string> sources = scanner_test_sources();
+  for (auto const &src : long_run_sources()) {
+    sources.push_back(src);
+  }
+  // exponents taken back right at the end of the input, and mid-way
+  for (char const *src :
+       {"1e5", "1.5e+5", "1.5e-", "1e", "2e+x", "1E-3;4e4 5.e+", "\r"}) {
+    sources.push_back(src);
+  }
+
+  for (auto const &src : sources) {
+    auto const expected = do_scan(src.data(), src.size());
+
+    std::vector<Token> pushed;
+    do_scan(src.data(), src.size(),
+            [&](Token const &t) { pushed.push_back(t); });
+    CHECK(pushed == expected);
+
+    uint32_t count = 0;
+    auto counter = [&count](Token const &) { ++count; };
+    do_scan(src.data(), src.size(), counter);
+    CHECK(count == expected.size());
+  }
+}
+
+TEST_CASE("token pipe delivers do_scan's tokens in either mode") {
+  std::vector<std::string> sources = scanner_test_sources();
+  for (auto const &src : long_run_sources()) {
+    sources.push_back(src);
+  }
+  // many times the ring, with exponents held back across slices
+  std::string big;
+  for (uint32_t i = 0; i < 400; ++i) {
+    big += "x = 1.5e+" + std::to_string(i) + " - y[" + std::to_string(i) +
+           "]; /* " + std::string(i % 40, '*') + " */\n\"s\\\n\";\n";
+  }
+  sources.push_back(big);
+  sources.push_back("");
+
+  for (auto const &src : sources) {
+    auto const expected = do_scan(src.data(), src.size());
+
+    for (PipeMode mode : {PipeMode::SameThread, PipeMode::ProducerThread}) {
+      TokenPipe pipe(src.data(), src.size(), mode);
+      std::vector<Token> pulled;
+      for (uint32_t i = 0; pipe.kind(i) != TokenKind::EVC_EOF; ++i) {
+        pulled.push_back(pipe[i]);
+      }
+      pulled.push_back(pipe[pulled.size()]);
+
+      CHECK(pulled == expected);
+      CHECK(pipe.size() == expected.size());
+      // past the end there is nothing but EOF
+      CHECK(pipe.kind(pulled.size() + 3) == TokenKind::EVC_EOF);
+    }
+  }
+
+  // the parser giving up half way must not leave the scanner thread stuck
+  TokenPipe abandoned(big.data(), big.size(), PipeMode::ProducerThread);
+  CHECK(abandoned.kind(10) == do_scan(big.data(), big.size())[10].kind);
+}
+
+TEST_CASE("literals are decoded while scanning") {
+  SUBCASE("same tokens as do_scan apart from the payload") {
+    std::vector<std::string> sources = scanner_test_sources();
+    for (char const *src : {"1e5", "1.5e+5 x", "1.5e-", "2e+x", "\"a\\"}) {
+      sources.push_back(src);
+    }
+    for (auto const &src : sources) {
+      auto expected = do_scan(src.data(), src.size());
+      LiteralTable table;
+      auto tks = do_scan_literals(src.data(), src.size(), &table);
+      REQUIRE(tks.size() == expected.size());
+      for (size_t i = 0; i < tks.size(); ++i) {
+        bool const has_payload = tks[i].payload != no_payload;
+        tks[i].payload = no_payload;
+        CHECK(tks[i] == expected[i]);
+        CHECK(has_payload == (decode_literal(tks[i], src.data(), &table) !=
+                              no_payload));
+      }
+    }
+  }
+
+  SUBCASE("values") {
+    std::string const src =
+        "0 42 12345678 123456789012 2147483647 2147483648 00000000000000007 "
+        "1.5 .25 3. 1e3 1.5e-3 6.02E+23 1e50 1e-50 0.1\n"
+        "true false \"a\\tb\\\"c\" \"\" \"x\\qy\" \"open\n";
+    LiteralTable table;
+    auto const tks = do_scan_literals(src.data(), src.size(), &table);
+
+    std::vector<Literal> lits;
+    for (auto const &tk : tks) {
+      if (tk.payload != no_payload) {
+        lits.push_back(table[tk.payload]);
+      }
+    }
+    REQUIRE(lits.size() == 22);
+
+    uint32_t const ints[] = {0, 42, 12345678, 2147483647, 2147483647,
+                             2147483647, 7};
+    bool const int_overflow[] = {false, false, false, true,
+                                 false, true,  false};
+    for (uint32_t i = 0; i < 7; ++i) {
+      CHECK(lits[i].kind == LiteralKind::Int);
+      CHECK(lits[i].int_value == ints[i]);
+      CHECK(lits[i].out_of_range == int_overflow[i]);
+    }
+
+    char const *const floats[] = {"1.5",  ".25",  "3.",    "1e3", "1.5e-3",
+                                  "6.02E+23", "1e50", "1e-50", "0.1"};
+    for (uint32_t i = 0; i < 9; ++i) {
+      CHECK(lits[7 + i].kind == LiteralKind::Float);
+      CHECK(lits[7 + i].float_value == std::strtof(floats[i], nullptr));
+      CHECK(lits[7 + i].out_of_range == (i == 6 || i == 7));
+    }
+
+    CHECK(lits[16].kind == LiteralKind::Bool);
+    CHECK(lits[16].bool_value);
+    CHECK_FALSE(lits[17].bool_value);
+
+    CHECK(lits[18].kind == LiteralKind::String);
+    CHECK(table.string_at(lits[18]) == "a\tb\"c");
+    CHECK(table.string_at(lits[19]) == "");
+    // illegal escapes are kept as written
+    CHECK(table.string_at(lits[20]) == "x\\qy");
+    CHECK(table.string_at(lits[21]) == "open");
+  }
+}
+
+TEST_CASE("identifiers are interned into dense symbol IDs") {
+  SUBCASE("same spelling, same ID, in first seen order") {
+    SymbolInterner symbols;
+    CHECK(symbols.intern("x") == 0);
+    CHECK(symbols.intern("counter") == 1);
+    CHECK(symbols.intern("x") == 0);
+    CHECK(symbols.intern("") == 2);
+    CHECK(symbols.intern("a_rather_long_identifier_name") == 3);
+    CHECK(symbols.intern("a_rather_long_identifier_namf") == 4);
+    CHECK(symbols.find("counter") == 1);
+    CHECK(symbols.find("count") == SymbolInterner::no_symbol);
+    CHECK(symbols.spelling(3) == "a_rather_long_identifier_name");
+    CHECK(symbols.size() == 5);
+
+    symbols.clear();
+    CHECK(symbols.size() == 0);
+    CHECK(symbols.find("x") == SymbolInterner::no_symbol);
+  }
+
+  SUBCASE("many symbols, through several rehashes") {
+    SymbolInterner symbols;
+    for (uint32_t i = 0; i < 20000; ++i) {
+      REQUIRE(symbols.intern("v" + std::to_string(i)) == i);
+    }
+    for (uint32_t i = 0; i < 20000; ++i) {
+      CHECK(symbols.find("v" + std::to_string(i)) == i);
+      CHECK(symbols.spelling(i) == "v" + std::to_string(i));
+    }
+    CHECK(symbols.find("v20000") == SymbolInterner::no_symbol);
+  }
+
+  SUBCASE("the scanner hands out IDs with the tokens") {
+    std::string const src = "int foo; foo = bar + 1e5 + e; int bar2 = foo;";
+    LiteralTable literals;
+    SymbolInterner symbols;
+    auto const tks = do_scan_literals(src.data(), src.size(), &literals,
+                                      &symbols);
+
+    std::vector<std::string_view> names;
+    for (auto const &tk : tks) {
+      if (tk.kind == TokenKind::ID) {
+        REQUIRE(tk.payload != no_payload);
+        CHECK(symbols.spelling(tk.payload) ==
+              std::string_view(src).substr(tk.start_offset,
+                                           tk.end_offset - tk.start_offset));
+        names.push_back(symbols.spelling(tk.payload));
+      } else if (tk.kind == TokenKind::INT) {
+        CHECK(tk.payload == no_payload);
+      }
+    }
+    CHECK(names == std::vector<std::string_view>{"foo", "foo", "bar", "e",
+                                                 "bar2", "foo"});
+    // the 'e' of the exponent is never interned
+    CHECK(symbols.size() == 4);
+    CHECK(symbols.find("e") == 2);
+  }
+
+  SUBCASE("the parser gets them through the pipe") {
+    // long enough to take several slices on either side of the pipe
+    std::string src;
+    for (int i = 0; i < 2000; ++i) {
+      src += "int v" + std::to_string(i) + " = w" + std::to_string(i % 7) +
+             " + 1e5;\n";
+    }
+    LiteralTable literals;
+    SymbolInterner scanned;
+    do_scan_literals(src.data(), src.size(), &literals, &scanned);
+
+    for (PipeMode mode : {PipeMode::SameThread, PipeMode::ProducerThread}) {
+      SymbolInterner symbols;
+      AST const ast = do_scan_and_parse(src.data(), src.size(), mode, &symbols);
+      REQUIRE(ast.decls.size() == 2000);
+      // first seen order is the same however the tokens got there
+      REQUIRE(symbols.size() == scanned.size());
+      for (uint32_t id = 0; id < symbols.size(); ++id) {
+        CHECK(symbols.spelling(id) == scanned.spelling(id));
+      }
+      for (int i = 0; i < 2000; ++i) {
+        Decl const &d = ast.decls[i];
+        CHECK(symbols.spelling(d.ti.ident.payload) ==
+              "v" + std::to_string(i));
+        REQUIRE(d.init.tag == InitValue::DeclKind::Expr);
+        Token const w = d.init.expr->binary_node.left_expr->plain_node.the_tk;
+        CHECK(symbols.spelling(w.payload) == "w" + std::to_string(i % 7));
+      }
+    }
+
+    AST const plain = do_scan_and_parse(src.data(), src.size());
+    CHECK(plain.decls[0].ti.ident.payload == no_payload);
+  }
+}
+
+TEST_CASE("work stealing runs every index exactly once") {
+  for (uint32_t threads : {1u, 2u, 3u, 8u}) {
+    for (uint32_t count : {0u, 1u, 5u, 1000u}) {
+      std::vector<std::atomic<uint32_t>> runs(count);
+      run_work_stealing(count, threads, [&](uint32_t i) {
+        // a few slow items at the front, for the others to steal around
+        if (i < 4) {
+          volatile uint32_t spin = 0;
+          while (spin < 100000) {
+            spin = spin + 1;
+          }
+        }
+        runs[i].fetch_add(1);
+      });
+      for (uint32_t i = 0; i < count; ++i) {
+        CHECK(runs[i].load() == 1);
+      }
+    }
+  }
+}
+
+TEST_CASE("batch mode writes one dump per file") {
+  namespace fs = std::filesystem;
+  fs::path const dir = fs::temp_directory_path() /
+                       ("evc_batch_" + std::to_string(::getpid()));
+  fs::create_directories(dir / "in" / "sub");
+  fs::create_directories(dir / "out");
+
+  std::vector<std::string> const sources = scanner_test_sources();
+  std::vector<std::string> inputs;
+  for (size_t i = 0; i < sources.size(); ++i) {
+    // every other file under sub/ with a name already used
+    fs::path const path = i % 2 == 0
+                              ? dir / "in" / ("f" + std::to_string(i / 2))
+                              : dir / "in" / "sub" /
+                                    ("f" + std::to_string(i / 2));
+    std::ofstream(path, std::ios::binary) << sources[i];
+    inputs.push_back(path.string());
+  }
+  inputs.push_back((dir / "in" / "missing").string());
+
+  std::ofstream(dir / "manifest") << "# a comment\n\n" << inputs[0]
+                                  << "\r\n" << inputs[1] << "\n";
+  std::vector<std::string> listed;
+  REQUIRE(read_manifest((dir / "manifest").string().c_str(), &listed));
+  CHECK(listed == std::vector<std::string>{inputs[0], inputs[1]});
+
+  // a suffixed name that is some other input's own name is never reused
+  CHECK(batch_output_paths({"x/a.vc", "y/a.vc", "a.vc.2", "z/a.vc", "a.vc.2"},
+                           "out", false) ==
+        std::vector<std::string>{"out/a.vc.tokens", "out/a.vc.2.tokens",
+                                 "out/a.vc.2.2.tokens", "out/a.vc.3.tokens",
+                                 "out/a.vc.2.3.tokens"});
+
+  CompileOptions options;
+  std::vector<BatchFileResult> results;
+  BatchReport const report =
+      run_batch(inputs, (dir / "out").string(), options, 3, &results);
+
+  CHECK(report.files == inputs.size());
+  CHECK(report.failed == 1);
+  REQUIRE(results.size() == inputs.size());
+  CHECK_FALSE(results.back().ok);
+  CHECK(results.back().error.find("missing") != std::string::npos);
+
+  uint64_t bytes = 0;
+  for (size_t i = 0; i < sources.size(); ++i) {
+    REQUIRE(results[i].ok);
+    bytes += results[i].bytes;
+
+    std::string const expected_name =
+        "f" + std::to_string(i / 2) + (i % 2 == 0 ? "" : ".2") + ".tokens";
+    CHECK(fs::path(results[i].output_path).filename() == expected_name);
+
+    // the same as dumping the file on its own
+    std::string expected = "======= The VC compiler =======\n";
+    auto const tks = do_scan(sources[i].data(), sources[i].size());
+    for (auto const &t : tks) {
+      expected += to_string(t, sources[i].data(), sources[i].size()) + "\n";
+    }
+    CHECK(results[i].tokens == tks.size());
+
+    std::ifstream written(results[i].output_path, std::ios::binary);
+    std::stringstream contents;
+    contents << written.rdbuf();
+    CHECK(contents.str() == expected);
+  }
+  CHECK(report.bytes == bytes);
+
+  // parsed too, a file with a syntax error fails but still gets its dump
+  {
+    std::ofstream(dir / "in" / "good.vc") << "int x;\nint f() { return x; }";
+    std::ofstream(dir / "in" / "bad.vc") << "int x;\nint y = ;";
+    std::vector<std::string> const parsed = {(dir / "in" / "good.vc").string(),
+                                             (dir / "in" / "bad.vc").string()};
+    options.parse = true;
+    BatchReport const parse_report =
+        run_batch(parsed, (dir / "out").string(), options, 2, &results);
+    CHECK(parse_report.failed == 1);
+    CHECK(results[0].ok);
+    CHECK_FALSE(results[1].ok);
+    CHECK(results[1].error == parsed[1] + ":2:9: syntax error at ;");
+    CHECK(results[1].tokens == 8);
+    CHECK(fs::file_size(results[1].output_path) > 0);
+  }
+
+  fs::remove_all(dir);
+}
+
+TEST_CASE("the compile server answers like the command line") {
+  namespace fs = std::filesystem;
+  std::string const socket_path =
+      (fs::temp_directory_path() /
+       ("evc_server_" + std::to_string(::getpid()) + ".sock"))
+          .string();
+
+  CompileServer server(2);
+  REQUIRE(server.listen(socket_path.c_str()));
+  std::thread serving([&server] { server.serve(); });
+
+  std::vector<std::string> const sources = scanner_test_sources();
+  auto const local = [](std::string const &src, CompileOptions const &opts) {
+    std::string ret;
+    TokenWriter out(&ret);
+    write_dump_start(opts, &out);
+    dump_tokens(src.data(), src.size(), opts, &out);
+    out.flush();
+    return ret;
+  };
+
+  // a few clients at once, each sending every source down one connection
+  std::vector<std::thread> clients;
+  std::atomic<uint32_t> mismatches{0};
+  for (uint32_t c = 0; c < 3; ++c) {
+    clients.emplace_back([&, c] {
+      CompileOptions opts;
+      opts.binary_dump = c == 1;
+      opts.lazy_positions = c == 2;
+      int const fd = connect_compile_server(socket_path.c_str());
+      if (fd < 0) {
+        ++mismatches;
+        return;
+      }
+      for (auto const &src : sources) {
+        ServerResponse response;
+        if (!request_compile(fd, opts, "f.vc", src.data(), src.size(),
+                             &response) ||
+            response.status != 0 || response.output != local(src, opts) ||
+            !response.diagnostics.empty()) {
+          ++mismatches;
+        }
+      }
+      ::close(fd);
+    });
+  }
+  for (auto &client : clients) {
+    client.join();
+  }
+  CHECK(mismatches.load() == 0);
+
+  // parsed on the server, a syntax error comes back as a diagnostic; the
+  // interner is emptied between requests, so the good source after it
+  // still parses
+  {
+    int const fd = connect_compile_server(socket_path.c_str());
+    REQUIRE(fd >= 0);
+    CompileOptions opts;
+    opts.parse = true;
+    for (std::string const src : {"int x;\nint y = ;", "int f() { x; }"}) {
+      bool const bad = src.back() == ';';
+      ServerResponse response;
+      REQUIRE(request_compile(fd, opts, "bad.vc", src.data(), src.size(),
+                              &response));
+      CHECK(response.output == local(src, opts));
+
+      std::string expected;
+      TokenWriter out(&expected);
+      CompileResult const result =
+          compile_source(src.data(), src.size(), opts, &out);
+      CHECK(result.ok == !bad);
+      CHECK(response.status == (bad ? 1 : 0));
+      CHECK(response.diagnostics ==
+            (result.ok ? "" : describe_syntax_error("bad.vc", result) + "\n"));
+    }
+    ::close(fd);
+  }
+
+  // checked on the server, like --check: no dump, and the first lexical
+  // error as the diagnostic
+  {
+    int const fd = connect_compile_server(socket_path.c_str());
+    REQUIRE(fd >= 0);
+    uint32_t errors = 0;
+    for (auto const &src : sources) {
+      ServerResponse response;
+      REQUIRE(request_check(fd, "f.vc", src.data(), src.size(), &response));
+      CHECK(response.output.empty());
+      Token error;
+      if (check_scan(src.data(), src.size(), &error)) {
+        CHECK(response.status == 0);
+        CHECK(response.diagnostics.empty());
+      } else {
+        ++errors;
+        CHECK(response.status == 1);
+        CHECK(response.diagnostics ==
+              describe_error("f.vc", error, spelling_of(error.kind)) + "\n");
+      }
+    }
+    CHECK(errors > 0);
+    ::close(fd);
+  }
+
+  // a length the server won't allocate for is refused, without the source
+  {
+    int const fd = connect_compile_server(socket_path.c_str());
+    REQUIRE(fd >= 0);
+    ServerRequestHeader const header = {
+        .magic = {'E', 'V', 'C', 'Q'},
+        .version = server_protocol_version,
+        .flags = 0,
+        .path_length = 0,
+        .source_length = server_max_source_length + 1,
+    };
+    REQUIRE(::write(fd, &header, sizeof(header)) == sizeof(header));
+    ServerResponseHeader response;
+    REQUIRE(::read(fd, &response, sizeof(response)) == sizeof(response));
+    CHECK(std::string(response.magic, 4) == "EVCR");
+    CHECK(response.status != 0);
+    CHECK(response.output_length == 0);
+    std::string diagnostics(response.diagnostics_length, '\0');
+    CHECK(::read(fd, diagnostics.data(), diagnostics.size()) ==
+          static_cast<ssize_t>(diagnostics.size()));
+    CHECK(diagnostics.find("too large") != std::string::npos);
+    // and the connection is closed
+    char byte;
+    CHECK(::read(fd, &byte, 1) == 0);
+    ::close(fd);
+  }
+
+  // an idle connection must not keep the server from stopping
+  int const idle = connect_compile_server(socket_path.c_str());
+  CHECK(idle >= 0);
+
+  int const fd = connect_compile_server(socket_path.c_str());
+  REQUIRE(fd >= 0);
+  CHECK(request_shutdown(fd));
+  ::close(fd);
+  serving.join();
+  ::close(idle);
+
+  CHECK_FALSE(fs::exists(socket_path));
+  CHECK(connect_compile_server(socket_path.c_str()) < 0);
+}
+
+TEST_CASE("relexing after an edit gives do_scan's tokens") {
+  SUBCASE("edits all over the test sources") {
+    static char const *const snippets[] = {
+        "", " ", "\n", "\r\n", "\t", "x", "e", "1", ".5", "+", "\"",
+        "\\", "/", "/*", "*/", "//", "int", "1e+", "<=", "\"s\\n\""};
+    uint32_t seed = 1;
+    auto const next = [&seed](uint32_t bound) {
+      seed = seed * 1103515245 + 12345;
+      return (seed >> 8) % bound;
+    };
+
+    for (auto const &src : scanner_test_sources()) {
+      for (uint32_t i = 0; i < 50; ++i) {
+        uint32_t const offset = next(src.size() + 1);
+        uint32_t const removed =
+            next(std::min<size_t>(src.size() - offset, 8) + 1);
+        std::string const inserted =
+            std::string(snippets[next(const_size_of(snippets))]) +
+            snippets[next(const_size_of(snippets))];
+        std::string const edited = src.substr(0, offset) + inserted +
+                                   src.substr(offset + removed);
+
+        auto tks = do_scan(src.data(), src.size());
+        relex(&tks, edited.data(), edited.size(),
+              TextEdit{offset, removed, inserted});
+        CHECK(tks == do_scan(edited.data(), edited.size()));
+      }
+    }
+  }
+
+  SUBCASE("only the edited part of a long file is lexed") {
+    std::string src;
+    for (uint32_t i = 0; i < 2000; ++i) {
+      src += "int f" + std::to_string(i) + "(float y) { return y * 1.5e+" +
+             std::to_string(i % 30) + "; } // line " + std::to_string(i) +
+             "\n";
+    }
+    auto tks = do_scan(src.data(), src.size());
+
+    uint32_t const offset = static_cast<uint32_t>(src.find("return", 30000));
+    std::string const inserted = "x = \"new\\t\"; /* more */\n  ";
+    std::string const edited =
+        src.substr(0, offset) + inserted + src.substr(offset);
+    RelexResult const r = relex(&tks, edited.data(), edited.size(),
+                                TextEdit{offset, 0, inserted});
+    CHECK(tks == do_scan(edited.data(), edited.size()));
+    CHECK(r.scanned_bytes < 1024);
+    CHECK(r.inserted < 20);
+    CHECK(r.removed < 20);
+
+    // opening a comment past the last "*/" swallows the rest of the file
+    uint32_t const open_at = offset + static_cast<uint32_t>(inserted.size());
+    std::string const opened =
+        edited.substr(0, open_at) + "/*" + edited.substr(open_at);
+    RelexResult const all =
+        relex(&tks, opened.data(), opened.size(), TextEdit{open_at, 0, "/*"});
+    CHECK(tks == do_scan(opened.data(), opened.size()));
+    CHECK(all.scanned_bytes == opened.size() - tks[all.first].start_offset);
+  }
+}
+
+TEST_CASE("non-ASCII text is lexed as UTF-8") {
+  auto const kinds = [](std::string const &src) {
+    std::vector<TokenKind> ret;
+    for (auto const &t : do_scan(src.data(), src.size())) {
+      ret.push_back(t.kind);
+    }
+    return ret;
+  };
+
+  SUBCASE("multibyte characters take up one column") {
+    // in a string, then a comment long enough for the vector kernels
+    std::string const src = "\"caf\xc3\xa9 \xe2\x82\xac\" x\n"
+                            "// " +
+                            std::string(40, '-') +
+                            " \xf0\x9f\x98\x80 \xc3\xa9\n"
+                            "y";
+    auto const tks = do_scan(src.data(), src.size());
+    REQUIRE(tks.size() == 4);
+    CHECK(tks[0].kind == TokenKind::STRINGLITERAL);
+    CHECK(tks[0].end_pos == SourcePosition{8, 1});
+    CHECK(tks[1].start_pos == SourcePosition{10, 1});
+    CHECK(tks[2].kind == TokenKind::ID);
+    CHECK(tks[2].start_pos == SourcePosition{1, 3});
+    CHECK(tks[3].kind == TokenKind::EVC_EOF);
+  }
+
+  SUBCASE("bytes that are not UTF-8 are errors") {
+    using K = TokenKind;
+    CHECK(kinds("a \xff b") ==
+          std::vector{K::ID, K::ERROR_INVALID_UTF8, K::ID, K::EVC_EOF});
+    // a character cut short is one error, not one per byte
+    CHECK(kinds("\xe2\x82;") ==
+          std::vector{K::ERROR_INVALID_UTF8, K::SEMICOLON, K::EVC_EOF});
+    // overlong forms and surrogates
+    CHECK(kinds("\xc0\xaf") == std::vector{K::ERROR_INVALID_UTF8,
+                                           K::ERROR_INVALID_UTF8, K::EVC_EOF});
+    CHECK(kinds("\xed\xa0\x80").size() == 4);
+    CHECK(kinds("/* \x80 */ x") ==
+          std::vector{K::ERROR_INVALID_UTF8, K::ID, K::EVC_EOF});
+    CHECK(kinds("\"a\xc3\" x") ==
+          std::vector{K::ERROR_STRINGLIT_WITH_INVALID_UTF8, K::ID, K::EVC_EOF});
+    CHECK(kinds("\"\\\xc3\xa9\"") ==
+          std::vector{K::ERROR_STRINGLIT_WITH_ILLEGAL_ESCAPE_CHAR, K::EVC_EOF});
+    CHECK(kinds("x \xf0\x9f\x98") ==
+          std::vector{K::ID, K::ERROR_INVALID_UTF8, K::EVC_EOF});
+  }
+
+  SUBCASE("every engine agrees") {
+    std::vector<std::string> const sources = {
+        "int x = 1; // \xc3\xa9t\xc3\xa9\n\"\xe2\x82\xac\\n\" y",
+        "/* \xf0\x9f\x98\x80\r\n\t\xe2\x82 */ a\xff\xfe"
+        "b",
+        "\"\xc3\" \xed\xa0\x80 \x80\x80 1.5e\xc3\xa9",
+        "/*\xe2\x82\xac*\xe2\x82\xac*/\"\\\xe2\x82\xac\\\r\n\xc3",
+    };
+    for (auto const &src : sources) {
+      auto const expected = do_scan(src.data(), src.size());
+
+      CHECK(do_scan(src.data(), src.size(), ScanEngine::Table) == expected);
+      CHECK(do_scan_parallel(src.data(), src.size(), 4, 8) == expected);
+
+      std::vector<uint32_t> escaped_crs;
+      auto lazy = do_scan_offsets(src.data(), src.size(), &escaped_crs);
+      resolve_positions(&lazy,
+                        LineIndex(src.data(), src.size(), escaped_crs));
+      CHECK(lazy == expected);
+
+      // a byte at a time splits every character
+      StreamScanner stream;
+      std::vector<Token> streamed;
+      for (char const c : src) {
+        stream.feed(&c, 1, &streamed);
+      }
+      stream.finish(&streamed);
+      CHECK(streamed == expected);
+    }
+  }
+}
+
+TEST_CASE("checking finds do_scan's first error") {
+  std::vector<std::string> sources = scanner_test_sources();
+  for (char const *src :
+       {"", "int x;", "a | b", "x = 1.;\n\"ab\\q\" y", "/* open", "\"open",
+        "ok\r\n\tok \xff", "1.2e+ 2 ."}) {
+    sources.push_back(src);
+  }
+
+  for (auto const &src : sources) {
+    auto const tks = do_scan(src.data(), src.size());
+    auto const first = std::find_if(tks.begin(), tks.end(), [](Token const &t) {
+      return is_error(t.kind);
+    });
+
+    Token error;
+    bool const ok = check_scan(src.data(), src.size(), &error);
+    CHECK(ok == (first == tks.end()));
+    if (!ok && first != tks.end()) {
+      CHECK(error == *first);
+    }
+  }
+}
+
+TEST_CASE("the arena hands out aligned memory and frees it all at once") {
+  struct Pod {
+    uint8_t tag;
+    double value;
+  };
+
+  Arena arena;
+  CHECK(arena.bytes_reserved() == 0);
+
+  std::vector<Pod *> pods;
+  for (uint32_t i = 0; i < 10000; ++i) {
+    Pod *const p = arena.alloc<Pod>();
+    CHECK(reinterpret_cast<uintptr_t>(p) % alignof(Pod) == 0);
+    p->tag = static_cast<uint8_t>(i);
+    p->value = i;
+    pods.push_back(p);
+    // odd sizes in between, to throw the alignment off
+    arena.allocate(i % 7 + 1, 1);
+  }
+  for (uint32_t i = 0; i < 10000; ++i) {
+    CHECK(pods[i]->value == i);
+  }
+  CHECK(arena.node_count() == 10000);
+  CHECK(arena.slab_count() > 1);
+  CHECK(arena.bytes_used() >= 10000 * sizeof(Pod));
+  CHECK(arena.bytes_reserved() >= arena.bytes_used());
+
+  // too big for a slab: gets one of its own, and bumping carries on in the
+  // current slab
+  size_t const slabs = arena.slab_count();
+  char *const before = static_cast<char *>(arena.allocate(1, 1));
+  arena.allocate(Arena::slab_size * 2, 8);
+  char *const after = static_cast<char *>(arena.allocate(1, 1));
+  CHECK(arena.slab_count() == slabs + 1);
+  CHECK(after == before + 1);
+
+  Pod *const made = arena.make<Pod>(Pod{.tag = 7, .value = 1.5});
+  CHECK(made->tag == 7);
+  CHECK(made->value == 1.5);
+
+  std::vector<uint32_t> const items = {1, 2, 3};
+  ArenaSpan<uint32_t> const span = arena.make_span(items.data(), 3);
+  CHECK(std::vector<uint32_t>(span.begin(), span.end()) == items);
+  CHECK(arena.make_span(items.data(), 0).empty());
+
+  Arena other;
+  other.alloc<Pod>();
+  uint32_t const nodes = arena.node_count() + other.node_count();
+  size_t const reserved = arena.bytes_reserved() + other.bytes_reserved();
+  arena.adopt(std::move(other));
+  CHECK(other.node_count() == 0);
+  CHECK(other.bytes_reserved() == 0);
+  CHECK(arena.node_count() == nodes);
+  CHECK(arena.bytes_reserved() == reserved);
+
+  Arena moved = std::move(arena);
+  CHECK(arena.node_count() == 0);
+  CHECK(moved.node_count() == nodes);
+  CHECK(span[2] == 3);
+}
@@ -1,8 +1,9 @@
 #include <string>
+#include <string_view>
 
 #include "token.hpp"
 
-static const std::string keywords[] = {
+static constexpr std::string_view keywords[] = {
     "boolean",
     "break",
     "continue",
@@ -48,11 +49,17 @@ static const std::string keywords[] = {
     "<error - unterminated comment>",
     "<error - unterminated string>",
     "<error - illegal escape character>",
+    "<error - invalid utf-8>",
+    "<error - invalid utf-8 in string>",
 };
 
 enum class TokenKind;
 
-std::string spell(TokenKind tk) { return keywords[static_cast<int>(tk)]; }
+std::string_view spelling_of(TokenKind tk) {
+  return keywords[static_cast<int>(tk)];
+}
+
+std::string spell(TokenKind tk) { return std::string(spelling_of(tk)); }
 
 static std::string pos_to_string(SourcePosition const &lhs,
                                  SourcePosition const &rhs) {
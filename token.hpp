@@ -1,5 +1,7 @@
 #pragma once
+#include <cstdint>
 #include <string>
+#include <string_view>
 
 enum class TokenKind {
   BOOLEAN = 0,
@@ -59,21 +61,52 @@ enum class TokenKind {
   ERROR_UNTERMINATED_COMMENT = 42,
   ERROR_UNTERMINATED_STRING = 43,
   ERROR_STRINGLIT_WITH_ILLEGAL_ESCAPE_CHAR = 44,
+  ERROR_INVALID_UTF8 = 45,
+  ERROR_STRINGLIT_WITH_INVALID_UTF8 = 46,
 };
 
 struct SourcePosition {
   int col_pos;
   int line_num;
+
+  bool operator==(SourcePosition const &) const = default;
 };
 
+// Token::payload when there is nothing behind the token.
+static constexpr uint32_t no_payload = UINT32_MAX;
+
 struct Token {
   TokenKind kind;
   uint32_t start_offset;
   uint32_t end_offset;
   SourcePosition start_pos;
   SourcePosition end_pos;
+  // For literals scanned by do_scan_literals(), their index in the
+  // LiteralTable (literal_table.hpp); for identifiers, when it was given a
+  // SymbolInterner, their symbol ID.
+  uint32_t payload = no_payload;
+
+  bool operator==(Token const &) const = default;
 };
 
+// Whether tk only ever comes out of the scanner for input that is not valid
+// VC.
+inline bool is_error(TokenKind tk) {
+  switch (tk) {
+  case TokenKind::ERROR:
+  case TokenKind::ERROR_UNTERMINATED_COMMENT:
+  case TokenKind::ERROR_UNTERMINATED_STRING:
+  case TokenKind::ERROR_STRINGLIT_WITH_ILLEGAL_ESCAPE_CHAR:
+  case TokenKind::ERROR_INVALID_UTF8:
+  case TokenKind::ERROR_STRINGLIT_WITH_INVALID_UTF8:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Points into a static table, so it never allocates.
+std::string_view spelling_of(TokenKind tk);
 std::string spell(TokenKind tk);
 std::string to_string(Token t, char const *buf, uint32_t length);
 
@@ -84,6 +117,7 @@ inline void restart_token(Token *tk, TokenKind kind, uint32_t offset,
   tk->end_offset = offset;
   tk->start_pos = curr_pos;
   tk->end_pos = curr_pos;
+  tk->payload = no_payload;
   return;
 }
 
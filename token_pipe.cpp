@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <string_view>
+#include <thread>
+
+#include "scanner_core.hpp"
+#include "scanner_internal.hpp"
+#include "symbol_interner.hpp"
+#include "token.hpp"
+#include "token_pipe.hpp"
+
+// Source bytes scanned per step. A step can't push more tokens than it has
+// bytes, plus the two held back and EOF, so on the parser's thread it always
+// fits in the ring next to the tokens still readable.
+static constexpr uint32_t same_thread_slice = 256;
+static constexpr uint32_t producer_slice = 16 * 1024;
+
+static_assert(same_thread_slice + 3 + TokenPipe::lookback +
+                  2 * TokenPipe::release_step <
+              TokenPipe::capacity);
+
+TokenPipe::TokenPipe(char const *start, uint32_t length, PipeMode mode,
+                     SymbolInterner *symbols)
+    : start(start), length(length), mode(mode), symbols(symbols) {
+  if (mode == PipeMode::ProducerThread) {
+    producer = std::thread([this] { produce(); });
+  }
+}
+
+TokenPipe::~TokenPipe() {
+  if (producer.joinable()) {
+    // wake the scanner if it is waiting for room, and let it run dry
+    cancelled.store(true, std::memory_order_release);
+    released.store(released_local + 1, std::memory_order_release);
+    released.notify_all();
+    producer.join();
+  }
+}
+
+uint32_t TokenPipe::size() const {
+  uint32_t const p = published.load(std::memory_order_acquire);
+  if (p != 0 && slots[(p - 1) % capacity].kind == TokenKind::EVC_EOF) {
+    return p;
+  }
+  return UINT32_MAX;
+}
+
+void TokenPipe::push_back(Token const &tk) {
+  if (pushed - released.load(std::memory_order_acquire) >= capacity) {
+    assert(mode == PipeMode::ProducerThread && "scanned too much at once");
+
+    // the parser may be waiting on exactly these
+    publish(pushed >= 2 ? pushed - 2 : 0);
+    for (;;) {
+      uint32_t const r = released.load(std::memory_order_acquire);
+      if (pushed - r < capacity ||
+          cancelled.load(std::memory_order_acquire)) {
+        break;
+      }
+      released.wait(r, std::memory_order_acquire);
+    }
+  }
+
+  slots[pushed % capacity] = tk;
+  ++pushed;
+}
+
+void TokenPipe::publish(uint32_t count) {
+  uint32_t const from = published.load(std::memory_order_relaxed);
+  if (count <= from) {
+    return;
+  }
+  // published tokens are final, so this is where identifiers get interned
+  if (symbols != nullptr) {
+    for (uint32_t i = from; i < count; ++i) {
+      Token &tk = slots[i % capacity];
+      if (tk.kind == TokenKind::ID) {
+        tk.payload = symbols->intern(std::string_view(
+            start + tk.start_offset, tk.end_offset - tk.start_offset));
+      }
+    }
+  }
+  published.store(count, std::memory_order_release);
+  if (mode == PipeMode::ProducerThread) {
+    published.notify_one();
+  }
+}
+
+bool TokenPipe::scan_slice(uint32_t slice) {
+  if (finished_scanning) {
+    return false;
+  }
+
+  uint32_t const limit =
+      length - state.offset > slice ? state.offset + slice : length;
+  scan_chunk<FullScan>(&state, start, 0, limit, this);
+
+  if (limit == length) {
+    finish_scan(&state, this);
+    finished_scanning = true;
+    publish(pushed);
+  } else {
+    publish(pushed >= 2 ? pushed - 2 : 0);
+  }
+  return true;
+}
+
+void TokenPipe::produce() {
+  while (!cancelled.load(std::memory_order_acquire) &&
+         scan_slice(producer_slice)) {
+  }
+}
+
+void TokenPipe::release_up_to(uint32_t i) {
+  // never the last readable token, which tells whether the scan is over
+  uint32_t const upto = std::min(i, readable);
+  if (upto < lookback + release_step) {
+    return;
+  }
+
+  uint32_t const target = (upto - lookback) / release_step * release_step;
+  if (target > released_local) {
+    released_local = target;
+    released.store(target, std::memory_order_release);
+    if (mode == PipeMode::ProducerThread) {
+      released.notify_one();
+    }
+  }
+}
+
+void TokenPipe::wait_for(uint32_t i) {
+  for (;;) {
+    uint32_t const p = published.load(std::memory_order_acquire);
+    readable = p;
+    release_up_to(i);
+
+    // EVC_EOF only ever comes last
+    if (i < p ||
+        (p != 0 && slots[(p - 1) % capacity].kind == TokenKind::EVC_EOF)) {
+      return;
+    }
+
+    if (mode == PipeMode::SameThread) {
+      scan_slice(same_thread_slice);
+    } else {
+      published.wait(p, std::memory_order_acquire);
+    }
+  }
+}
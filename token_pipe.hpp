@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <thread>
+
+#include "scanner_internal.hpp"
+#include "token.hpp"
+
+class SymbolInterner;
+
+enum class PipeMode {
+  // the scanner runs on the parser's thread, a slice of source at a time,
+  // whenever the parser looks past the last token scanned
+  SameThread,
+  // the scanner runs ahead on a thread of its own, blocking while the ring
+  // is full
+  ProducerThread,
+};
+
+// Tokens flowing from the scanner to the parser through a fixed ring of
+// `capacity` tokens, so the token array for the whole file never exists and
+// the parser can start before the scanner is done. Reads go through the
+// same kind(i) / operator[](i) interface as TokenStream, with i counting
+// from the first token of the file, and must not go back more than
+// `lookback` tokens from the furthest one read so far. Reading at or past
+// the EOF token gives the EOF token.
+//
+// Tokens are the same as do_scan's, except that with a SymbolInterner every
+// ID token gets its symbol ID as payload, as do_scan_literals() gives it.
+// The scanner side interns them, on the producer thread if there is one, so
+// nothing else may use the interner until the pipe is gone. The source has
+// to outlive the pipe.
+class TokenPipe {
+public:
+  static constexpr uint32_t capacity = 1024;
+  static constexpr uint32_t lookback = 8;
+  // The parser hands slots back to the scanner this many at a time.
+  static constexpr uint32_t release_step = 64;
+
+  TokenPipe(char const *start, uint32_t length, PipeMode mode,
+            SymbolInterner *symbols = nullptr);
+  // Stops the producer thread, if any, even if the parser gave up early.
+  ~TokenPipe();
+
+  TokenPipe(TokenPipe const &) = delete;
+  TokenPipe &operator=(TokenPipe const &) = delete;
+
+  TokenKind kind(uint32_t i) { return at(i).kind; }
+  Token operator[](uint32_t i) { return at(i); }
+
+  // Number of tokens, EOF included, once the scanner has finished; until
+  // then UINT32_MAX.
+  uint32_t size() const;
+
+  // Scanner side, the Out interface scan_chunk() writes through. Only for
+  // token_pipe.cpp.
+  void push_back(Token const &tk);
+  Token const &back() const { return slots[(pushed - 1) % capacity]; }
+  void pop_back() { --pushed; }
+
+private:
+  static_assert((capacity & (capacity - 1)) == 0);
+
+  Token const &at(uint32_t i) {
+    assert(i >= released_local && "read too far back");
+    if (i >= readable) {
+      wait_for(i);
+      if (i >= readable) {
+        // past the end: the last token is EVC_EOF
+        i = readable - 1;
+      }
+    } else if (i - released_local >= lookback + 2 * release_step) {
+      release_up_to(i);
+    }
+    return slots[i % capacity];
+  }
+
+  void wait_for(uint32_t i);
+  void release_up_to(uint32_t i);
+
+  // Scan the next slice of source; false once there is none left.
+  bool scan_slice(uint32_t slice);
+  void publish(uint32_t count);
+  void produce();
+
+  char const *start;
+  uint32_t length;
+  PipeMode mode;
+  SymbolInterner *symbols;
+
+  // scanner side
+  ScanState state = {};
+  uint32_t pushed = 0;
+  bool finished_scanning = false;
+
+  // Tokens [0, published) are final and may be read. The last two pushed
+  // are held back until the scan is done, as an exponent may still take
+  // them back (see HoldBackSink).
+  std::atomic<uint32_t> published{0};
+  // Slots before `released` may be overwritten.
+  std::atomic<uint32_t> released{0};
+  std::atomic<bool> finished{false};
+  std::atomic<bool> cancelled{false};
+
+  // parser side copies
+  uint32_t readable = 0;
+  uint32_t released_local = 0;
+
+  Token slots[capacity];
+  std::thread producer;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <concepts>
+#include <cstdint>
+#include <type_traits>
+
+#include "scanner_core.hpp"
+#include "scanner_internal.hpp"
+#include "token.hpp"
+
+// Push based scanning: instead of collecting every token into a vector, the
+// scanner hands each one to a consumer as soon as it is final, e.g.
+//
+//   uint32_t ints = 0;
+//   do_scan(src, length, [&](Token const &t) {
+//     ints += t.kind == TokenKind::INTLITERAL;
+//   });
+//
+// The consumer's type is a template parameter, so the call is resolved (and
+// usually inlined) at compile time. std::vector<Token> and TokenStream are
+// the collecting sinks, see scanner.hpp.
+
+// The scanner emits a number and the 'e' (and sign) after it as separate
+// tokens, then takes up to two of them back when exponent digits follow.
+// HoldBackSink gives a consumer the vector-like interface the scanner needs
+// by keeping the last two tokens until nothing can take them back.
+template <typename Consumer> class HoldBackSink {
+public:
+  explicit HoldBackSink(Consumer &consumer) : consumer(consumer) {}
+
+  void push_back(Token const &tk) {
+    if (held == 2) {
+      consumer(tokens[0]);
+      tokens[0] = tokens[1];
+      held = 1;
+    }
+    tokens[held++] = tk;
+  }
+
+  Token const &back() const { return tokens[held - 1]; }
+  void pop_back() { --held; }
+
+  // Hand over whatever is still held; the scan has to be finished.
+  void flush() {
+    for (uint32_t i = 0; i < held; ++i) {
+      consumer(tokens[i]);
+    }
+    held = 0;
+  }
+
+private:
+  Consumer &consumer;
+  Token tokens[2];
+  uint32_t held = 0;
+};
+
+// Same tokens as do_scan(start, length), each passed to consumer(Token const &)
+// in order as it completes.
+template <typename Consumer>
+  requires std::invocable<Consumer &, Token const &>
+void do_scan(char const *start, uint32_t length, Consumer &&consumer) {
+  HoldBackSink<std::remove_reference_t<Consumer>> sink(consumer);
+  scan_source<FullScan>(start, length, &sink);
+  sink.flush();
+}
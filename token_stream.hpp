@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "token.hpp"
+
+struct TokenSpan {
+  uint32_t start_offset;
+  uint32_t end_offset;
+};
+
+struct TokenPositions {
+  SourcePosition start_pos;
+  SourcePosition end_pos;
+};
+
+// Structure of arrays form of std::vector<Token>. Kinds are one byte each
+// and live in their own array, so walking the kinds (which is all the
+// parser does while looking ahead) touches one byte per token instead of a
+// whole 32 byte Token. Offsets, positions and payloads sit in arrays of their
+// own and are only pulled in when a full Token is asked for.
+class TokenStream {
+public:
+  uint32_t size() const { return static_cast<uint32_t>(kinds.size()); }
+  bool empty() const { return kinds.empty(); }
+
+  TokenKind kind(uint32_t i) const { return static_cast<TokenKind>(kinds[i]); }
+  TokenSpan span(uint32_t i) const { return spans[i]; }
+  TokenPositions positions(uint32_t i) const { return pos[i]; }
+  uint32_t payload(uint32_t i) const { return payloads[i]; }
+
+  Token operator[](uint32_t i) const {
+    return Token{
+        .kind = kind(i),
+        .start_offset = spans[i].start_offset,
+        .end_offset = spans[i].end_offset,
+        .start_pos = pos[i].start_pos,
+        .end_pos = pos[i].end_pos,
+        .payload = payloads[i],
+    };
+  }
+
+  Token back() const { return (*this)[size() - 1]; }
+
+  void push_back(Token const &tk) {
+    kinds.push_back(static_cast<uint8_t>(tk.kind));
+    spans.push_back(TokenSpan{tk.start_offset, tk.end_offset});
+    pos.push_back(TokenPositions{tk.start_pos, tk.end_pos});
+    payloads.push_back(tk.payload);
+  }
+
+  void pop_back() {
+    kinds.pop_back();
+    spans.pop_back();
+    pos.pop_back();
+    payloads.pop_back();
+  }
+
+  void reserve(uint32_t n) {
+    kinds.reserve(n);
+    spans.reserve(n);
+    pos.reserve(n);
+    payloads.reserve(n);
+  }
+
+  void clear() {
+    kinds.clear();
+    spans.clear();
+    pos.clear();
+    payloads.clear();
+  }
+
+  uint8_t const *kind_data() const { return kinds.data(); }
+
+private:
+  std::vector<uint8_t> kinds;
+  std::vector<TokenSpan> spans;
+  std::vector<TokenPositions> pos;
+  std::vector<uint32_t> payloads;
+};
+
+static_assert(static_cast<int>(
+                  TokenKind::ERROR_STRINGLIT_WITH_INVALID_UTF8) < 256,
+              "token kinds must fit in a byte");
+
+inline TokenStream to_token_stream(Token const *tks, uint32_t length) {
+  TokenStream ret;
+  ret.reserve(length);
+  for (uint32_t i = 0; i < length; ++i) {
+    ret.push_back(tks[i]);
+  }
+  return ret;
+}
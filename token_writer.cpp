@@ -0,0 +1,180 @@
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "token.hpp"
+#include "token_writer.hpp"
+
+// append_uint() makes sure this much room is left before formatting into the
+// buffer, which is never made smaller than twice that.
+static constexpr uint32_t max_field_length = 64;
+
+// Write out every iovec, retrying after signals and short writes.
+static bool write_all(int fd, struct iovec *iov, int count) {
+  while (count > 0) {
+    ssize_t written = ::writev(fd, iov, count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+
+    while (count > 0 && static_cast<size_t>(written) >= iov->iov_len) {
+      written -= static_cast<ssize_t>(iov->iov_len);
+      ++iov;
+      --count;
+    }
+    if (count > 0) {
+      iov->iov_base = static_cast<char *>(iov->iov_base) + written;
+      iov->iov_len -= static_cast<size_t>(written);
+    }
+  }
+  return true;
+}
+
+TokenWriter::TokenWriter(int fd, uint32_t capacity)
+    : fd(fd), capacity(capacity < 2 * max_field_length ? 2 * max_field_length
+                                                       : capacity) {
+  buf = static_cast<char *>(std::malloc(this->capacity));
+  assert(buf != nullptr);
+}
+
+TokenWriter::TokenWriter(std::string *sink, uint32_t capacity)
+    : TokenWriter(-1, capacity) {
+  this->sink = sink;
+}
+
+bool TokenWriter::emit(struct iovec *iov, int count) {
+  if (sink == nullptr) {
+    return write_all(fd, iov, count);
+  }
+  for (int i = 0; i < count; ++i) {
+    sink->append(static_cast<char const *>(iov[i].iov_base), iov[i].iov_len);
+  }
+  return true;
+}
+
+TokenWriter::~TokenWriter() {
+  flush();
+  std::free(buf);
+}
+
+bool TokenWriter::flush() {
+  if (used != 0) {
+    struct iovec iov = {buf, used};
+    failed |= !emit(&iov, 1);
+    used = 0;
+  }
+  return !failed;
+}
+
+void TokenWriter::append(std::string_view text) {
+  if (text.size() > capacity - used && text.size() < capacity) {
+    flush();
+  }
+  if (text.size() <= capacity - used) {
+    std::memcpy(buf + used, text.data(), text.size());
+    used += static_cast<uint32_t>(text.size());
+    return;
+  }
+
+  // too big to copy in: write it out behind the buffer in the same call
+  struct iovec iov[2] = {
+      {buf, used},
+      {const_cast<char *>(text.data()), text.size()},
+  };
+  failed |= !emit(iov, 2);
+  used = 0;
+}
+
+static constexpr char digit_pairs[] = "00010203040506070809"
+                                      "10111213141516171819"
+                                      "20212223242526272829"
+                                      "30313233343536373839"
+                                      "40414243444546474849"
+                                      "50515253545556575859"
+                                      "60616263646566676869"
+                                      "70717273747576777879"
+                                      "80818283848586878889"
+                                      "90919293949596979899";
+
+void TokenWriter::append_uint(uint32_t value) {
+  if (capacity - used < max_field_length) {
+    flush();
+  }
+
+  // two digits at a time from the back of a scratch buffer
+  char digits[10];
+  char *p = digits + sizeof(digits);
+  while (value >= 100) {
+    uint32_t const pair = (value % 100) * 2;
+    value /= 100;
+    *--p = digit_pairs[pair + 1];
+    *--p = digit_pairs[pair];
+  }
+  if (value >= 10) {
+    *--p = digit_pairs[value * 2 + 1];
+    *--p = digit_pairs[value * 2];
+  } else {
+    *--p = static_cast<char>('0' + value);
+  }
+
+  uint32_t const count = static_cast<uint32_t>(digits + sizeof(digits) - p);
+  std::memcpy(buf + used, p, count);
+  used += count;
+}
+
+// "line(col)"
+void TokenWriter::append_pos(SourcePosition const &pos) {
+  assert(pos.line_num >= 0 && pos.col_pos >= 0);
+  append_uint(static_cast<uint32_t>(pos.line_num));
+  append("(");
+  append_uint(static_cast<uint32_t>(pos.col_pos));
+  append(")");
+}
+
+void TokenWriter::write_raw(std::string_view text) { append(text); }
+
+void TokenWriter::write_text(Token const &t, char const *src) {
+  append("Kind = ");
+  append_uint(static_cast<uint32_t>(t.kind));
+  append(" [");
+  append(spelling_of(t.kind));
+  append("], spelling = \"");
+  append(
+      std::string_view(src + t.start_offset, t.end_offset - t.start_offset));
+  append("\", position = ");
+  append_pos(t.start_pos);
+  append("..");
+  append_pos(t.end_pos);
+  append("\n");
+}
+
+void TokenWriter::write_binary_header() {
+  BinaryDumpHeader header = {};
+  std::memcpy(header.magic, "EVCT", 4);
+  header.version = binary_dump_version;
+  header.record_size = sizeof(BinaryTokenRecord);
+  append(std::string_view(reinterpret_cast<char const *>(&header),
+                          sizeof(header)));
+}
+
+void TokenWriter::write_binary(Token const &t) {
+  BinaryTokenRecord record = {};
+  record.kind = static_cast<uint8_t>(t.kind);
+  record.start_offset = t.start_offset;
+  record.end_offset = t.end_offset;
+  record.start_line = static_cast<uint32_t>(t.start_pos.line_num);
+  record.start_col = static_cast<uint32_t>(t.start_pos.col_pos);
+  record.end_line = static_cast<uint32_t>(t.end_pos.line_num);
+  record.end_col = static_cast<uint32_t>(t.end_pos.col_pos);
+  append(std::string_view(reinterpret_cast<char const *>(&record),
+                          sizeof(record)));
+}
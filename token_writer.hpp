@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "token.hpp"
+
+struct iovec;
+
+// Buffered token dumps straight to a file descriptor. Everything is
+// formatted into one buffer allocated up front and handed to write(2) when
+// it fills up, so dumping a token never allocates.
+//
+// Text lines are exactly what to_string() gives, plus a '\n'. The binary
+// format is a BinaryDumpHeader followed by one BinaryTokenRecord per token,
+// in host byte order.
+class TokenWriter {
+public:
+  explicit TokenWriter(int fd, uint32_t capacity = 64 * 1024);
+  // Appends to *sink instead of writing to a file descriptor.
+  explicit TokenWriter(std::string *sink, uint32_t capacity = 64 * 1024);
+  // Flushes whatever is left.
+  ~TokenWriter();
+
+  TokenWriter(TokenWriter const &) = delete;
+  TokenWriter &operator=(TokenWriter const &) = delete;
+
+  void write_raw(std::string_view text);
+  // `src` is the buffer the token was scanned from.
+  void write_text(Token const &t, char const *src);
+
+  void write_binary_header();
+  void write_binary(Token const &t);
+
+  // Returns false if any write since construction failed.
+  bool flush();
+
+private:
+  bool emit(struct iovec *iov, int count);
+  void append(std::string_view text);
+  void append_uint(uint32_t value);
+  void append_pos(SourcePosition const &pos);
+
+  int fd;
+  std::string *sink = nullptr;
+  char *buf;
+  uint32_t capacity;
+  uint32_t used = 0;
+  bool failed = false;
+};
+
+struct BinaryDumpHeader {
+  char magic[4]; // "EVCT"
+  uint32_t version;
+  uint32_t record_size;
+};
+
+struct BinaryTokenRecord {
+  uint8_t kind;
+  uint8_t reserved[3];
+  uint32_t start_offset;
+  uint32_t end_offset;
+  uint32_t start_line;
+  uint32_t start_col;
+  uint32_t end_line;
+  uint32_t end_col;
+};
+
+static constexpr uint32_t binary_dump_version = 1;
+static_assert(sizeof(BinaryTokenRecord) == 28);
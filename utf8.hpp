@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+
+// UTF-8 decoding for the scanner and LineIndex, which have to agree on where
+// every character starts: a character takes up one column however many
+// bytes it has, and so does each maximal run of bytes that is not UTF-8
+// (the "maximal subpart" of Unicode's U+FFFD substitution rules).
+
+inline bool is_non_ascii(char c) {
+  return static_cast<unsigned char>(c) >= 0x80;
+}
+
+// A character part of the way through: how many continuation bytes are
+// still to come, and the range the next one has to be in.
+struct Utf8Decoder {
+  uint8_t need = 0;
+  uint8_t lo = 0x80;
+  uint8_t hi = 0xBF;
+};
+
+// Take continuation bytes p[0, avail) for as long as they fit *d. Returns how
+// many were taken; d->need is 0 once the character is complete.
+inline uint32_t utf8_continue(Utf8Decoder *d, char const *p, uint32_t avail) {
+  uint32_t taken = 0;
+  while (d->need > 0 && taken < avail) {
+    uint8_t const b = static_cast<uint8_t>(p[taken]);
+    if (b < d->lo || b > d->hi) {
+      break;
+    }
+    ++taken;
+    --d->need;
+    d->lo = 0x80;
+    d->hi = 0xBF;
+  }
+  return taken;
+}
+
+enum class Utf8Char : uint8_t {
+  Valid,
+  Invalid,
+  // p[0, avail) ran out before the character was complete
+  Open,
+};
+
+// Bytes of the character starting at p[0], a non-ASCII byte, as far as
+// p[0, avail) goes: the whole character if it is valid, the bytes that make
+// up one error if not. An Open character leaves *d ready for utf8_continue()
+// on the bytes after avail.
+inline uint32_t utf8_char(char const *p, uint32_t avail, Utf8Decoder *d,
+                          Utf8Char *what) {
+  uint8_t const lead = static_cast<uint8_t>(p[0]);
+  // overlong forms, surrogates and anything past U+10FFFF are ruled out by
+  // narrowing the range of the first continuation byte
+  if (lead >= 0xC2 && lead <= 0xDF) {
+    *d = Utf8Decoder{1, 0x80, 0xBF};
+  } else if (lead == 0xE0) {
+    *d = Utf8Decoder{2, 0xA0, 0xBF};
+  } else if (lead == 0xED) {
+    *d = Utf8Decoder{2, 0x80, 0x9F};
+  } else if (lead >= 0xE1 && lead <= 0xEF) {
+    *d = Utf8Decoder{2, 0x80, 0xBF};
+  } else if (lead == 0xF0) {
+    *d = Utf8Decoder{3, 0x90, 0xBF};
+  } else if (lead >= 0xF1 && lead <= 0xF3) {
+    *d = Utf8Decoder{3, 0x80, 0xBF};
+  } else if (lead == 0xF4) {
+    *d = Utf8Decoder{3, 0x80, 0x8F};
+  } else {
+    // a stray continuation byte, or one that never appears in UTF-8
+    *d = Utf8Decoder{};
+    *what = Utf8Char::Invalid;
+    return 1;
+  }
+
+  uint32_t const n = 1 + utf8_continue(d, p + 1, avail - 1);
+  if (d->need == 0) {
+    *what = Utf8Char::Valid;
+  } else if (n == avail) {
+    *what = Utf8Char::Open;
+  } else {
+    *what = Utf8Char::Invalid;
+  }
+  return n;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Indices [begin, end) still to be run by one worker, packed into a single
+// word so the owner taking from the front and thieves taking from the back
+// never need a lock.
+class WorkRange {
+public:
+  void reset(uint32_t begin, uint32_t end) {
+    range.store(pack(begin, end), std::memory_order_release);
+  }
+
+  // Owner side: the next index, or false once the range is empty.
+  bool take_front(uint32_t *i) {
+    uint64_t r = range.load(std::memory_order_acquire);
+    for (;;) {
+      uint32_t const begin = front_of(r);
+      uint32_t const end = back_of(r);
+      if (begin >= end) {
+        return false;
+      }
+      if (range.compare_exchange_weak(r, pack(begin + 1, end),
+                                      std::memory_order_acq_rel)) {
+        *i = begin;
+        return true;
+      }
+    }
+  }
+
+  // Thief side: move the back half (at least one index) out of this range.
+  bool steal_half(uint32_t *begin_out, uint32_t *end_out) {
+    uint64_t r = range.load(std::memory_order_acquire);
+    for (;;) {
+      uint32_t const begin = front_of(r);
+      uint32_t const end = back_of(r);
+      if (begin >= end) {
+        return false;
+      }
+      uint32_t const mid = end - (end - begin + 1) / 2;
+      if (range.compare_exchange_weak(r, pack(begin, mid),
+                                      std::memory_order_acq_rel)) {
+        *begin_out = mid;
+        *end_out = end;
+        return true;
+      }
+    }
+  }
+
+private:
+  static uint64_t pack(uint32_t begin, uint32_t end) {
+    return uint64_t{end} << 32 | begin;
+  }
+  static uint32_t front_of(uint64_t r) { return static_cast<uint32_t>(r); }
+  static uint32_t back_of(uint64_t r) { return static_cast<uint32_t>(r >> 32); }
+
+  std::atomic<uint64_t> range{0};
+};
+
+// Run work(i) for every i in [0, count) on `threads` threads, the calling
+// thread being one of them. Every thread starts on an even slice of the
+// indices in order; one that runs dry steals the back half of another's
+// remaining slice, so a few slow items do not hold the rest up. Each index
+// is run exactly once, but in no particular order across threads.
+template <typename Work>
+void run_work_stealing(uint32_t count, uint32_t threads, Work work) {
+  threads = std::max(1u, std::min(threads, count));
+  if (threads == 1) {
+    for (uint32_t i = 0; i < count; ++i) {
+      work(i);
+    }
+    return;
+  }
+
+  std::unique_ptr<WorkRange[]> ranges(new WorkRange[threads]);
+  for (uint32_t t = 0; t < threads; ++t) {
+    ranges[t].reset(
+        static_cast<uint32_t>(uint64_t{count} * t / threads),
+        static_cast<uint32_t>(uint64_t{count} * (t + 1) / threads));
+  }
+
+  auto const worker = [&](uint32_t self) {
+    for (;;) {
+      uint32_t i;
+      while (ranges[self].take_front(&i)) {
+        work(i);
+      }
+
+      // Steal from the others in turn. Once they are all empty every index
+      // has been taken: a slice in the middle of being stolen belongs to the
+      // thief, which runs it itself.
+      bool stole = false;
+      for (uint32_t k = 1; k < threads && !stole; ++k) {
+        uint32_t begin, end;
+        if (ranges[(self + k) % threads].steal_half(&begin, &end)) {
+          ranges[self].reset(begin, end);
+          stole = true;
+        }
+      }
+      if (!stole) {
+        return;
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  workers.reserve(threads - 1);
+  for (uint32_t t = 1; t < threads; ++t) {
+    workers.emplace_back(worker, t);
+  }
+  worker(0);
+  for (auto &w : workers) {
+    w.join();
+  }
+}